@@ -0,0 +1,228 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "interface/displayserver.h"
+
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "common/debug.h"
+#include "common/option.h"
+
+static struct Option headlessOptions[] =
+{
+  {
+    .module       = "headless",
+    .name         = "enable",
+    .description  = "Run without a window or GPU for benchmarking the frame pipeline",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = false,
+  },
+  {0}
+};
+
+static void headlessSetup(void)
+{
+  option_register(headlessOptions);
+}
+
+static bool headlessProbe(void)
+{
+  return option_get_bool("headless", "enable");
+}
+
+static bool headlessEarlyInit(void)
+{
+  return true;
+}
+
+static bool headlessInit(const LG_DSInitParams params)
+{
+  DEBUG_INFO("Running headless, nothing will be displayed");
+
+  /* there is no window to resize, report the requested size once so the
+   * renderer viewport is configured */
+  const struct Border border = {0};
+  app_handleResizeEvent(params.w, params.h, 1.0, border);
+  return true;
+}
+
+static void headlessStartup(void)
+{
+}
+
+static void headlessShutdown(void)
+{
+}
+
+static void headlessFree(void)
+{
+}
+
+static bool headlessGetProp(LG_DSProperty prop, void * ret)
+{
+  if (prop == LG_DS_WARP_SUPPORT)
+  {
+    *(enum LG_DSWarpSupport *)ret = LG_DS_WARP_NONE;
+    return true;
+  }
+
+  return false;
+}
+
+#ifdef ENABLE_EGL
+static EGLDisplay headlessGetEGLDisplay(void)
+{
+  return EGL_NO_DISPLAY;
+}
+
+static EGLNativeWindowType headlessGetEGLNativeWindow(void)
+{
+  return (EGLNativeWindowType)0;
+}
+
+static void headlessEGLSwapBuffers(EGLDisplay display, EGLSurface surface,
+    const struct Rect * damage, int count)
+{
+}
+#endif
+
+#ifdef ENABLE_OPENGL
+static LG_DSGLContext headlessGLCreateContext(void)
+{
+  return NULL;
+}
+
+static void headlessGLDeleteContext(LG_DSGLContext context)
+{
+}
+
+static void headlessGLMakeCurrent(LG_DSGLContext context)
+{
+}
+
+static void headlessGLSetSwapInterval(int interval)
+{
+}
+
+static void headlessGLSwapBuffers(void)
+{
+}
+#endif
+
+static void headlessGuestPointerUpdated(double x, double y, double localX,
+    double localY)
+{
+}
+
+static void headlessShowPointer(bool show)
+{
+}
+
+static void headlessGrab(void)
+{
+}
+
+static void headlessWarpPointer(int x, int y, bool exiting)
+{
+}
+
+static void headlessRealignPointer(void)
+{
+}
+
+static bool headlessIsValidPointerPos(int x, int y)
+{
+  return false;
+}
+
+static void headlessInhibitIdle(void)
+{
+}
+
+static void headlessWait(unsigned int time)
+{
+  usleep(time * 1000U);
+}
+
+static void headlessSetWindowSize(int x, int y)
+{
+}
+
+static bool headlessGetFullscreen(void)
+{
+  return false;
+}
+
+static void headlessSetFullscreen(bool fs)
+{
+}
+
+static void headlessMinimize(void)
+{
+}
+
+struct LG_DisplayServerOps LGDS_Headless =
+{
+  .setup               = headlessSetup,
+  .probe               = headlessProbe,
+  .earlyInit           = headlessEarlyInit,
+  .init                = headlessInit,
+  .startup             = headlessStartup,
+  .shutdown            = headlessShutdown,
+  .free                = headlessFree,
+  .getProp             = headlessGetProp,
+
+#ifdef ENABLE_EGL
+  .getEGLDisplay       = headlessGetEGLDisplay,
+  .getEGLNativeWindow  = headlessGetEGLNativeWindow,
+  .eglSwapBuffers      = headlessEGLSwapBuffers,
+#endif
+
+#ifdef ENABLE_OPENGL
+  .glCreateContext     = headlessGLCreateContext,
+  .glDeleteContext     = headlessGLDeleteContext,
+  .glMakeCurrent       = headlessGLMakeCurrent,
+  .glSetSwapInterval   = headlessGLSetSwapInterval,
+  .glSwapBuffers       = headlessGLSwapBuffers,
+#endif
+
+  .guestPointerUpdated = headlessGuestPointerUpdated,
+  .showPointer         = headlessShowPointer,
+  .grabPointer         = headlessGrab,
+  .ungrabPointer       = headlessGrab,
+  .capturePointer      = headlessGrab,
+  .uncapturePointer    = headlessGrab,
+  .grabKeyboard        = headlessGrab,
+  .ungrabKeyboard      = headlessGrab,
+  .warpPointer         = headlessWarpPointer,
+  .realignPointer      = headlessRealignPointer,
+  .isValidPointerPos   = headlessIsValidPointerPos,
+  .inhibitIdle         = headlessInhibitIdle,
+  .uninhibitIdle       = headlessInhibitIdle,
+  .wait                = headlessWait,
+  .setWindowSize       = headlessSetWindowSize,
+  .setFullscreen       = headlessSetFullscreen,
+  .getFullscreen       = headlessGetFullscreen,
+  .minimize            = headlessMinimize,
+
+  /* there is no clipboard without a desktop session */
+  .cbInit    = NULL,
+};
@@ -386,6 +386,10 @@ static int sdlEventFilter(void * userdata, SDL_Event * event)
           break;
         }
 
+        case SDL_WINDOWEVENT_EXPOSED:
+          app_invalidateWindow(true);
+          break;
+
         case SDL_WINDOWEVENT_MOVED:
           app_updateWindowPos(event->window.data1, event->window.data2);
           break;
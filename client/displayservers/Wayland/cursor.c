@@ -38,7 +38,8 @@ static const uint32_t cursorBitmap[] = {
   0x000000, 0x000000, 0x000000, 0x000000,
 };
 
-static struct wl_buffer * createCursorBuffer(void)
+static struct wl_buffer * createCursorBuffer(const uint32_t * pixels,
+    int width, int height, uint32_t format)
 {
   int fd = memfd_create("lg-cursor", 0);
   if (fd < 0)
@@ -48,26 +49,28 @@ static struct wl_buffer * createCursorBuffer(void)
   }
 
   struct wl_buffer * result = NULL;
+  const size_t size = width * height * sizeof(*pixels);
 
-  if (ftruncate(fd, sizeof cursorBitmap) < 0)
+  if (ftruncate(fd, size) < 0)
   {
     DEBUG_ERROR("Failed to ftruncate cursor shared memory: %d", errno);
     goto fail;
   }
 
-  void * shm_data = mmap(NULL, sizeof cursorBitmap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  void * shm_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
   if (shm_data == MAP_FAILED)
   {
     DEBUG_ERROR("Failed to map memory for cursor: %d", errno);
     goto fail;
   }
 
-  struct wl_shm_pool * pool = wl_shm_create_pool(wlWm.shm, fd, sizeof cursorBitmap);
-  result = wl_shm_pool_create_buffer(pool, 0, 4, 4, 16, WL_SHM_FORMAT_XRGB8888);
+  struct wl_shm_pool * pool = wl_shm_create_pool(wlWm.shm, fd, size);
+  result = wl_shm_pool_create_buffer(pool, 0, width, height,
+      width * sizeof(*pixels), format);
   wl_shm_pool_destroy(pool);
 
-  memcpy(shm_data, cursorBitmap, sizeof cursorBitmap);
-  munmap(shm_data, sizeof cursorBitmap);
+  memcpy(shm_data, pixels, size);
+  munmap(shm_data, size);
 
 fail:
   close(fd);
@@ -82,7 +85,8 @@ bool waylandCursorInit(void)
     return false;
   }
 
-  wlWm.cursorBuffer = createCursorBuffer();
+  wlWm.cursorBuffer = createCursorBuffer(cursorBitmap, 4, 4,
+      WL_SHM_FORMAT_XRGB8888);
   if (wlWm.cursorBuffer)
   {
     wlWm.cursor = wl_compositor_create_surface(wlWm.compositor);
@@ -99,10 +103,61 @@ void waylandCursorFree(void)
     wl_surface_destroy(wlWm.cursor);
   if (wlWm.cursorBuffer)
     wl_buffer_destroy(wlWm.cursorBuffer);
+  if (wlWm.guestCursor)
+    wl_surface_destroy(wlWm.guestCursor);
+  if (wlWm.guestCursorBuffer)
+    wl_buffer_destroy(wlWm.guestCursorBuffer);
+}
+
+void waylandUpdatePointer(void)
+{
+  if (wlWm.useGuestCursor)
+    wl_pointer_set_cursor(wlWm.pointer, wlWm.pointerEnterSerial,
+        wlWm.guestCursor, wlWm.guestCursorHX, wlWm.guestCursorHY);
+  else
+    wl_pointer_set_cursor(wlWm.pointer, wlWm.pointerEnterSerial,
+        wlWm.showPointer ? wlWm.cursor : NULL, 0, 0);
 }
 
 void waylandShowPointer(bool show)
 {
   wlWm.showPointer = show;
-  wl_pointer_set_cursor(wlWm.pointer, wlWm.pointerEnterSerial, show ? wlWm.cursor : NULL, 0, 0);
+  waylandUpdatePointer();
+}
+
+bool waylandSetGuestPointer(const LG_DSPointerShape * shape)
+{
+  if (!shape)
+  {
+    wlWm.useGuestCursor = false;
+    waylandUpdatePointer();
+    return true;
+  }
+
+  if (!wlWm.guestCursor &&
+      !(wlWm.guestCursor = wl_compositor_create_surface(wlWm.compositor)))
+  {
+    DEBUG_ERROR("Failed to create the guest cursor surface");
+    return false;
+  }
+
+  struct wl_buffer * buffer = createCursorBuffer(shape->pixels, shape->width,
+      shape->height, WL_SHM_FORMAT_ARGB8888);
+  if (!buffer)
+    return false;
+
+  wl_surface_attach(wlWm.guestCursor, buffer, 0, 0);
+  wl_surface_damage(wlWm.guestCursor, 0, 0, shape->width, shape->height);
+  wl_surface_commit(wlWm.guestCursor);
+
+  /* the compositor has the new contents once committed */
+  if (wlWm.guestCursorBuffer)
+    wl_buffer_destroy(wlWm.guestCursorBuffer);
+  wlWm.guestCursorBuffer = buffer;
+
+  wlWm.guestCursorHX  = shape->hx;
+  wlWm.guestCursorHY  = shape->hy;
+  wlWm.useGuestCursor = true;
+  waylandUpdatePointer();
+  return true;
 }
@@ -52,8 +52,8 @@ static void pointerEnterHandler(void * data, struct wl_pointer * pointer,
   wlWm.pointerInSurface = true;
   app_handleEnterEvent(true);
 
-  wl_pointer_set_cursor(pointer, serial, wlWm.showPointer ? wlWm.cursor : NULL, 0, 0);
   wlWm.pointerEnterSerial = serial;
+  waylandUpdatePointer();
 
   wlWm.cursorX = wl_fixed_to_double(sxW);
   wlWm.cursorY = wl_fixed_to_double(syW);
@@ -162,6 +162,7 @@ struct LG_DisplayServerOps LGDS_Wayland =
 #endif
   .guestPointerUpdated = waylandGuestPointerUpdated,
   .showPointer         = waylandShowPointer,
+  .setGuestPointer     = waylandSetGuestPointer,
   .grabPointer         = waylandGrabPointer,
   .ungrabPointer       = waylandUngrabPointer,
   .capturePointer      = waylandCapturePointer,
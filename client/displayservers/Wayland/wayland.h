@@ -124,6 +124,11 @@ struct WaylandDSState
   struct wl_surface * cursor;
   struct wl_buffer * cursorBuffer;
 
+  struct wl_surface * guestCursor;
+  struct wl_buffer * guestCursorBuffer;
+  int guestCursorHX, guestCursorHY;
+  bool useGuestCursor;
+
   struct wl_data_device_manager * dataDeviceManager;
 
   uint32_t capabilities;
@@ -204,6 +209,8 @@ void waylandCBRelease(void);
 bool waylandCursorInit(void);
 void waylandCursorFree(void);
 void waylandShowPointer(bool show);
+bool waylandSetGuestPointer(const LG_DSPointerShape * shape);
+void waylandUpdatePointer(void);
 
 // gl module
 #if defined(ENABLE_EGL) || defined(ENABLE_OPENGL)
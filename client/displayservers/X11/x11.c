@@ -30,6 +30,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <X11/extensions/XInput2.h>
 #include <X11/extensions/scrnsaver.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/Xcursor/Xcursor.h>
 
 #include <GL/glx.h>
 #include <GL/glxext.h>
@@ -444,6 +445,7 @@ static bool x11Init(const LG_DSInitParams params)
 
   /* default to the square cursor */
   XDefineCursor(x11.display, x11.window, x11.squareCursor);
+  x11.showPointer = true;
 
   XMapWindow(x11.display, x11.window);
   XFlush(x11.display);
@@ -480,6 +482,8 @@ static void x11Free(void)
   if (x11.window)
     XDestroyWindow(x11.display, x11.window);
 
+  if (x11.guestCursor)
+    XFreeCursor(x11.display, x11.guestCursor);
   XFreeCursor(x11.display, x11.squareCursor);
   XFreeCursor(x11.display, x11.blankCursor);
   XCloseDisplay(x11.display);
@@ -614,6 +618,10 @@ static int x11EventThread(void * unused)
         break;
       }
 
+      case Expose:
+        app_invalidateWindow(true);
+        break;
+
       case GenericEvent:
       {
         XGenericEventCookie *cookie = (XGenericEventCookie*)&xe.xcookie;
@@ -943,7 +951,52 @@ static EGLNativeWindowType x11GetEGLNativeWindow(void)
 static void x11EGLSwapBuffers(EGLDisplay display, EGLSurface surface,
     const struct Rect * damage, int count)
 {
-  eglSwapBuffers(display, surface);
+  static bool                          swapWithDamageInit = false;
+  static eglSwapBuffersWithDamageKHR_t swapWithDamage     = NULL;
+  static EGLint                      * damageRects        = NULL;
+  static int                           damageRectCount    = 0;
+
+  if (!swapWithDamageInit)
+  {
+    const char *exts = eglQueryString(display, EGL_EXTENSIONS);
+    swapWithDamageInit = true;
+    if (util_hasGLExt(exts, "EGL_KHR_swap_buffers_with_damage") && g_egl_dynProcs.eglSwapBuffersWithDamageKHR)
+    {
+      swapWithDamage = g_egl_dynProcs.eglSwapBuffersWithDamageKHR;
+      DEBUG_INFO("Using EGL_KHR_swap_buffers_with_damage");
+    }
+    else if (util_hasGLExt(exts, "EGL_EXT_swap_buffers_with_damage") && g_egl_dynProcs.eglSwapBuffersWithDamageEXT)
+    {
+      swapWithDamage = g_egl_dynProcs.eglSwapBuffersWithDamageEXT;
+      DEBUG_INFO("Using EGL_EXT_swap_buffers_with_damage");
+    }
+    else
+      DEBUG_INFO("Swapping buffers with damage: not supported");
+  }
+
+  if (swapWithDamage && count)
+  {
+    if (count * 4 > damageRectCount)
+    {
+      free(damageRects);
+      damageRects = malloc(sizeof(EGLint) * count * 4);
+      if (!damageRects)
+        DEBUG_FATAL("Out of memory");
+      damageRectCount = count * 4;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      damageRects[i*4+0] = damage[i].x;
+      damageRects[i*4+1] = damage[i].y;
+      damageRects[i*4+2] = damage[i].w;
+      damageRects[i*4+3] = damage[i].h;
+    }
+
+    swapWithDamage(display, surface, damageRects, count);
+  }
+  else
+    eglSwapBuffers(display, surface);
 }
 #endif
 
@@ -1000,12 +1053,55 @@ static void x11GuestPointerUpdated(double x, double y, double localX, double loc
 
 static void x11ShowPointer(bool show)
 {
+  x11.showPointer = show;
+  if (x11.useGuestCursor)
+    return;
+
   if (show)
     XDefineCursor(x11.display, x11.window, x11.squareCursor);
   else
     XDefineCursor(x11.display, x11.window, x11.blankCursor);
 }
 
+static bool x11SetGuestPointer(const LG_DSPointerShape * shape)
+{
+  if (!shape)
+  {
+    x11.useGuestCursor = false;
+    x11ShowPointer(x11.showPointer);
+    XFlush(x11.display);
+    return true;
+  }
+
+  XcursorImage * image = XcursorImageCreate(shape->width, shape->height);
+  if (!image)
+  {
+    DEBUG_ERROR("Failed to create the cursor image");
+    return false;
+  }
+
+  image->xhot = shape->hx;
+  image->yhot = shape->hy;
+  memcpy(image->pixels, shape->pixels,
+      shape->width * shape->height * sizeof(*image->pixels));
+
+  Cursor cursor = XcursorImageLoadCursor(x11.display, image);
+  XcursorImageDestroy(image);
+  if (!cursor)
+  {
+    DEBUG_ERROR("Failed to load the cursor image");
+    return false;
+  }
+
+  XDefineCursor(x11.display, x11.window, cursor);
+  if (x11.guestCursor)
+    XFreeCursor(x11.display, x11.guestCursor);
+  x11.guestCursor    = cursor;
+  x11.useGuestCursor = true;
+  XFlush(x11.display);
+  return true;
+}
+
 static void x11PrintGrabError(const char * type, int dev, Status ret)
 {
   const char * errStr;
@@ -1256,6 +1352,7 @@ struct LG_DisplayServerOps LGDS_X11 =
 #endif
   .guestPointerUpdated = x11GuestPointerUpdated,
   .showPointer         = x11ShowPointer,
+  .setGuestPointer     = x11SetGuestPointer,
   .grabPointer         = x11GrabPointer,
   .ungrabPointer       = x11UngrabPointer,
   .capturePointer      = x11CapturePointer,
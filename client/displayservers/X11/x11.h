@@ -52,6 +52,9 @@ struct X11DSState
 
   Cursor blankCursor;
   Cursor squareCursor;
+  Cursor guestCursor;
+  bool   showPointer;
+  bool   useGuestCursor;
 
   // XFixes vars
   int eventBase;
@@ -22,6 +22,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "interface/font.h"
 #include "common/debug.h"
+#include "common/stringutils.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -161,42 +162,6 @@ static void lgf_freetype_destroy(LG_FontObj opaque)
   }
 }
 
-// A very simple UTF-8 decoder that assumes the input is valid.
-static unsigned int utf8_decode(const char * str)
-{
-  const unsigned char * ptr = (const unsigned char *) str;
-  // Handle the 4 byte case: 1111 0xxx 10xx xxxx 10xx xxxx 10xx xxxx.
-  if ((*ptr & 0xf8) == 0xf0)
-    return (ptr[0] & 0x07) << 18 | (ptr[1] & 0x3f) << 12 | (ptr[2] & 0x3f) << 6 | (ptr[3] & 0x3f);
-  // Handle the 3 byte case: 1110 xxxx 10xx xxxx 10xx xxxx.
-  else if ((*ptr & 0xf0) == 0xe0)
-    return (ptr[0] & 0x0f) << 12 | (ptr[1] & 0x3f) << 6 | (ptr[2] & 0x3f);
-  // Handle the 2 byte case: 110x xxxx 10xx xxxx.
-  else if ((*ptr & 0xe0) == 0xc0)
-    return (ptr[0] & 0x1f) << 6 | (ptr[1] & 0x3f);
-  // Everything else is the 1 byte case.
-  else
-    return *ptr;
-}
-
-// Return the length of the current UTF-8 character. Assumes the input is valid.
-static unsigned int utf8_advance(const char * str)
-{
-  const unsigned char * ptr = (const unsigned char *) str;
-  // 4 byte case starts with 1111 0xxx.
-  if ((*ptr & 0xf8) == 0xf0)
-    return 4;
-  // 3 byte case starts with 1110 xxxx.
-  else if ((*ptr & 0xf0) == 0xe0)
-    return 3;
-  // 2 byte case starts with 110x xxxx.
-  else if ((*ptr & 0xe0) == 0xc0)
-    return 2;
-  // Everything else is the 1 byte case.
-  else
-    return 1;
-}
-
 static LG_FontBitmap * lgf_freetype_render(LG_FontObj opaque, unsigned int fg_color, const char * text)
 {
   struct Inst * this = (struct Inst *)opaque;
@@ -307,6 +272,39 @@ static LG_FontBitmap * lgf_freetype_render(LG_FontObj opaque, unsigned int fg_co
   return out;
 }
 
+static bool lgf_freetype_glyph(LG_FontObj opaque, unsigned int ch,
+    LG_FontGlyph * glyph)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  if (FT_Load_Char(this->face, ch, FT_LOAD_RENDER))
+  {
+    DEBUG_ERROR("Failed to load character: U+%x", ch);
+    return false;
+  }
+
+  FT_GlyphSlot slot = this->face->glyph;
+  glyph->width   = slot->bitmap.width;
+  glyph->height  = slot->bitmap.rows;
+  glyph->left    = slot->bitmap_left;
+  glyph->top     = slot->bitmap_top;
+  glyph->advance = slot->advance.x / 64;
+  glyph->pitch   = slot->bitmap.pitch;
+  glyph->pixels  = slot->bitmap.buffer;
+
+  // always hand out the bitmap top row first
+  if (glyph->pitch < 0 && glyph->height)
+    glyph->pixels -= (glyph->height - 1) * glyph->pitch;
+
+  return true;
+}
+
+static unsigned int lgf_freetype_line_height(LG_FontObj opaque)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  return this->height;
+}
+
 static void lgf_freetype_release(LG_FontObj opaque, LG_FontBitmap * font)
 {
   LG_FontBitmap * bitmap = (LG_FontBitmap *)font;
@@ -320,5 +318,7 @@ struct LG_Font LGF_freetype =
   .create       = lgf_freetype_create,
   .destroy      = lgf_freetype_destroy,
   .render       = lgf_freetype_render,
-  .release      = lgf_freetype_release
+  .release      = lgf_freetype_release,
+  .glyph        = lgf_freetype_glyph,
+  .lineHeight   = lgf_freetype_line_height
 };
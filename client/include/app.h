@@ -59,6 +59,18 @@ void app_handleFocusEvent(bool focused);
 void app_handleCloseEvent(void);
 void app_handleRenderEvent(const uint64_t timeUs);
 
+/**
+ * Wake the render thread as something visible has changed. If full is set the
+ * whole window is redrawn, for example after it was exposed.
+ */
+void app_invalidateWindow(bool full);
+
+/**
+ * Called by the renderer once the newest frame has been uploaded and can be
+ * drawn, this ends the upload stage of the latency statistics.
+ */
+void app_frameUploaded(void);
+
 void app_setFullscreen(bool fs);
 bool app_getFullscreen(void);
 bool app_getProp(LG_DSProperty prop, void * ret);
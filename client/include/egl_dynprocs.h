@@ -30,6 +30,18 @@ typedef void (*eglSwapBuffersWithDamageKHR_t)(EGLDisplay dpy,
     EGLSurface surface, const EGLint *rects, EGLint n_rects);
 typedef void (*glEGLImageTargetTexture2DOES_t)(GLenum target,
     GLeglImageOES image);
+typedef EGLBoolean (*eglSetDamageRegionKHR_t)(EGLDisplay dpy,
+    EGLSurface surface, EGLint *rects, EGLint n_rects);
+typedef void (*glCopyImageSubData_t)(GLuint srcName, GLenum srcTarget,
+    GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ, GLuint dstName,
+    GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ,
+    GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
+typedef void (*glGetProgramBinary_t)(GLuint program, GLsizei bufSize,
+    GLsizei * length, GLenum * binaryFormat, void * binary);
+typedef void (*glProgramBinary_t)(GLuint program, GLenum binaryFormat,
+    const void * binary, GLsizei length);
+typedef void (*glProgramParameteri_t)(GLuint program, GLenum pname,
+    GLint value);
 
 struct EGLDynProcs
 {
@@ -38,6 +50,11 @@ struct EGLDynProcs
   eglSwapBuffersWithDamageKHR_t  eglSwapBuffersWithDamageKHR;
   eglSwapBuffersWithDamageKHR_t  eglSwapBuffersWithDamageEXT;
   glEGLImageTargetTexture2DOES_t glEGLImageTargetTexture2DOES;
+  eglSetDamageRegionKHR_t        eglSetDamageRegionKHR;
+  glCopyImageSubData_t           glCopyImageSubData;
+  glGetProgramBinary_t           glGetProgramBinary;
+  glProgramBinary_t              glProgramBinary;
+  glProgramParameteri_t          glProgramParameteri;
 };
 
 extern struct EGLDynProcs g_egl_dynProcs;
@@ -76,6 +76,18 @@ typedef struct LG_DSInitParams
 }
 LG_DSInitParams;
 
+typedef struct LG_DSPointerShape
+{
+  int width, height;
+
+  // the hotspot
+  int hx, hy;
+
+  // width * height premultiplied ARGB pixels
+  const uint32_t * pixels;
+}
+LG_DSPointerShape;
+
 typedef void (* LG_ClipboardReplyFn)(void * opaque, const LG_ClipboardData type,
     uint8_t * data, uint32_t size);
 
@@ -131,6 +143,12 @@ struct LG_DisplayServerOps
   /* dm specific cursor implementations */
   void (*guestPointerUpdated)(double x, double y, double localX, double localY);
   void (*showPointer)(bool show);
+
+  /* optional, display the guest's cursor as the local pointer in place of the
+   * one selected by showPointer so it moves at the compositor's latency, or go
+   * back to the showPointer one if shape is NULL. Returns false on failure */
+  bool (*setGuestPointer)(const LG_DSPointerShape * shape);
+
   void (*grabKeyboard)();
   void (*ungrabKeyboard)();
   /* (un)grabPointer is used to toggle cursor tracking/confine in normal mode */
@@ -33,10 +33,22 @@ typedef struct LG_FontBitmap
 }
 LG_FontBitmap;
 
+typedef struct LG_FontGlyph
+{
+  unsigned int    width, height; // size of the bitmap in pixels
+  int             left, top;     // bitmap offset from the pen position
+  int             advance;       // horizontal pen advance in pixels
+  int             pitch;         // bytes between rows of the bitmap
+  const uint8_t * pixels;        // 8bit coverage, valid until the next call
+}
+LG_FontGlyph;
+
 typedef bool            (* LG_FontCreate      )(LG_FontObj * opaque, const char * font_name, unsigned int size);
 typedef void            (* LG_FontDestroy     )(LG_FontObj opaque);
 typedef LG_FontBitmap * (* LG_FontRender      )(LG_FontObj opaque, unsigned int fg_color, const char * text);
 typedef void            (* LG_FontRelease     )(LG_FontObj opaque, LG_FontBitmap * bitmap);
+typedef bool            (* LG_FontGlyphFn     )(LG_FontObj opaque, unsigned int ch, LG_FontGlyph * glyph);
+typedef unsigned int    (* LG_FontLineHeight  )(LG_FontObj opaque);
 
 typedef struct LG_Font
 {
@@ -46,5 +58,7 @@ typedef struct LG_Font
   LG_FontDestroy      destroy;
   LG_FontRender       render;
   LG_FontRelease      release;
+  LG_FontGlyphFn      glyph;
+  LG_FontLineHeight   lineHeight;
 }
 LG_Font;
\ No newline at end of file
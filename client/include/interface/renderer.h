@@ -45,7 +45,8 @@ typedef struct LG_RendererParams
 {
 //  TTF_Font * font;
 //  TTF_Font * alertFont;
-  bool       quickSplash;
+  bool         quickSplash;
+  unsigned int copyThreads; // 0 = auto
 }
 LG_RendererParams;
 
@@ -113,13 +114,14 @@ typedef void         (* LG_RendererOnResize     )(void * opaque, const int width
 typedef bool         (* LG_RendererOnMouseShape )(void * opaque, const LG_RendererCursor cursor, const int width, const int height, const int pitch, const uint8_t * data);
 typedef bool         (* LG_RendererOnMouseEvent )(void * opaque, const bool visible , const int x, const int y);
 typedef bool         (* LG_RendererOnFrameFormat)(void * opaque, const LG_RendererFormat format, bool useDMA);
-typedef bool         (* LG_RendererOnFrame      )(void * opaque, const FrameBuffer * frame, int dmaFD);
+typedef bool         (* LG_RendererOnFrame      )(void * opaque, const FrameBuffer * frame, int dmaFD, const FrameDamageRect * damageRects, int damageRectsCount);
 typedef void         (* LG_RendererOnAlert      )(void * opaque, const LG_MsgAlert alert, const char * message, bool ** closeFlag);
 typedef void         (* LG_RendererOnHelp       )(void * opaque, const char * message);
 typedef void         (* LG_RendererOnShowFPS    )(void * opaque, bool showFPS);
 typedef bool         (* LG_RendererRenderStartup)(void * opaque);
-typedef bool         (* LG_RendererRender       )(void * opaque, LG_RendererRotate rotate);
-typedef void         (* LG_RendererUpdateFPS    )(void * opaque, const float avgUPS, const float avgFPS);
+typedef bool         (* LG_RendererNeedsRender  )(void * opaque);
+typedef bool         (* LG_RendererRender       )(void * opaque, LG_RendererRotate rotate, const bool invalidateWindow);
+typedef void         (* LG_RendererUpdateFPS    )(void * opaque, const float avgUPS, const float avgFPS, const char * stats);
 
 typedef struct LG_Renderer
 {
@@ -140,6 +142,7 @@ typedef struct LG_Renderer
   LG_RendererOnHelp         on_help;
   LG_RendererOnShowFPS      on_show_fps;
   LG_RendererRenderStartup  render_startup;
+  LG_RendererNeedsRender    needs_render;
   LG_RendererRender         render;
   LG_RendererUpdateFPS      update_fps;
 }
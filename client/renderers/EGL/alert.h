@@ -21,14 +21,13 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <stdbool.h>
 
-#include "interface/font.h"
+#include "text.h"
 
 typedef struct EGL_Alert EGL_Alert;
 
-bool egl_alert_init(EGL_Alert ** alert, const LG_Font * font, LG_FontObj fontObj);
+bool egl_alert_init(EGL_Alert ** alert, EGL_FontAtlas * atlas);
 void egl_alert_free(EGL_Alert ** alert);
 
 void egl_alert_set_color(EGL_Alert * alert, const uint32_t color);
 void egl_alert_set_text (EGL_Alert * alert, const char * str);
-void egl_alert_set_font (EGL_Alert * alert, LG_Font * fontObj);
 void egl_alert_render   (EGL_Alert * alert, const float scaleX, const float scaleY);
\ No newline at end of file
@@ -21,6 +21,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/debug.h"
 #include "common/locking.h"
 #include "common/option.h"
+#include "common/cursor.h"
 
 #include "texture.h"
 #include "shader.h"
@@ -34,26 +35,53 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "cursor_rgb.frag.h"
 #include "cursor_mono.frag.h"
 
+// number of converted cursor shapes to keep on the GPU
+#define CURSOR_CACHE 8
+
 struct CursorTex
 {
-  struct EGL_Texture * texture;
   struct EGL_Shader  * shader;
   GLuint uMousePos;
   GLuint uRotate;
   GLuint uCBMode;
 };
 
+struct CursorShape
+{
+  bool              valid;
+  uint64_t          hash;
+  LG_RendererCursor type;
+  int               width;
+  int               height;
+  uint64_t          used;
+
+  struct EGL_Texture * norm;
+  struct EGL_Texture * mono;
+};
+
 struct EGL_Cursor
 {
   LG_Lock           lock;
+
+  // the pending shape, converted on the cursor thread
   LG_RendererCursor type;
   int               width;
   int               height;
-  int               stride;
-  uint8_t *         data;
+  uint64_t          hash;
+  uint32_t *        data;
   size_t            dataSize;
+  bool              converted;
   bool              update;
 
+  // the conversion buffer, only touched by the cursor thread
+  uint32_t *        convData;
+  size_t            convSize;
+
+  // the shape cache, only modified by the render thread
+  struct CursorShape   cache[CURSOR_CACHE];
+  struct CursorShape * shape;
+  uint64_t             useCount;
+
   // cursor state
   bool              visible;
   float             x, y, w, h;
@@ -69,12 +97,6 @@ static bool egl_cursor_tex_init(struct CursorTex * t,
     const char * vertex_code  , size_t vertex_size,
     const char * fragment_code, size_t fragment_size)
 {
-  if (!egl_texture_init(&t->texture, NULL))
-  {
-    DEBUG_ERROR("Failed to initialize the cursor texture");
-    return false;
-  }
-
   if (!egl_shader_init(&t->shader))
   {
     DEBUG_ERROR("Failed to initialize the cursor shader");
@@ -113,10 +135,74 @@ static inline void egl_cursor_tex_uniforms(EGL_Cursor * cursor, struct CursorTex
 
 static void egl_cursor_tex_free(struct CursorTex * t)
 {
-  egl_texture_free(&t->texture);
-  egl_shader_free (&t->shader );
+  egl_shader_free(&t->shader);
 };
 
+static struct CursorShape * egl_cursor_find(EGL_Cursor * cursor,
+    const uint64_t hash, const LG_RendererCursor type, const int width,
+    const int height)
+{
+  for(int i = 0; i < CURSOR_CACHE; ++i)
+  {
+    struct CursorShape * shape = &cursor->cache[i];
+    if (shape->valid && shape->hash == hash && shape->type == type &&
+        shape->width == width && shape->height == height)
+      return shape;
+  }
+  return NULL;
+}
+
+static struct CursorShape * egl_cursor_evict(EGL_Cursor * cursor)
+{
+  struct CursorShape * lru = &cursor->cache[0];
+  for(int i = 0; i < CURSOR_CACHE; ++i)
+  {
+    struct CursorShape * shape = &cursor->cache[i];
+    if (!shape->valid)
+      return shape;
+
+    if (shape->used < lru->used)
+      lru = shape;
+  }
+
+  lru->valid = false;
+  return lru;
+}
+
+static bool egl_cursor_upload(EGL_Cursor * cursor, struct CursorShape * shape)
+{
+  if (!shape->norm && !egl_texture_init(&shape->norm, NULL, 0))
+  {
+    DEBUG_ERROR("Failed to initialize the cursor texture");
+    return false;
+  }
+
+  egl_texture_setup (shape->norm, EGL_PF_BGRA, cursor->width, cursor->height,
+      cursor->width * 4, false, false);
+  egl_texture_update(shape->norm, (uint8_t *)cursor->data);
+
+  if (cursor->type == LG_CURSOR_MONOCHROME)
+  {
+    if (!shape->mono && !egl_texture_init(&shape->mono, NULL, 0))
+    {
+      DEBUG_ERROR("Failed to initialize the cursor texture");
+      return false;
+    }
+
+    egl_texture_setup (shape->mono, EGL_PF_BGRA, cursor->width, cursor->height,
+        cursor->width * 4, false, false);
+    egl_texture_update(shape->mono,
+        (uint8_t *)(cursor->data + cursor->width * cursor->height));
+  }
+
+  shape->valid  = true;
+  shape->hash   = cursor->hash;
+  shape->type   = cursor->type;
+  shape->width  = cursor->width;
+  shape->height = cursor->height;
+  return true;
+}
+
 bool egl_cursor_init(EGL_Cursor ** cursor)
 {
   *cursor = (EGL_Cursor *)malloc(sizeof(EGL_Cursor));
@@ -158,8 +244,14 @@ void egl_cursor_free(EGL_Cursor ** cursor)
     return;
 
   LG_LOCK_FREE((*cursor)->lock);
-  if ((*cursor)->data)
-    free((*cursor)->data);
+  free((*cursor)->data);
+  free((*cursor)->convData);
+
+  for(int i = 0; i < CURSOR_CACHE; ++i)
+  {
+    egl_texture_free(&(*cursor)->cache[i].norm);
+    egl_texture_free(&(*cursor)->cache[i].mono);
+  }
 
   egl_cursor_tex_free(&(*cursor)->norm);
   egl_cursor_tex_free(&(*cursor)->mono);
@@ -172,33 +264,71 @@ void egl_cursor_free(EGL_Cursor ** cursor)
 bool egl_cursor_set_shape(EGL_Cursor * cursor, const LG_RendererCursor type,
     const int width, const int height, const int stride, const uint8_t * data)
 {
-  LG_LOCK(cursor->lock);
-
-  cursor->type   = type;
-  cursor->width  = width;
-  cursor->height = (type == LG_CURSOR_MONOCHROME ? height / 2 : height);
-  cursor->stride = stride;
+  const uint64_t hash = cursor_hash(type, width, height, stride, data);
+  const int      texH = type == LG_CURSOR_MONOCHROME ? height / 2 : height;
 
-  const size_t size = height * stride;
-  if (size > cursor->dataSize)
+  // if the shape is already on the GPU there is nothing to convert
+  LG_LOCK(cursor->lock);
+  if (egl_cursor_find(cursor, hash, type, width, texH))
   {
-    if (cursor->data)
-      free(cursor->data);
+    cursor->type      = type;
+    cursor->width     = width;
+    cursor->height    = texH;
+    cursor->hash      = hash;
+    cursor->converted = false;
+    cursor->update    = true;
+    LG_UNLOCK(cursor->lock);
+    return true;
+  }
+  LG_UNLOCK(cursor->lock);
 
-    cursor->data = (uint8_t *)malloc(size);
-    if (!cursor->data)
+  const size_t size = (size_t)width * height * sizeof(uint32_t);
+  if (size > cursor->convSize)
+  {
+    free(cursor->convData);
+    cursor->convData = (uint32_t *)malloc(size);
+    if (!cursor->convData)
     {
       DEBUG_ERROR("Failed to malloc buffer for cursor shape");
+      cursor->convSize = 0;
       return false;
     }
 
-    cursor->dataSize = size;
+    cursor->convSize = size;
   }
 
-  memcpy(cursor->data, data, size);
-  cursor->update = true;
+  switch(type)
+  {
+    case LG_CURSOR_COLOR:
+      cursor_convert_color(cursor->convData, data, width, height, stride);
+      break;
+
+    case LG_CURSOR_MASKED_COLOR:
+      cursor_convert_masked(cursor->convData, data, width, height, stride);
+      break;
+
+    case LG_CURSOR_MONOCHROME:
+      cursor_convert_mono(cursor->convData, data, width, height, stride);
+      break;
+  }
 
+  // hand the converted shape to the render thread, keeping its old buffer
+  LG_LOCK(cursor->lock);
+  uint32_t * tmpData = cursor->data;
+  size_t     tmpSize = cursor->dataSize;
+
+  cursor->data      = cursor->convData;
+  cursor->dataSize  = cursor->convSize;
+  cursor->convData  = tmpData;
+  cursor->convSize  = tmpSize;
+  cursor->type      = type;
+  cursor->width     = width;
+  cursor->height    = texH;
+  cursor->hash      = hash;
+  cursor->converted = true;
+  cursor->update    = true;
   LG_UNLOCK(cursor->lock);
+
   return true;
 }
 
@@ -235,66 +365,45 @@ void egl_cursor_render(EGL_Cursor * cursor, LG_RendererRotate rotate)
     LG_LOCK(cursor->lock);
     cursor->update = false;
 
-    uint8_t * data = cursor->data;
+    struct CursorShape * shape = egl_cursor_find(cursor, cursor->hash,
+        cursor->type, cursor->width, cursor->height);
 
-    switch(cursor->type)
+    if (!shape && cursor->converted)
     {
-      case LG_CURSOR_MASKED_COLOR:
-        // fall through
-
-      case LG_CURSOR_COLOR:
-      {
-        egl_texture_setup(cursor->norm.texture, EGL_PF_BGRA, cursor->width, cursor->height, cursor->stride, false, false);
-        egl_texture_update(cursor->norm.texture, data);
-        egl_model_set_texture(cursor->model, cursor->norm.texture);
-        break;
-      }
-
-      case LG_CURSOR_MONOCHROME:
-      {
-        uint32_t and[cursor->width * cursor->height];
-        uint32_t xor[cursor->width * cursor->height];
-
-        for(int y = 0; y < cursor->height; ++y)
-          for(int x = 0; x < cursor->width; ++x)
-          {
-            const uint8_t  * srcAnd  = data + (cursor->stride * y) + (x / 8);
-            const uint8_t  * srcXor  = srcAnd + cursor->stride * cursor->height;
-            const uint8_t    mask    = 0x80 >> (x % 8);
-            const uint32_t   andMask = (*srcAnd & mask) ? 0xFFFFFFFF : 0xFF000000;
-            const uint32_t   xorMask = (*srcXor & mask) ? 0x00FFFFFF : 0x00000000;
-
-            and[y * cursor->width + x] = andMask;
-            xor[y * cursor->width + x] = xorMask;
-          }
-
-        egl_texture_setup (cursor->norm.texture, EGL_PF_BGRA, cursor->width, cursor->height, cursor->width * 4, false, false);
-        egl_texture_setup (cursor->mono.texture, EGL_PF_BGRA, cursor->width, cursor->height, cursor->width * 4, false, false);
-        egl_texture_update(cursor->norm.texture, (uint8_t *)and);
-        egl_texture_update(cursor->mono.texture, (uint8_t *)xor);
-        break;
-      }
+      shape = egl_cursor_evict(cursor);
+      if (!egl_cursor_upload(cursor, shape))
+        shape = NULL;
+    }
+
+    if (shape)
+    {
+      shape->used   = ++cursor->useCount;
+      cursor->shape = shape;
     }
     LG_UNLOCK(cursor->lock);
   }
 
+  struct CursorShape * shape = cursor->shape;
+  if (!shape)
+    return;
+
   cursor->rotate = rotate;
 
   glEnable(GL_BLEND);
-  switch(cursor->type)
+  switch(shape->type)
   {
     case LG_CURSOR_MONOCHROME:
     {
       egl_shader_use(cursor->norm.shader);
       egl_cursor_tex_uniforms(cursor, &cursor->norm, true);;
       glBlendFunc(GL_ZERO, GL_SRC_COLOR);
-      egl_model_set_texture(cursor->model, cursor->norm.texture);
+      egl_model_set_texture(cursor->model, shape->norm);
       egl_model_render(cursor->model);
 
       egl_shader_use(cursor->mono.shader);
       egl_cursor_tex_uniforms(cursor, &cursor->mono, true);;
       glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
-      egl_model_set_texture(cursor->model, cursor->mono.texture);
+      egl_model_set_texture(cursor->model, shape->mono);
       egl_model_render(cursor->model);
       break;
     }
@@ -304,6 +413,7 @@ void egl_cursor_render(EGL_Cursor * cursor, LG_RendererRotate rotate)
       egl_shader_use(cursor->norm.shader);
       egl_cursor_tex_uniforms(cursor, &cursor->norm, false);
       glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+      egl_model_set_texture(cursor->model, shape->norm);
       egl_model_render(cursor->model);
       break;
     }
@@ -313,6 +423,7 @@ void egl_cursor_render(EGL_Cursor * cursor, LG_RendererRotate rotate)
       egl_shader_use(cursor->mono.shader);
       egl_cursor_tex_uniforms(cursor, &cursor->mono, false);
       glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
+      egl_model_set_texture(cursor->model, shape->norm);
       egl_model_render(cursor->model);
       break;
     }
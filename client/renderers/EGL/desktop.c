@@ -103,7 +103,8 @@ static bool egl_init_desktop_shader(
   return true;
 }
 
-bool egl_desktop_init(EGL_Desktop ** desktop, EGLDisplay * display)
+bool egl_desktop_init(EGL_Desktop ** desktop, EGLDisplay * display,
+    unsigned int copyThreads)
 {
   *desktop = (EGL_Desktop *)malloc(sizeof(EGL_Desktop));
   if (!*desktop)
@@ -115,7 +116,7 @@ bool egl_desktop_init(EGL_Desktop ** desktop, EGLDisplay * display)
   memset(*desktop, 0, sizeof(EGL_Desktop));
   (*desktop)->display = display;
 
-  if (!egl_texture_init(&(*desktop)->texture, display))
+  if (!egl_texture_init(&(*desktop)->texture, display, copyThreads))
   {
     DEBUG_ERROR("Failed to initialize the desktop texture");
     return false;
@@ -258,7 +259,8 @@ bool egl_desktop_setup(EGL_Desktop * desktop, const LG_RendererFormat format, bo
   return true;
 }
 
-bool egl_desktop_update(EGL_Desktop * desktop, const FrameBuffer * frame, int dmaFd)
+bool egl_desktop_update(EGL_Desktop * desktop, const FrameBuffer * frame, int dmaFd,
+    const FrameDamageRect * damageRects, int damageRectsCount)
 {
   if (dmaFd >= 0)
   {
@@ -267,15 +269,22 @@ bool egl_desktop_update(EGL_Desktop * desktop, const FrameBuffer * frame, int dm
   }
   else
   {
-    if (!egl_texture_update_from_frame(desktop->texture, frame))
+    if (!egl_texture_update_from_frame(desktop->texture, frame,
+          damageRects, damageRectsCount))
       return false;
   }
 
-  enum EGL_TexStatus status;
-  if ((status = egl_texture_process(desktop->texture)) != EGL_TEX_STATUS_OK)
+  return true;
+}
+
+bool egl_desktop_process(EGL_Desktop * desktop, FrameDamageRect * damageRects,
+    int * damageRectsCount)
+{
+  if (egl_texture_process(desktop->texture, damageRects, damageRectsCount) ==
+      EGL_TEX_STATUS_ERROR)
   {
-    if (status != EGL_TEX_STATUS_NOTREADY)
-      DEBUG_ERROR("Failed to process the desktop texture");
+    DEBUG_ERROR("Failed to process the desktop texture");
+    return false;
   }
 
   return true;
@@ -35,11 +35,15 @@ enum EGL_DesktopScaleType
 struct Option;
 bool egl_desktop_scale_validate(struct Option * opt, const char ** error);
 
-bool egl_desktop_init(EGL_Desktop ** desktop, EGLDisplay * display);
+bool egl_desktop_init(EGL_Desktop ** desktop, EGLDisplay * display,
+    unsigned int copyThreads);
 void egl_desktop_free(EGL_Desktop ** desktop);
 
 bool egl_desktop_setup (EGL_Desktop * desktop, const LG_RendererFormat format, bool useDMA);
-bool egl_desktop_update(EGL_Desktop * desktop, const FrameBuffer * frame, int dmaFd);
+bool egl_desktop_update(EGL_Desktop * desktop, const FrameBuffer * frame, int dmaFd,
+    const FrameDamageRect * damageRects, int damageRectsCount);
+bool egl_desktop_process(EGL_Desktop * desktop, FrameDamageRect * damageRects,
+    int * damageRectsCount);
 bool egl_desktop_render(EGL_Desktop * desktop, const float x, const float y,
     const float scaleX, const float scaleY, enum EGL_DesktopScaleType scaleType,
     LG_RendererRotate rotate);
@@ -24,6 +24,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/sysinfo.h"
 #include "common/time.h"
 #include "common/locking.h"
+#include "common/event.h"
+#include "common/mutex.h"
+#include "common/thread.h"
 #include "util.h"
 #include "dynamic/fonts.h"
 
@@ -32,6 +35,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <assert.h>
 #include <math.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "app.h"
 #include "egl_dynprocs.h"
@@ -43,16 +47,34 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "splash.h"
 #include "alert.h"
 #include "help.h"
+#include "text.h"
+#include "graph.h"
 
 #define SPLASH_FADE_TIME 1000000
 #define ALERT_TIMEOUT    2000000
 
+// the oldest buffer age that can still be partially redrawn
+#define DAMAGE_HISTORY 4
+
 struct Options
 {
   bool vsync;
   bool doubleBuffer;
 };
 
+struct DesktopDamage
+{
+  bool            full;
+  int             count;
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+};
+
+struct DamageHistory
+{
+  bool        full;
+  struct Rect bbox;
+};
+
 struct Inst
 {
   bool dmaSupport;
@@ -63,7 +85,13 @@ struct Inst
   EGLDisplay           display;
   EGLConfig            configs;
   EGLSurface           surface;
-  EGLContext           context, frameContext;
+  EGLContext           context, frameContext, uploadContext;
+
+  LGThread           * uploadThread;
+  LGEvent            * uploadEvent;
+  atomic_bool          uploadRunning;
+  atomic_bool          uploadFailed;
+  LGMutex            * uploadLock;
 
   EGL_Desktop     * desktop; // the desktop
   EGL_Cursor      * cursor;  // the mouse cursor
@@ -71,6 +99,7 @@ struct Inst
   EGL_Splash      * splash;  // the splash screen
   EGL_Alert       * alert;   // the alert display
   EGL_Help        * help;    // the help display
+  EGL_Graph       * graph;   // the frame timing graph
 
   LG_RendererFormat    format;
   bool                 formatValid;
@@ -78,6 +107,9 @@ struct Inst
   uint64_t             waitFadeTime;
   bool                 waitDone;
 
+  // set whenever something visible changes, cleared by each render
+  atomic_bool invalidate;
+
   bool     showAlert;
   uint64_t alertTimeout;
   bool     useCloseFlag;
@@ -106,9 +138,17 @@ struct Inst
   unsigned          fontSize;
   LG_FontObj        helpFontObj;
   unsigned          helpFontSize;
+  EGL_FontAtlas   * fontAtlas;
+  EGL_FontAtlas   * helpAtlas;
 
   bool               cursorLastValid;
   struct CursorState cursorLast;
+
+  bool                 hasBufferAge;
+  LG_Lock              damageLock;
+  struct DesktopDamage desktopDamage;
+  struct DamageHistory damageHistory[DAMAGE_HISTORY];
+  int                  damageHistoryIdx;
 };
 
 static struct Option egl_options[] =
@@ -163,6 +203,27 @@ static struct Option egl_options[] =
     .validator    = egl_desktop_scale_validate,
     .value.x_int  = 0
   },
+  {
+    .module       = "egl",
+    .name         = "graphScale",
+    .description  = "The frame interval in milliseconds at the top of the timing graph",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 50
+  },
+  {
+    .module       = "egl",
+    .name         = "poolSize",
+    .description  = "Memory in MiB kept for the textures of recently used frame formats",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 256
+  },
+  {
+    .module       = "egl",
+    .name         = "shaderCache",
+    .description  = "Cache compiled shader programs on disk to speed up startup",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true
+  },
   {0}
 };
 
@@ -191,11 +252,8 @@ static bool egl_update_font(struct Inst * this)
     return false;
   }
 
-  if (this->alert)
-    egl_alert_set_font(this->alert, fontObj);
-
-  if (this->fps)
-    egl_fps_set_font(this->fps, fontObj);
+  if (this->fontAtlas)
+    egl_font_atlas_set_font(this->fontAtlas, fontObj);
 
   if (this->fontObj)
     this->font->destroy(this->fontObj);
@@ -217,8 +275,8 @@ static bool egl_update_help_font(struct Inst * this)
     return false;
   }
 
-  if (this->help)
-    egl_help_set_font(this->help, fontObj);
+  if (this->helpAtlas)
+    egl_font_atlas_set_font(this->helpAtlas, fontObj);
 
   if (this->helpFontObj)
     this->font->destroy(this->helpFontObj);
@@ -256,6 +314,10 @@ bool egl_create(void ** opaque, const LG_RendererParams params, bool * needsOpen
   this->screenScaleY = 1.0f;
   this->uiScale      = 1.0;
 
+  LG_LOCK_INIT(this->damageLock);
+  this->desktopDamage.full = true;
+  atomic_init(&this->invalidate, true);
+
   this->font = LG_Fonts[0];
   if (!egl_update_font(this))
     return false;
@@ -278,6 +340,20 @@ void egl_deinitialize(void * opaque)
 {
   struct Inst * this = (struct Inst *)opaque;
 
+  if (this->uploadThread)
+  {
+    atomic_store(&this->uploadRunning, false);
+    lgSignalEvent(this->uploadEvent);
+    lgJoinThread(this->uploadThread, NULL);
+    this->uploadThread = NULL;
+  }
+
+  if (this->uploadEvent)
+    lgFreeEvent(this->uploadEvent);
+
+  if (this->uploadLock)
+    lgFreeMutex(this->uploadLock);
+
   if (this->font)
   {
     if (this->fontObj)
@@ -294,14 +370,20 @@ void egl_deinitialize(void * opaque)
   egl_splash_free (&this->splash);
   egl_alert_free  (&this->alert );
   egl_help_free   (&this->help);
+  egl_font_atlas_free(&this->fontAtlas);
+  egl_font_atlas_free(&this->helpAtlas);
+  egl_graph_free  (&this->graph);
 
-  LG_LOCK_FREE(this->lock);
+  LG_LOCK_FREE(this->damageLock);
 
   eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 
   if (this->frameContext)
     eglDestroyContext(this->display, this->frameContext);
 
+  if (this->uploadContext)
+    eglDestroyContext(this->display, this->uploadContext);
+
   if (this->context)
     eglDestroyContext(this->display, this->context);
 
@@ -331,6 +413,11 @@ void egl_on_restart(void * opaque)
   eglDestroyContext(this->display, this->frameContext);
   this->frameContext = NULL;
   this->start        = false;
+
+  LG_LOCK(this->damageLock);
+  this->desktopDamage.full = true;
+  LG_UNLOCK(this->damageLock);
+  atomic_store(&this->invalidate, true);
 }
 
 static void egl_calc_mouse_size(struct Inst * this)
@@ -477,6 +564,7 @@ void egl_on_resize(void * opaque, const int width, const int height, const doubl
   egl_update_help_font(this);
 
   this->cursorLastValid = false;
+  atomic_store(&this->invalidate, true);
 }
 
 bool egl_on_mouse_shape(void * opaque, const LG_RendererCursor cursor,
@@ -494,6 +582,7 @@ bool egl_on_mouse_shape(void * opaque, const LG_RendererCursor cursor,
   this->mouseWidth  = width;
   this->mouseHeight = height;
   egl_calc_mouse_size(this);
+  atomic_store(&this->invalidate, true);
 
   return true;
 }
@@ -501,6 +590,11 @@ bool egl_on_mouse_shape(void * opaque, const LG_RendererCursor cursor,
 bool egl_on_mouse_event(void * opaque, const bool visible, const int x, const int y)
 {
   struct Inst * this = (struct Inst *)opaque;
+
+  /* a hidden cursor moving does not change anything on screen */
+  if (visible || this->cursorVisible)
+    atomic_store(&this->invalidate, true);
+
   this->cursorVisible = visible;
   this->cursorX       = x;
   this->cursorY       = y;
@@ -536,21 +630,118 @@ bool egl_on_frame_format(void * opaque, const LG_RendererFormat format, bool use
   }
 
   egl_update_scale_type(this);
-  return egl_desktop_setup(this->desktop, format, useDMA);
+
+  LG_LOCK(this->damageLock);
+  this->desktopDamage.full = true;
+  LG_UNLOCK(this->damageLock);
+  atomic_store(&this->invalidate, true);
+
+  /* the upload thread must not touch the texture while it is rebuilt, and
+   * will use the new objects from its own context. Both sides may block on
+   * the GPU while holding the lock, so it must not be a spinlock */
+  lgLockMutex(this->uploadLock);
+  const bool ret = egl_desktop_setup(this->desktop, format, useDMA);
+  glFinish();
+  lgUnlockMutex(this->uploadLock);
+
+  return ret;
+}
+
+/* merge damage into the damage for the next render, a count of 0 is full */
+static void egl_add_damage(struct Inst * this, const FrameDamageRect * rects,
+    int count)
+{
+  LG_LOCK(this->damageLock);
+  struct DesktopDamage * damage = &this->desktopDamage;
+  if (!count || damage->count + count > KVMFR_MAX_DAMAGE_RECTS)
+    damage->full = true;
+  else if (!damage->full)
+  {
+    memcpy(damage->rects + damage->count, rects,
+        count * sizeof(FrameDamageRect));
+    damage->count += count;
+  }
+  LG_UNLOCK(this->damageLock);
+  atomic_store(&this->invalidate, true);
+}
+
+/* owns the PBO to texture transfers and their fences so that the render
+ * thread only ever samples textures that are complete */
+static int egl_upload_thread(void * opaque)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  if (!eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+        this->uploadContext))
+  {
+    DEBUG_ERROR("Failed to make the upload context current");
+    return 1;
+  }
+
+  FrameDamageRect damageRects[KVMFR_MAX_DAMAGE_RECTS];
+  int             damageRectsCount;
+
+  while(atomic_load(&this->uploadRunning))
+  {
+    if (!lgWaitEvent(this->uploadEvent, 100))
+      continue;
+
+    lgLockMutex(this->uploadLock);
+    const bool ok = egl_desktop_process(this->desktop, damageRects,
+        &damageRectsCount);
+    lgUnlockMutex(this->uploadLock);
+
+    if (!ok)
+    {
+      /* the render thread reports this so the client does not keep showing a
+       * desktop that will never update again */
+      DEBUG_ERROR("The upload thread failed to process the desktop texture");
+      atomic_store(&this->uploadFailed, true);
+      app_invalidateWindow(false);
+      break;
+    }
+
+    /* the damage only becomes visible once the texture is published, the
+     * render thread may have skipped the frame signal that came before it */
+    if (damageRectsCount >= 0)
+    {
+      egl_graph_sample(this->graph, EGL_GRAPH_UPLOAD);
+      app_frameUploaded();
+      egl_add_damage(this, damageRects, damageRectsCount);
+      app_invalidateWindow(false);
+    }
+  }
+
+  eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+      EGL_NO_CONTEXT);
+  return 0;
 }
 
-bool egl_on_frame(void * opaque, const FrameBuffer * frame, int dmaFd)
+bool egl_on_frame(void * opaque, const FrameBuffer * frame, int dmaFd,
+    const FrameDamageRect * damageRects, int damageRectsCount)
 {
   struct Inst * this = (struct Inst *)opaque;
 
-  if (!egl_desktop_update(this->desktop, frame, dmaFd))
+  egl_graph_sample(this->graph, EGL_GRAPH_UPDATE);
+  if (!egl_desktop_update(this->desktop, frame, dmaFd, damageRects,
+        damageRectsCount))
   {
     DEBUG_INFO("Failed to to update the desktop");
     return false;
   }
 
+  /* DMA frames are sampled in place so the damage applies immediately, other
+   * frames are reported by the upload thread once their texture is ready */
+  if (dmaFd >= 0)
+  {
+    egl_graph_sample(this->graph, EGL_GRAPH_UPLOAD);
+    app_frameUploaded();
+    egl_add_damage(this, damageRects, damageRectsCount);
+  }
+  else
+    lgSignalEvent(this->uploadEvent);
+
   this->start = true;
-  this->cursorLastValid = false;
   return true;
 }
 
@@ -588,6 +779,8 @@ void egl_on_alert(void * opaque, const LG_MsgAlert alert, const char * message,
 
   this->showAlert = true;
   this->cursorLastValid = false;
+  atomic_store(&this->invalidate, true);
+  app_invalidateWindow(false);
 }
 
 void egl_on_help(void * opaque, const char * message)
@@ -595,12 +788,17 @@ void egl_on_help(void * opaque, const char * message)
   struct Inst * this = (struct Inst *)opaque;
   egl_help_set_text(this->help, message);
   this->cursorLastValid = false;
+  atomic_store(&this->invalidate, true);
+  app_invalidateWindow(false);
 }
 
 void egl_on_show_fps(void * opaque, bool showFPS)
 {
   struct Inst * this = (struct Inst *)opaque;
   egl_fps_set_display(this->fps, showFPS);
+  this->cursorLastValid = false;
+  atomic_store(&this->invalidate, true);
+  app_invalidateWindow(false);
 }
 
 bool egl_render_startup(void * opaque)
@@ -727,9 +925,17 @@ bool egl_render_startup(void * opaque)
     DEBUG_INFO("glEGLImageTargetTexture2DOES unavilable, DMA support disabled");
   }
 
+  if (util_hasGLExt(client_exts, "EGL_EXT_buffer_age") ||
+      util_hasGLExt(client_exts, "EGL_KHR_partial_update"))
+  {
+    DEBUG_INFO("Using buffer age for partial redraws");
+    this->hasBufferAge = true;
+  }
+
   eglSwapInterval(this->display, this->opt.vsync ? 1 : 0);
 
-  if (!egl_desktop_init(&this->desktop, this->display))
+  if (!egl_desktop_init(&this->desktop, this->display,
+        this->params.copyThreads))
   {
     DEBUG_ERROR("Failed to initialize the desktop");
     return false;
@@ -741,7 +947,14 @@ bool egl_render_startup(void * opaque)
     return false;
   }
 
-  if (!egl_fps_init(&this->fps, this->font, this->fontObj))
+  if (!egl_font_atlas_init(&this->fontAtlas, this->font, this->fontObj) ||
+      !egl_font_atlas_init(&this->helpAtlas, this->font, this->helpFontObj))
+  {
+    DEBUG_ERROR("Failed to initialize the font atlas");
+    return false;
+  }
+
+  if (!egl_fps_init(&this->fps, this->fontAtlas))
   {
     DEBUG_ERROR("Failed to initialize the FPS display");
     return false;
@@ -753,77 +966,177 @@ bool egl_render_startup(void * opaque)
     return false;
   }
 
-  if (!egl_alert_init(&this->alert, this->font, this->fontObj))
+  if (!egl_alert_init(&this->alert, this->fontAtlas))
   {
     DEBUG_ERROR("Failed to initialize the alert display");
     return false;
   }
 
-  if (!egl_help_init(&this->help, this->font, this->helpFontObj))
+  if (!egl_help_init(&this->help, this->helpAtlas))
   {
     DEBUG_ERROR("Failed to initialize the alert display");
     return false;
   }
 
+  if (!egl_graph_init(&this->graph, &this->invalidate))
+  {
+    DEBUG_ERROR("Failed to initialize the timing graph");
+    return false;
+  }
+
+  this->uploadContext = eglCreateContext(this->display, this->configs,
+      this->context, ctxattr);
+  if (this->uploadContext == EGL_NO_CONTEXT)
+  {
+    DEBUG_ERROR("Failed to create the upload context (eglError: 0x%x)",
+        eglGetError());
+    return false;
+  }
+
+  if (!(this->uploadEvent = lgCreateEvent(true, 0)))
+  {
+    DEBUG_ERROR("Failed to create the upload event");
+    return false;
+  }
+
+  if (!(this->uploadLock = lgCreateMutex()))
+  {
+    DEBUG_ERROR("Failed to create the upload lock");
+    return false;
+  }
+
+  atomic_store(&this->uploadRunning, true);
+  if (!lgCreateThread("eglUpload", egl_upload_thread, this,
+        &this->uploadThread))
+  {
+    DEBUG_ERROR("Failed to create the upload thread");
+    return false;
+  }
+
   return true;
 }
 
-bool egl_render(void * opaque, LG_RendererRotate rotate)
-{
-  struct Inst * this = (struct Inst *)opaque;
+static inline int imin(int a, int b) { return a < b ? a : b; }
+static inline int imax(int a, int b) { return a > b ? a : b; }
 
-  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+static inline bool rect_empty(const struct Rect * rect)
+{
+  return rect->w <= 0 || rect->h <= 0;
+}
 
-  bool hasLastCursor = this->cursorLastValid;
-  bool cursorRendered = false;
-  struct CursorState cursorState;
+static void rect_union(struct Rect * dst, const struct Rect * src)
+{
+  if (rect_empty(src))
+    return;
 
-  if (this->start && egl_desktop_render(this->desktop,
-        this->translateX, this->translateY,
-        this->scaleX    , this->scaleY    ,
-        this->scaleType , rotate))
+  if (rect_empty(dst))
   {
-    if (!this->waitFadeTime)
-    {
-      if (!this->params.quickSplash)
-        this->waitFadeTime = microtime() + SPLASH_FADE_TIME;
-      else
-        this->waitDone = true;
-    }
-
-    cursorRendered = true;
-    cursorState = egl_cursor_get_state(this->cursor, this->width, this->height);
-    egl_cursor_render(this->cursor,
-        (this->format.rotate + rotate) % LG_ROTATE_MAX);
+    *dst = *src;
+    return;
   }
 
-  if (!this->waitDone)
+  const int x2 = imax(dst->x + dst->w, src->x + src->w);
+  const int y2 = imax(dst->y + dst->h, src->y + src->h);
+  dst->x = imin(dst->x, src->x);
+  dst->y = imin(dst->y, src->y);
+  dst->w = x2 - dst->x;
+  dst->h = y2 - dst->y;
+}
+
+static void rect_clip(struct Rect * rect, int width, int height)
+{
+  const int x2 = imin(rect->x + rect->w, width );
+  const int y2 = imin(rect->y + rect->h, height);
+  rect->x = imax(rect->x, 0);
+  rect->y = imax(rect->y, 0);
+  rect->w = x2 - rect->x;
+  rect->h = y2 - rect->y;
+}
+
+/* map a damaged region of the guest frame to the window, the inverse of the
+ * rotation applied in the desktop shader. The region is grown by a texel as
+ * linear filtering samples the neighbours. */
+static struct Rect egl_desktop_damage_rect(struct Inst * this,
+    LG_RendererRotate rotate, const FrameDamageRect * damage)
+{
+  const float x0 = ((float)damage->x - 1.0f) / this->format.width;
+  const float y0 = ((float)damage->y - 1.0f) / this->format.height;
+  const float x1 = ((float)(damage->x + damage->width ) + 1.0f) /
+    this->format.width;
+  const float y1 = ((float)(damage->y + damage->height) + 1.0f) /
+    this->format.height;
+
+  float u0 = x0, u1 = x1, v0 = y0, v1 = y1;
+  switch(rotate)
   {
-    float a = 1.0f;
-    if (!this->waitFadeTime)
-      a = 1.0f;
-    else
-    {
-      uint64_t t = microtime();
-      if (t > this->waitFadeTime)
-        this->waitDone = true;
-      else
-      {
-        uint64_t delta = this->waitFadeTime - t;
-        a = 1.0f / SPLASH_FADE_TIME * delta;
-      }
-    }
+    case LG_ROTATE_0:
+      break;
 
-    if (!this->waitDone)
-      egl_splash_render(this->splash, a, this->splashRatio);
+    case LG_ROTATE_90:
+      u0 = 1.0f - y1; u1 = 1.0f - y0;
+      v0 = x0;        v1 = x1;
+      break;
+
+    case LG_ROTATE_180:
+      u0 = 1.0f - x1; u1 = 1.0f - x0;
+      v0 = 1.0f - y1; v1 = 1.0f - y0;
+      break;
+
+    case LG_ROTATE_270:
+      u0 = y0;        u1 = y1;
+      v0 = 1.0f - x1; v1 = 1.0f - x0;
+      break;
   }
-  else
+
+  // the desktop is laid out from the top, window coordinates start at bottom
+  const int left   = floorf(this->destRect.x + u0 * this->destRect.w);
+  const int right  = ceilf (this->destRect.x + u1 * this->destRect.w);
+  const int top    = floorf(this->destRect.y + v0 * this->destRect.h);
+  const int bottom = ceilf (this->destRect.y + v1 * this->destRect.h);
+
+  struct Rect rect =
   {
-    if (!this->start)
-      egl_splash_render(this->splash, 1.0f, this->splashRatio);
-  }
+    .x = left,
+    .y = this->height - bottom,
+    .w = right  - left,
+    .h = bottom - top
+  };
+  rect_clip(&rect, this->width, this->height);
+  return rect;
+}
+
+bool egl_needs_render(void * opaque)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  if (atomic_load(&this->invalidate) || atomic_load(&this->uploadFailed))
+    return true;
 
+  // the splash fade and the timing graph change on every frame
+  if ((!this->waitDone && this->waitFadeTime) ||
+      egl_graph_get_display(this->graph))
+    return true;
+
+  // the alert needs to be removed once it is closed or has timed out
+  if (this->showAlert &&
+      (this->useCloseFlag ? this->closeFlag : this->alertTimeout < microtime()))
+    return true;
+
+  return false;
+}
+
+bool egl_render(void * opaque, LG_RendererRotate rotate,
+    const bool invalidateWindow)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  if (atomic_load(&this->uploadFailed))
+    return false;
+
+  /* anything that changes from here on must cause another render */
+  atomic_store(&this->invalidate, false);
+
+  // update the alert and splash state first as they decide what is damaged
   if (this->showAlert)
   {
     bool close = false;
@@ -837,43 +1150,169 @@ bool egl_render(void * opaque, LG_RendererRotate rotate)
       this->showAlert = false;
       this->cursorLastValid = false;
     }
+  }
+
+  float splashAlpha = 1.0f;
+  if (!this->waitDone && this->waitFadeTime)
+  {
+    uint64_t t = microtime();
+    if (t > this->waitFadeTime)
+    {
+      this->waitDone = true;
+      this->cursorLastValid = false;
+    }
     else
-      egl_alert_render(this->alert, this->screenScaleX, this->screenScaleY);
+    {
+      uint64_t delta = this->waitFadeTime - t;
+      splashAlpha = 1.0f / SPLASH_FADE_TIME * delta;
+    }
   }
 
-  struct Rect damage[2];
+  struct DesktopDamage desktopDamage;
+  LG_LOCK(this->damageLock);
+  desktopDamage.full  = this->desktopDamage.full;
+  desktopDamage.count = this->desktopDamage.count;
+  memcpy(desktopDamage.rects, this->desktopDamage.rects,
+      desktopDamage.count * sizeof(FrameDamageRect));
+  this->desktopDamage.full  = false;
+  this->desktopDamage.count = 0;
+  LG_UNLOCK(this->damageLock);
+
+  struct CursorState cursorState = { .visible = false };
+  if (this->start)
+    cursorState = egl_cursor_get_state(this->cursor, this->width, this->height);
+
+  /* only the desktop and cursor can change between frames without forcing a
+   * full update, the graph changes every frame */
+  const bool partial =
+    this->start && this->waitDone && this->cursorLastValid &&
+    this->destRect.valid && !desktopDamage.full && !invalidateWindow &&
+    !egl_graph_get_display(this->graph);
+
+  struct Rect damage[KVMFR_MAX_DAMAGE_RECTS + 2];
+  struct Rect damageBBox = { 0 };
   int damageIdx = 0;
 
-  if (this->waitDone)
+  if (partial)
+  {
+    for(int i = 0; i < desktopDamage.count; ++i)
+    {
+      struct Rect rect =
+        egl_desktop_damage_rect(this, rotate, desktopDamage.rects + i);
+      if (!rect_empty(&rect))
+        damage[damageIdx++] = rect;
+    }
+
+    if (this->cursorLast.visible)
+      damage[damageIdx++] = this->cursorLast.rect;
+
+    if (cursorState.visible)
+      damage[damageIdx++] = cursorState.rect;
+
+    for(int i = 0; i < damageIdx; ++i)
+      rect_union(&damageBBox, damage + i);
+  }
+
+  /* the back buffer still holds the frame from `age` swaps ago, only the
+   * regions that changed since then need to be drawn again */
+  bool scissor = false;
+  struct Rect redraw = damageBBox;
+  EGLint age = 0;
+  if (partial && this->hasBufferAge &&
+      eglQuerySurface(this->display, this->surface, EGL_BUFFER_AGE_EXT, &age) &&
+      age > 0 && age <= DAMAGE_HISTORY)
   {
-    if (cursorRendered && hasLastCursor)
+    scissor = true;
+    for(int i = 1; i < age; ++i)
     {
-      if (this->cursorLast.visible)
-        damage[damageIdx++] = this->cursorLast.rect;
+      const struct DamageHistory * history = &this->damageHistory[
+        (this->damageHistoryIdx + DAMAGE_HISTORY - i) % DAMAGE_HISTORY];
 
-      if (cursorState.visible)
-        damage[damageIdx++] = cursorState.rect;
+      if (history->full)
+      {
+        scissor = false;
+        break;
+      }
+      rect_union(&redraw, &history->bbox);
+    }
+  }
 
-      this->cursorLast = cursorState;
+  if (scissor)
+  {
+    if (g_egl_dynProcs.eglSetDamageRegionKHR && !rect_empty(&redraw))
+    {
+      EGLint region[] = { redraw.x, redraw.y, redraw.w, redraw.h };
+      g_egl_dynProcs.eglSetDamageRegionKHR(this->display, this->surface,
+          region, 1);
     }
-    else if (cursorRendered)
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(redraw.x, redraw.y, imax(redraw.w, 0), imax(redraw.h, 0));
+  }
+
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  bool cursorRendered = false;
+  if (this->start && egl_desktop_render(this->desktop,
+        this->translateX, this->translateY,
+        this->scaleX    , this->scaleY    ,
+        this->scaleType , rotate))
+  {
+    if (!this->waitFadeTime)
     {
-      this->cursorLast = cursorState;
-      this->cursorLastValid = true;
+      if (!this->params.quickSplash)
+        this->waitFadeTime = microtime() + SPLASH_FADE_TIME;
+      else
+        this->waitDone = true;
     }
+
+    cursorRendered = true;
+    egl_cursor_render(this->cursor,
+        (this->format.rotate + rotate) % LG_ROTATE_MAX);
+  }
+
+  if (!this->waitDone)
+    egl_splash_render(this->splash, splashAlpha, this->splashRatio);
+  else if (!this->start)
+    egl_splash_render(this->splash, 1.0f, this->splashRatio);
+
+  if (this->showAlert)
+    egl_alert_render(this->alert, this->screenScaleX, this->screenScaleY);
+
+  if (this->waitDone && cursorRendered)
+  {
+    this->cursorLast      = cursorState;
+    this->cursorLastValid = true;
   }
 
   egl_fps_render(this->fps, this->screenScaleX, this->screenScaleY);
   egl_help_render(this->help, this->screenScaleX, this->screenScaleY);
-  app_eglSwapBuffers(this->display, this->surface, damage, damageIdx);
+  egl_graph_render(this->graph, this->screenScaleX, this->screenScaleY);
+
+  if (scissor)
+    glDisable(GL_SCISSOR_TEST);
+
+  app_eglSwapBuffers(this->display, this->surface, damage,
+      partial ? damageIdx : 0);
+  egl_graph_sample(this->graph, EGL_GRAPH_PRESENT);
+
+  this->damageHistory[this->damageHistoryIdx] = (struct DamageHistory)
+  {
+    .full = !partial,
+    .bbox = damageBBox
+  };
+  this->damageHistoryIdx = (this->damageHistoryIdx + 1) % DAMAGE_HISTORY;
   return true;
 }
 
-void egl_update_fps(void * opaque, const float avgUPS, const float avgFPS)
+void egl_update_fps(void * opaque, const float avgUPS, const float avgFPS,
+    const char * stats)
 {
   struct Inst * this = (struct Inst *)opaque;
-  egl_fps_update(this->fps, avgUPS, avgFPS);
+  egl_fps_update(this->fps, avgUPS, avgFPS, stats);
   this->cursorLastValid = false;
+  atomic_store(&this->invalidate, true);
 }
 
 struct LG_Renderer LGR_EGL =
@@ -894,6 +1333,7 @@ struct LG_Renderer LGR_EGL =
   .on_help         = egl_on_help,
   .on_show_fps     = egl_on_show_fps,
   .render_startup  = egl_render_startup,
+  .needs_render    = egl_needs_render,
   .render          = egl_render,
   .update_fps      = egl_update_fps
 };
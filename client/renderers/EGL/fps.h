@@ -21,14 +21,14 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <stdbool.h>
 
-#include "interface/font.h"
+#include "text.h"
 
 typedef struct EGL_FPS EGL_FPS;
 
-bool egl_fps_init(EGL_FPS ** fps, const LG_Font * font, LG_FontObj fontObj);
+bool egl_fps_init(EGL_FPS ** fps, EGL_FontAtlas * atlas);
 void egl_fps_free(EGL_FPS ** fps);
 
 void egl_fps_set_display(EGL_FPS * fps, bool display);
-void egl_fps_set_font   (EGL_FPS * fps, LG_Font * fontObj);
-void egl_fps_update(EGL_FPS * fps, const float avgUPS, const float avgFPS);
+void egl_fps_update(EGL_FPS * fps, const float avgUPS, const float avgFPS,
+    const char * stats);
 void egl_fps_render(EGL_FPS * fps, const float scaleX, const float scaleY);
\ No newline at end of file
@@ -0,0 +1,290 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "graph.h"
+#include "common/debug.h"
+#include "common/option.h"
+#include "common/time.h"
+
+#include "app.h"
+#include "shader.h"
+#include "model.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// these headers are auto generated by cmake
+#include "graph.vert.h"
+#include "graph_bg.vert.h"
+#include "graph.frag.h"
+
+#define GRAPH_SAMPLES 512 // a few seconds at typical refresh rates
+#define GRAPH_PENDING 64
+#define GRAPH_WIDTH   512.0f
+#define GRAPH_HEIGHT  160.0f
+
+struct Series
+{
+  // written by the sampling thread
+  uint64_t    last;
+  float       pending[GRAPH_PENDING];
+  atomic_uint pendingW;
+
+  // owned by the render thread
+  unsigned int pendingR;
+  unsigned int head;
+  GLuint       buffer;
+};
+
+struct EGL_Graph
+{
+  bool          display;
+  float         scale;
+  atomic_bool * invalidate;
+  struct Series series[EGL_GRAPH_MAX];
+
+  // the ring indices twice over so any window of it is contiguous
+  GLuint        indices;
+
+  EGL_Shader * shader;
+  EGL_Shader * shaderBG;
+  EGL_Model  * model;
+
+  // uniforms
+  GLint uScreen  , uSize  , uHead, uCount, uScale, uColor;
+  GLint uScreenBG, uSizeBG, uColorBG;
+};
+
+static const GLfloat colors[EGL_GRAPH_MAX][4] =
+{
+  [EGL_GRAPH_UPDATE ] = { 0.0f, 1.0f, 0.0f, 1.0f },
+  [EGL_GRAPH_UPLOAD ] = { 1.0f, 1.0f, 0.0f, 1.0f },
+  [EGL_GRAPH_PRESENT] = { 1.0f, 0.3f, 0.3f, 1.0f }
+};
+
+static void egl_graph_toggle(int key, void * opaque);
+
+bool egl_graph_init(EGL_Graph ** graph, atomic_bool * invalidate)
+{
+  *graph = (EGL_Graph *)malloc(sizeof(EGL_Graph));
+  if (!*graph)
+  {
+    DEBUG_ERROR("Failed to malloc EGL_Graph");
+    return false;
+  }
+
+  memset(*graph, 0, sizeof(EGL_Graph));
+  (*graph)->invalidate = invalidate;
+  (*graph)->scale = option_get_int("egl", "graphScale");
+  if ((*graph)->scale <= 0.0f)
+    (*graph)->scale = 50.0f;
+
+  if (!egl_shader_init(&(*graph)->shader))
+  {
+    DEBUG_ERROR("Failed to initialize the graph shader");
+    return false;
+  }
+
+  if (!egl_shader_init(&(*graph)->shaderBG))
+  {
+    DEBUG_ERROR("Failed to initialize the graph bg shader");
+    return false;
+  }
+
+  if (!egl_shader_compile((*graph)->shader,
+        b_shader_graph_vert, b_shader_graph_vert_size,
+        b_shader_graph_frag, b_shader_graph_frag_size))
+  {
+    DEBUG_ERROR("Failed to compile the graph shader");
+    return false;
+  }
+
+  if (!egl_shader_compile((*graph)->shaderBG,
+        b_shader_graph_bg_vert, b_shader_graph_bg_vert_size,
+        b_shader_graph_frag   , b_shader_graph_frag_size))
+  {
+    DEBUG_ERROR("Failed to compile the graph bg shader");
+    return false;
+  }
+
+  (*graph)->uScreen   = egl_shader_get_uniform_location((*graph)->shader  , "screen"    );
+  (*graph)->uSize     = egl_shader_get_uniform_location((*graph)->shader  , "size"      );
+  (*graph)->uHead     = egl_shader_get_uniform_location((*graph)->shader  , "head"      );
+  (*graph)->uCount    = egl_shader_get_uniform_location((*graph)->shader  , "count"     );
+  (*graph)->uScale    = egl_shader_get_uniform_location((*graph)->shader  , "scale"     );
+  (*graph)->uColor    = egl_shader_get_uniform_location((*graph)->shader  , "graphColor");
+  (*graph)->uScreenBG = egl_shader_get_uniform_location((*graph)->shaderBG, "screen"    );
+  (*graph)->uSizeBG   = egl_shader_get_uniform_location((*graph)->shaderBG, "size"      );
+  (*graph)->uColorBG  = egl_shader_get_uniform_location((*graph)->shaderBG, "graphColor");
+
+  if (!egl_model_init(&(*graph)->model))
+  {
+    DEBUG_ERROR("Failed to initialize the graph model");
+    return false;
+  }
+  egl_model_set_default((*graph)->model);
+
+  // the sample rings are only ever updated in place, one value at a time
+  const GLfloat zero[GRAPH_SAMPLES] = { 0 };
+  for(int i = 0; i < EGL_GRAPH_MAX; ++i)
+  {
+    glGenBuffers(1, &(*graph)->series[i].buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, (*graph)->series[i].buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(zero), zero, GL_DYNAMIC_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  GLushort indices[GRAPH_SAMPLES * 2];
+  for(int i = 0; i < GRAPH_SAMPLES * 2; ++i)
+    indices[i] = i % GRAPH_SAMPLES;
+
+  glGenBuffers(1, &(*graph)->indices);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (*graph)->indices);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+      GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  app_registerKeybind(KEY_G, egl_graph_toggle, *graph, "Frame timing graph toggle");
+  return true;
+}
+
+void egl_graph_free(EGL_Graph ** graph)
+{
+  if (!*graph)
+    return;
+
+  for(int i = 0; i < EGL_GRAPH_MAX; ++i)
+    if ((*graph)->series[i].buffer)
+      glDeleteBuffers(1, &(*graph)->series[i].buffer);
+
+  if ((*graph)->indices)
+    glDeleteBuffers(1, &(*graph)->indices);
+
+  egl_shader_free(&(*graph)->shader  );
+  egl_shader_free(&(*graph)->shaderBG);
+  egl_model_free (&(*graph)->model   );
+
+  free(*graph);
+  *graph = NULL;
+}
+
+static void egl_graph_toggle(int key, void * opaque)
+{
+  EGL_Graph * graph = (EGL_Graph *)opaque;
+  graph->display = !graph->display;
+
+  // nothing else may be changing on an idle guest, force the redraw
+  atomic_store(graph->invalidate, true);
+  app_invalidateWindow(true);
+}
+
+bool egl_graph_get_display(EGL_Graph * graph)
+{
+  return graph->display;
+}
+
+void egl_graph_sample(EGL_Graph * graph, enum EGL_GraphSeries series)
+{
+  struct Series * s = &graph->series[series];
+
+  // restart the interval when hidden so stale samples are not shown
+  if (!graph->display)
+  {
+    s->last = 0;
+    return;
+  }
+
+  const uint64_t now = nanotime();
+  if (s->last)
+  {
+    const unsigned int w = atomic_load_explicit(&s->pendingW,
+        memory_order_relaxed);
+    s->pending[w % GRAPH_PENDING] = (float)(now - s->last) / 1e6f;
+    atomic_store_explicit(&s->pendingW, w + 1, memory_order_release);
+  }
+  s->last = now;
+}
+
+void egl_graph_render(EGL_Graph * graph, const float scaleX, const float scaleY)
+{
+  if (!graph->display)
+    return;
+
+  // move any new samples into the vertex buffer rings
+  for(int i = 0; i < EGL_GRAPH_MAX; ++i)
+  {
+    struct Series * s = &graph->series[i];
+    const unsigned int w = atomic_load_explicit(&s->pendingW,
+        memory_order_acquire);
+
+    if (w - s->pendingR > GRAPH_PENDING)
+      s->pendingR = w - GRAPH_PENDING;
+
+    if (s->pendingR == w)
+      continue;
+
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    for(; s->pendingR != w; ++s->pendingR)
+    {
+      glBufferSubData(GL_ARRAY_BUFFER, s->head * sizeof(GLfloat),
+          sizeof(GLfloat), &s->pending[s->pendingR % GRAPH_PENDING]);
+      if (++s->head == GRAPH_SAMPLES)
+        s->head = 0;
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // render the background first
+  egl_shader_use(graph->shaderBG);
+  glUniform2f(graph->uScreenBG, scaleX     , scaleY      );
+  glUniform2f(graph->uSizeBG  , GRAPH_WIDTH, GRAPH_HEIGHT);
+  glUniform4f(graph->uColorBG , 0.0f, 0.0f, 0.0f, 0.5f);
+  egl_model_render(graph->model);
+
+  // then each series, oldest to newest starting at the head of the ring
+  egl_shader_use(graph->shader);
+  glUniform2f(graph->uScreen, scaleX     , scaleY      );
+  glUniform2f(graph->uSize  , GRAPH_WIDTH, GRAPH_HEIGHT);
+  glUniform1i(graph->uCount , GRAPH_SAMPLES);
+  glUniform1f(graph->uScale , graph->scale );
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, graph->indices);
+  glEnableVertexAttribArray(0);
+  for(int i = 0; i < EGL_GRAPH_MAX; ++i)
+  {
+    struct Series * s = &graph->series[i];
+    glBindBuffer(GL_ARRAY_BUFFER, s->buffer);
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glUniform1i(graph->uHead, s->head);
+    glUniform4fv(graph->uColor, 1, colors[i]);
+
+    glDrawElements(GL_LINE_STRIP, GRAPH_SAMPLES, GL_UNSIGNED_SHORT,
+        (void*)(s->head * sizeof(GLushort)));
+  }
+  glDisableVertexAttribArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glUseProgram(0);
+
+  glDisable(GL_BLEND);
+}
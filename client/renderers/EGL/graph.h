@@ -0,0 +1,41 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+typedef struct EGL_Graph EGL_Graph;
+
+enum EGL_GraphSeries
+{
+  EGL_GRAPH_UPDATE,  // guest frame updates
+  EGL_GRAPH_UPLOAD,  // client texture uploads
+  EGL_GRAPH_PRESENT, // buffer swaps
+
+  EGL_GRAPH_MAX
+};
+
+bool egl_graph_init(EGL_Graph ** graph, atomic_bool * invalidate);
+void egl_graph_free(EGL_Graph ** graph);
+
+bool egl_graph_get_display(EGL_Graph * graph);
+void egl_graph_sample(EGL_Graph * graph, enum EGL_GraphSeries series);
+void egl_graph_render(EGL_Graph * graph, const float scaleX, const float scaleY);
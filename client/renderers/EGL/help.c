@@ -20,7 +20,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "help.h"
 #include "common/debug.h"
 
-#include "texture.h"
+#include "text.h"
 #include "shader.h"
 #include "model.h"
 
@@ -30,31 +30,23 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 // these headers are auto generated by cmake
 #include "help.vert.h"
-#include "help.frag.h"
 #include "help_bg.frag.h"
 
 struct EGL_Help
 {
-  const LG_Font * font;
-  LG_FontObj      fontObj;
-
-  EGL_Texture * texture;
-  EGL_Shader  * shader;
+  EGL_Text    * text;
   EGL_Shader  * shaderBG;
   EGL_Model   * model;
 
-  _Atomic(LG_FontBitmap *) bmp;
+  _Atomic(char *) str;
 
   bool  shouldRender;
-  int   iwidth, iheight;
-  float width, height;
 
   // uniforms
-  GLint uScreen  , uSize;
   GLint uScreenBG, uSizeBG;
 };
 
-bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj)
+bool egl_help_init(EGL_Help ** help, EGL_FontAtlas * atlas)
 {
   *help = (EGL_Help *)malloc(sizeof(EGL_Help));
   if (!*help)
@@ -65,18 +57,9 @@ bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj)
 
   memset(*help, 0, sizeof(EGL_Help));
 
-  (*help)->font    = font;
-  (*help)->fontObj = fontObj;
-
-  if (!egl_texture_init(&(*help)->texture, NULL))
-  {
-    DEBUG_ERROR("Failed to initialize the help texture");
-    return false;
-  }
-
-  if (!egl_shader_init(&(*help)->shader))
+  if (!egl_text_init(&(*help)->text, atlas))
   {
-    DEBUG_ERROR("Failed to initialize the help shader");
+    DEBUG_ERROR("Failed to initialize the help text");
     return false;
   }
 
@@ -86,15 +69,6 @@ bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj)
     return false;
   }
 
-
-  if (!egl_shader_compile((*help)->shader,
-        b_shader_help_vert, b_shader_help_vert_size,
-        b_shader_help_frag, b_shader_help_frag_size))
-  {
-    DEBUG_ERROR("Failed to compile the help shader");
-    return false;
-  }
-
   if (!egl_shader_compile((*help)->shaderBG,
         b_shader_help_vert   , b_shader_help_vert_size,
         b_shader_help_bg_frag, b_shader_help_bg_frag_size))
@@ -103,8 +77,6 @@ bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj)
     return false;
   }
 
-  (*help)->uSize     = egl_shader_get_uniform_location((*help)->shader  , "size"  );
-  (*help)->uScreen   = egl_shader_get_uniform_location((*help)->shader  , "screen");
   (*help)->uSizeBG   = egl_shader_get_uniform_location((*help)->shaderBG, "size"  );
   (*help)->uScreenBG = egl_shader_get_uniform_location((*help)->shaderBG, "screen");
 
@@ -115,9 +87,8 @@ bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj)
   }
 
   egl_model_set_default((*help)->model);
-  egl_model_set_texture((*help)->model, (*help)->texture);
 
-  atomic_init(&(*help)->bmp, NULL);
+  atomic_init(&(*help)->str, NULL);
 
   return true;
 }
@@ -127,10 +98,10 @@ void egl_help_free(EGL_Help ** help)
   if (!*help)
     return;
 
-  egl_texture_free(&(*help)->texture );
-  egl_shader_free (&(*help)->shader  );
-  egl_shader_free (&(*help)->shaderBG);
-  egl_model_free  (&(*help)->model   );
+  egl_text_free  (&(*help)->text    );
+  egl_shader_free(&(*help)->shaderBG);
+  egl_model_free (&(*help)->model   );
+  free(atomic_exchange(&(*help)->str, NULL));
 
   free(*help);
   *help = NULL;
@@ -138,77 +109,49 @@ void egl_help_free(EGL_Help ** help)
 
 void egl_help_set_text(EGL_Help * help, const char * help_text)
 {
-  LG_FontBitmap * bmp = NULL;
+  // the text is laid out on the render thread as it may add glyphs to the atlas
+  char * str = NULL;
   if (help_text)
   {
-    bmp = help->font->render(help->fontObj, 0xffffff00, help_text);
-    if (!bmp)
-      DEBUG_ERROR("Failed to render help text");
+    str = strdup(help_text);
+    if (!str)
+      DEBUG_ERROR("Failed to duplicate the help text");
   } else
     help->shouldRender = false;
 
-  bmp = atomic_exchange(&help->bmp, bmp);
-  if (bmp)
-  {
-    help->font->release(help->fontObj, bmp);
-  }
-}
-
-void egl_help_set_font(EGL_Help * help, LG_FontObj fontObj)
-{
-  help->fontObj = fontObj;
+  free(atomic_exchange(&help->str, str));
 }
 
 void egl_help_render(EGL_Help * help, const float scaleX, const float scaleY)
 {
-  LG_FontBitmap * bmp = atomic_exchange(&help->bmp, NULL);
-  if (bmp)
+  char * str = atomic_exchange(&help->str, NULL);
+  if (str)
   {
-    if (help->iwidth != bmp->width || help->iheight != bmp->height)
-    {
-      help->iwidth  = bmp->width;
-      help->iheight = bmp->height;
-      help->width   = (float)bmp->width;
-      help->height  = (float)bmp->height;
-
-      egl_texture_setup(
-        help->texture,
-        EGL_PF_BGRA,
-        bmp->width ,
-        bmp->height,
-        bmp->width * bmp->bpp,
-        false,
-        false
-      );
-    }
-
-    egl_texture_update
-    (
-      help->texture,
-      bmp->pixels
-    );
-
-    help->shouldRender = true;
-    help->font->release(help->fontObj, bmp);
+    if (egl_text_set(help->text, str))
+      help->shouldRender = true;
+    else
+      DEBUG_ERROR("Failed to render help text");
+    free(str);
   }
 
   if (!help->shouldRender)
     return;
 
+  int width, height;
+  egl_text_get_size(help->text, &width, &height);
+
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
   // render the background first
   egl_shader_use(help->shaderBG);
-  glUniform2f(help->uScreenBG, scaleX     , scaleY      );
-  glUniform2f(help->uSizeBG  , help->width, help->height);
+  glUniform2f(help->uScreenBG, scaleX, scaleY);
+  glUniform2f(help->uSizeBG  , width , height);
   egl_model_render(help->model);
 
-  // render the texture over the background
-  egl_shader_use(help->shader);
-  glUniform2f(help->uScreen, scaleX     , scaleY      );
-  glUniform2f(help->uSize  , help->width, help->height);
-  egl_model_render(help->model);
+  // render the text over the background in the bottom left corner
+  egl_text_render(help->text, scaleX, scaleY,
+      5.0f, 1.0f / scaleY - 5.0f - height);
 
   glDisable(GL_BLEND);
 }
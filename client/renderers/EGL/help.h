@@ -21,13 +21,12 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <stdbool.h>
 
-#include "interface/font.h"
+#include "text.h"
 
 typedef struct EGL_Help EGL_Help;
 
-bool egl_help_init(EGL_Help ** help, const LG_Font * font, LG_FontObj fontObj);
+bool egl_help_init(EGL_Help ** help, EGL_FontAtlas * atlas);
 void egl_help_free(EGL_Help ** help);
 
 void egl_help_set_text(EGL_Help * help, const char * help_text);
-void egl_help_set_font(EGL_Help * help, LG_FontObj fontObj);
 void egl_help_render(EGL_Help * help, const float scaleX, const float scaleY);
@@ -187,6 +187,9 @@ void egl_model_render(EGL_Model * model)
     offset += fl->count;
   }
 
+  if (model->texture)
+    egl_texture_fence(model->texture);
+
   /* unbind and cleanup */
   glBindTexture(GL_TEXTURE_2D, 0);
   glDisableVertexAttribArray(0);
@@ -19,11 +19,35 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "shader.h"
 #include "common/debug.h"
+#include "common/option.h"
+#include "common/stringutils.h"
+#include "egl_dynprocs.h"
 #include "util.h"
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+/* bump this if the layout of the cache files changes */
+#define CACHE_MAGIC   0x4253474CU // "LGSB"
+#define CACHE_VERSION 1
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+};
 
 struct EGL_Shader
 {
@@ -84,6 +108,214 @@ bool egl_shader_load(EGL_Shader * this, const char * vertex_file, const char * f
   return ret;
 }
 
+static uint64_t egl_shader_hash(uint64_t hash, const void * data, size_t size)
+{
+  const uint8_t * bytes = (const uint8_t *)data;
+  for(size_t i = 0; i < size; ++i)
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+
+  /* include the size so adjacent strings can not run into each other */
+  for(size_t i = 0; i < sizeof(size); ++i)
+    hash = (hash ^ ((size >> (i * 8)) & 0xFF)) * FNV_PRIME;
+
+  return hash;
+}
+
+static bool egl_shader_cache_supported(void)
+{
+  if (!g_egl_dynProcs.glGetProgramBinary || !g_egl_dynProcs.glProgramBinary ||
+      !option_get_bool("egl", "shaderCache"))
+    return false;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+/* a program binary is only valid for the driver that produced it, so the key
+ * covers the driver as well as the sources */
+static uint64_t egl_shader_cache_key(const char * vertex_code,
+    size_t vertex_size, const char * fragment_code, size_t fragment_size)
+{
+  static const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+  uint64_t key = FNV_OFFSET;
+  for(size_t i = 0; i < sizeof(strings) / sizeof(*strings); ++i)
+  {
+    const char * str = (const char *)glGetString(strings[i]);
+    if (str)
+      key = egl_shader_hash(key, str, strlen(str));
+  }
+
+  key = egl_shader_hash(key, vertex_code  , vertex_size  );
+  key = egl_shader_hash(key, fragment_code, fragment_size);
+  return key;
+}
+
+/* returns the path of the cache file for key, creating the directories on the
+ * way to it if create is set */
+static char * egl_shader_cache_path(uint64_t key, bool create)
+{
+  char * dir;
+  const char * xdg  = getenv("XDG_CACHE_HOME");
+  const char * home = getenv("HOME");
+
+  if (xdg && *xdg)
+    dir = strdup(xdg);
+  else if (home && *home)
+    alloc_sprintf(&dir, "%s/.cache", home);
+  else
+    return NULL;
+
+  if (!dir)
+    return NULL;
+
+  char * path = NULL;
+  static const char * subdirs[] = { "", "/looking-glass", "/looking-glass/shaders" };
+  for(size_t i = 0; create && i < sizeof(subdirs) / sizeof(*subdirs); ++i)
+  {
+    char * sub;
+    if (alloc_sprintf(&sub, "%s%s", dir, subdirs[i]) < 0)
+      goto out;
+
+    if (mkdir(sub, 0700) < 0 && errno != EEXIST)
+    {
+      DEBUG_WARN("Failed to create the shader cache directory %s: %s", sub,
+          strerror(errno));
+      free(sub);
+      goto out;
+    }
+    free(sub);
+  }
+
+  if (alloc_sprintf(&path, "%s/looking-glass/shaders/%016" PRIx64 ".bin", dir,
+        key) < 0)
+    path = NULL;
+
+out:
+  free(dir);
+  return path;
+}
+
+static bool egl_shader_cache_load(EGL_Shader * this, uint64_t key)
+{
+  char * path = egl_shader_cache_path(key, false);
+  if (!path)
+    return false;
+
+  char * data;
+  size_t size;
+  bool   ret = false;
+
+  /* not being cached yet is not an error */
+  if (access(path, R_OK) != 0)
+    goto out;
+
+  if (!util_fileGetContents(path, &data, &size))
+    goto out;
+
+  struct CacheHeader header;
+  if (size < sizeof(header))
+    goto invalid;
+
+  memcpy(&header, data, sizeof(header));
+  if (header.magic   != CACHE_MAGIC   ||
+      header.version != CACHE_VERSION ||
+      header.key     != key           ||
+      header.length  != size - sizeof(header))
+    goto invalid;
+
+  this->shader = glCreateProgram();
+  g_egl_dynProcs.glProgramBinary(this->shader, header.format,
+      data + sizeof(header), header.length);
+
+  GLint result = GL_FALSE;
+  glGetProgramiv(this->shader, GL_LINK_STATUS, &result);
+  if (result == GL_FALSE)
+  {
+    glDeleteProgram(this->shader);
+    goto invalid;
+  }
+
+  ret = true;
+  free(data);
+  goto out;
+
+invalid:
+  /* a driver update can reject the binary even though the key matches, it is
+   * removed so it gets replaced once the program is compiled */
+  DEBUG_INFO("Discarding the stale shader cache file %s", path);
+  unlink(path);
+  free(data);
+
+out:
+  free(path);
+  return ret;
+}
+
+static void egl_shader_cache_store(EGL_Shader * this, uint64_t key)
+{
+  GLint length = 0;
+  glGetProgramiv(this->shader, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  char * path = egl_shader_cache_path(key, true);
+  if (!path)
+    return;
+
+  char * tmp  = NULL;
+  char * data = malloc(sizeof(struct CacheHeader) + length);
+  if (!data)
+    goto out;
+
+  struct CacheHeader header =
+  {
+    .magic   = CACHE_MAGIC,
+    .version = CACHE_VERSION,
+    .key     = key
+  };
+
+  GLenum  format;
+  GLsizei written = 0;
+  g_egl_dynProcs.glGetProgramBinary(this->shader, length, &written, &format,
+      data + sizeof(header));
+  if (written <= 0)
+    goto out;
+
+  header.format = format;
+  header.length = written;
+  memcpy(data, &header, sizeof(header));
+
+  /* write to a temporary file first so a partial file is never loaded */
+  if (alloc_sprintf(&tmp, "%s.%d", path, (int)getpid()) < 0)
+  {
+    tmp = NULL;
+    goto out;
+  }
+
+  FILE * fp = fopen(tmp, "wb");
+  if (!fp)
+  {
+    DEBUG_WARN("Failed to write the shader cache file %s: %s", tmp,
+        strerror(errno));
+    goto out;
+  }
+
+  const size_t size = sizeof(header) + written;
+  const bool   ok   = fwrite(data, 1, size, fp) == size;
+  if (fclose(fp) != 0 || !ok || rename(tmp, path) < 0)
+  {
+    DEBUG_WARN("Failed to write the shader cache file %s", path);
+    unlink(tmp);
+  }
+
+out:
+  free(tmp);
+  free(data);
+  free(path);
+}
+
 bool egl_shader_compile(EGL_Shader * this, const char * vertex_code, size_t vertex_size, const char * fragment_code, size_t fragment_size)
 {
   if (this->hasShader)
@@ -92,6 +324,16 @@ bool egl_shader_compile(EGL_Shader * this, const char * vertex_code, size_t vert
     this->hasShader = false;
   }
 
+  const bool     useCache = egl_shader_cache_supported();
+  const uint64_t key      = useCache ? egl_shader_cache_key(vertex_code,
+      vertex_size, fragment_code, fragment_size) : 0;
+
+  if (useCache && egl_shader_cache_load(this, key))
+  {
+    this->hasShader = true;
+    return true;
+  }
+
   GLint  length;
   GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
 
@@ -150,6 +392,11 @@ bool egl_shader_compile(EGL_Shader * this, const char * vertex_code, size_t vert
   this->shader = glCreateProgram();
   glAttachShader(this->shader, vertexShader  );
   glAttachShader(this->shader, fragmentShader);
+
+  if (useCache && g_egl_dynProcs.glProgramParameteri)
+    g_egl_dynProcs.glProgramParameteri(this->shader,
+        GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   glLinkProgram(this->shader);
 
   glGetProgramiv(this->shader, GL_LINK_STATUS, &result);
@@ -181,6 +428,9 @@ bool egl_shader_compile(EGL_Shader * this, const char * vertex_code, size_t vert
   glDeleteShader(fragmentShader);
   glDeleteShader(vertexShader  );
 
+  if (useCache)
+    egl_shader_cache_store(this, key);
+
   this->hasShader = true;
   return true;
 }
@@ -0,0 +1,10 @@
+#version 300 es
+
+out highp vec4 color;
+
+uniform highp vec4 graphColor;
+
+void main()
+{
+  color = graphColor;
+}
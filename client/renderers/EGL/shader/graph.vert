@@ -0,0 +1,20 @@
+#version 300 es
+
+layout(location = 0) in float value;
+
+uniform vec2  screen;
+uniform vec2  size;
+uniform int   head;
+uniform int   count;
+uniform float scale;
+
+void main()
+{
+  // the oldest sample is at head, so the age gives the x position
+  float x = float((gl_VertexID - head + count) % count) / float(count - 1);
+  float y = clamp(value / scale, 0.0, 1.0);
+
+  gl_Position.xy = vec2(-1.0, -1.0) + screen * 2.0 * (vec2(10.0) + vec2(x, y) * size);
+  gl_Position.z  = 0.0;
+  gl_Position.w  = 1.0;
+}
@@ -0,0 +1,15 @@
+#version 300 es
+
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+uniform vec2 screen;
+uniform vec2 size;
+
+void main()
+{
+  vec2 pos = vertexPosition_modelspace.xy * 0.5 + 0.5;
+
+  gl_Position.xy = vec2(-1.0, -1.0) + screen * 2.0 * (vec2(10.0) + pos * size);
+  gl_Position.z  = 0.0;
+  gl_Position.w  = 1.0;
+}
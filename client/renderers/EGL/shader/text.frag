@@ -7,5 +7,5 @@ uniform sampler2D sampler1;
 
 void main()
 {
-  color = texture(sampler1, uv);
+  color = vec4(1.0, 1.0, 1.0, texture(sampler1, uv).r);
 }
@@ -0,0 +1,22 @@
+#version 300 es
+
+layout(location = 0) in vec4 rect;
+layout(location = 1) in vec4 uvRect;
+
+uniform vec2 screen;
+uniform vec2 pos;
+
+out highp vec2 uv;
+
+void main()
+{
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec2 px     = pos + rect.xy + corner * rect.zw;
+
+  gl_Position.x = px.x * screen.x * 2.0 - 1.0;
+  gl_Position.y = 1.0 - px.y * screen.y * 2.0;
+  gl_Position.z = 0.0;
+  gl_Position.w = 1.0;
+
+  uv = mix(uvRect.xy, uvRect.zw, corner);
+}
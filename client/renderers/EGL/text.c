@@ -0,0 +1,470 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2019 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+cahe terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "text.h"
+#include "common/debug.h"
+#include "common/stringutils.h"
+
+#include "shader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <GL/gl.h>
+
+// these headers are auto generated by cmake
+#include "text.vert.h"
+#include "text.frag.h"
+
+#define ATLAS_SIZE  1024
+#define GLYPH_TABLE 1024 // must be a power of two
+#define GLYPH_MAX   (GLYPH_TABLE * 3 / 4)
+
+struct Glyph
+{
+  unsigned int key; // the character + 1, zero if the slot is free
+  int x, y;
+  int width, height;
+  int left, top;
+  int advance;
+};
+
+struct GlyphQuad
+{
+  GLfloat x, y, w, h;
+  GLfloat u0, v0, u1, v1;
+};
+
+struct EGL_FontAtlas
+{
+  const LG_Font * font;
+  LG_FontObj      fontObj;
+  unsigned int    generation;
+
+  GLuint       texture;
+  GLuint       sampler;
+  EGL_Shader * shader;
+  GLint        uScreen, uPos;
+
+  // simple shelf packing, glyphs are added left to right on the current shelf
+  int shelfX, shelfY, shelfHeight;
+
+  struct Glyph glyphs[GLYPH_TABLE];
+  int          glyphCount;
+};
+
+struct EGL_Text
+{
+  EGL_FontAtlas * atlas;
+  unsigned int    generation;
+  char          * str;
+
+  struct GlyphQuad * quads;
+  int                quadCount;
+  int                quadSize;
+  int                width, height;
+
+  GLuint buffer;
+  int    bufferSize;
+};
+
+bool egl_font_atlas_init(EGL_FontAtlas ** atlas, const LG_Font * font,
+    LG_FontObj fontObj)
+{
+  *atlas = (EGL_FontAtlas *)malloc(sizeof(EGL_FontAtlas));
+  if (!*atlas)
+  {
+    DEBUG_ERROR("Failed to malloc EGL_FontAtlas");
+    return false;
+  }
+
+  memset(*atlas, 0, sizeof(EGL_FontAtlas));
+  (*atlas)->font    = font;
+  (*atlas)->fontObj = fontObj;
+
+  if (!egl_shader_init(&(*atlas)->shader))
+  {
+    DEBUG_ERROR("Failed to initialize the text shader");
+    return false;
+  }
+
+  if (!egl_shader_compile((*atlas)->shader,
+        b_shader_text_vert, b_shader_text_vert_size,
+        b_shader_text_frag, b_shader_text_frag_size))
+  {
+    DEBUG_ERROR("Failed to compile the text shader");
+    return false;
+  }
+
+  (*atlas)->uScreen = egl_shader_get_uniform_location((*atlas)->shader, "screen");
+  (*atlas)->uPos    = egl_shader_get_uniform_location((*atlas)->shader, "pos"   );
+
+  glGenTextures(1, &(*atlas)->texture);
+  glBindTexture(GL_TEXTURE_2D, (*atlas)->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED,
+      GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // glyphs are drawn 1:1 so there is no need to filter
+  glGenSamplers(1, &(*atlas)->sampler);
+  glSamplerParameteri((*atlas)->sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glSamplerParameteri((*atlas)->sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glSamplerParameteri((*atlas)->sampler, GL_TEXTURE_WRAP_S    , GL_CLAMP_TO_EDGE);
+  glSamplerParameteri((*atlas)->sampler, GL_TEXTURE_WRAP_T    , GL_CLAMP_TO_EDGE);
+
+  return true;
+}
+
+void egl_font_atlas_free(EGL_FontAtlas ** atlas)
+{
+  if (!*atlas)
+    return;
+
+  glDeleteTextures(1, &(*atlas)->texture);
+  glDeleteSamplers(1, &(*atlas)->sampler);
+  egl_shader_free(&(*atlas)->shader);
+
+  free(*atlas);
+  *atlas = NULL;
+}
+
+static void egl_font_atlas_flush(EGL_FontAtlas * atlas)
+{
+  memset(atlas->glyphs, 0, sizeof(atlas->glyphs));
+  atlas->glyphCount  = 0;
+  atlas->shelfX      = 0;
+  atlas->shelfY      = 0;
+  atlas->shelfHeight = 0;
+  ++atlas->generation;
+}
+
+void egl_font_atlas_set_font(EGL_FontAtlas * atlas, LG_FontObj fontObj)
+{
+  atlas->fontObj = fontObj;
+  egl_font_atlas_flush(atlas);
+}
+
+static bool egl_font_atlas_pack(EGL_FontAtlas * atlas, struct Glyph * glyph)
+{
+  // leave a one pixel gap between glyphs
+  const int w = glyph->width  + 1;
+  const int h = glyph->height + 1;
+
+  if (atlas->shelfX + w > ATLAS_SIZE)
+  {
+    atlas->shelfX      = 0;
+    atlas->shelfY     += atlas->shelfHeight;
+    atlas->shelfHeight = 0;
+  }
+
+  if (atlas->shelfY + h > ATLAS_SIZE)
+    return false;
+
+  glyph->x = atlas->shelfX;
+  glyph->y = atlas->shelfY;
+
+  atlas->shelfX += w;
+  if (h > atlas->shelfHeight)
+    atlas->shelfHeight = h;
+
+  return true;
+}
+
+static const struct Glyph * egl_font_atlas_get(EGL_FontAtlas * atlas,
+    unsigned int ch)
+{
+  const unsigned int key = ch + 1;
+  unsigned int slot = (key * 2654435761u) & (GLYPH_TABLE - 1);
+
+  while(atlas->glyphs[slot].key)
+  {
+    if (atlas->glyphs[slot].key == key)
+      return &atlas->glyphs[slot];
+    slot = (slot + 1) & (GLYPH_TABLE - 1);
+  }
+
+  LG_FontGlyph g;
+  if (!atlas->font->glyph(atlas->fontObj, ch, &g))
+    return NULL;
+
+  struct Glyph glyph =
+  {
+    .key     = key,
+    .width   = g.width,
+    .height  = g.height,
+    .left    = g.left,
+    .top     = g.top,
+    .advance = g.advance
+  };
+
+  if (glyph.width > ATLAS_SIZE - 1 || glyph.height > ATLAS_SIZE - 1)
+  {
+    DEBUG_WARN("Glyph U+%x is too large for the atlas", ch);
+    glyph.width  = 0;
+    glyph.height = 0;
+  }
+
+  // when the atlas is full start over, the caller must lay out its text again
+  if (atlas->glyphCount == GLYPH_MAX || !egl_font_atlas_pack(atlas, &glyph))
+  {
+    egl_font_atlas_flush(atlas);
+    egl_font_atlas_pack(atlas, &glyph);
+    slot = (key * 2654435761u) & (GLYPH_TABLE - 1);
+  }
+
+  if (glyph.width && glyph.height)
+  {
+    glBindTexture(GL_TEXTURE_2D, atlas->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (g.pitch > 0)
+    {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, g.pitch);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y, glyph.width,
+          glyph.height, GL_RED, GL_UNSIGNED_BYTE, g.pixels);
+    }
+    else
+    {
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      for(int y = 0; y < glyph.height; ++y)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y + y, glyph.width,
+            1, GL_RED, GL_UNSIGNED_BYTE, g.pixels + y * g.pitch);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT , 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  atlas->glyphs[slot] = glyph;
+  ++atlas->glyphCount;
+  return &atlas->glyphs[slot];
+}
+
+bool egl_text_init(EGL_Text ** text, EGL_FontAtlas * atlas)
+{
+  *text = (EGL_Text *)malloc(sizeof(EGL_Text));
+  if (!*text)
+  {
+    DEBUG_ERROR("Failed to malloc EGL_Text");
+    return false;
+  }
+
+  memset(*text, 0, sizeof(EGL_Text));
+  (*text)->atlas = atlas;
+  glGenBuffers(1, &(*text)->buffer);
+
+  return true;
+}
+
+void egl_text_free(EGL_Text ** text)
+{
+  if (!*text)
+    return;
+
+  glDeleteBuffers(1, &(*text)->buffer);
+  free((*text)->quads);
+  free((*text)->str);
+
+  free(*text);
+  *text = NULL;
+}
+
+static bool egl_text_layout_pass(EGL_Text * text)
+{
+  EGL_FontAtlas * atlas      = text->atlas;
+  const int       lineHeight = atlas->font->lineHeight(atlas->fontObj);
+
+  int width         = 0;
+  int row           = 0;
+  int rowWidth      = 0;
+  int topAscend     = 0;
+  int bottomDescend = 0;
+
+  text->quadCount = 0;
+  for(const char * ptr = text->str; *ptr; ptr += utf8_advance(ptr))
+  {
+    const unsigned int ch = utf8_decode(ptr);
+    if (ch == '\n')
+    {
+      if (!ptr[1])
+        break;
+      if (rowWidth > width)
+        width = rowWidth;
+      rowWidth = bottomDescend = 0;
+      ++row;
+      continue;
+    }
+
+    const struct Glyph * glyph = egl_font_atlas_get(atlas, ch);
+    if (!glyph)
+      return false;
+
+    if (glyph->width && glyph->height)
+    {
+      // y is relative to the first baseline until it is known
+      struct GlyphQuad * quad = &text->quads[text->quadCount++];
+      quad->x  = rowWidth + glyph->left;
+      quad->y  = row * lineHeight - glyph->top;
+      quad->w  = glyph->width;
+      quad->h  = glyph->height;
+      quad->u0 = (float)glyph->x / ATLAS_SIZE;
+      quad->v0 = (float)glyph->y / ATLAS_SIZE;
+      quad->u1 = (float)(glyph->x + glyph->width ) / ATLAS_SIZE;
+      quad->v1 = (float)(glyph->y + glyph->height) / ATLAS_SIZE;
+    }
+
+    rowWidth += glyph->advance;
+
+    const int descend = glyph->height - glyph->top;
+    if (descend > bottomDescend)
+      bottomDescend = descend;
+    if (row == 0 && glyph->top > topAscend)
+      topAscend = glyph->top;
+  }
+
+  if (rowWidth > width)
+    width = rowWidth;
+
+  for(int i = 0; i < text->quadCount; ++i)
+    text->quads[i].y += topAscend;
+
+  text->width  = width;
+  text->height = topAscend + lineHeight * row + bottomDescend;
+  return true;
+}
+
+static bool egl_text_layout(EGL_Text * text)
+{
+  const int maxQuads = strlen(text->str);
+  if (maxQuads > text->quadSize)
+  {
+    struct GlyphQuad * quads = realloc(text->quads,
+        sizeof(struct GlyphQuad) * maxQuads);
+    if (!quads)
+    {
+      DEBUG_ERROR("Failed to realloc the text quads");
+      return false;
+    }
+
+    text->quads    = quads;
+    text->quadSize = maxQuads;
+  }
+
+  // if the atlas filled up part way through, the glyphs already placed are
+  // gone, so lay everything out a second time
+  for(int i = 0; i < 2; ++i)
+  {
+    text->generation = text->atlas->generation;
+    if (!egl_text_layout_pass(text))
+    {
+      DEBUG_ERROR("Failed to lay out the text");
+      text->quadCount = 0;
+      return false;
+    }
+
+    if (text->generation == text->atlas->generation)
+      break;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, text->buffer);
+  if (text->quadCount > text->bufferSize)
+  {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct GlyphQuad) * text->quadCount,
+        text->quads, GL_DYNAMIC_DRAW);
+    text->bufferSize = text->quadCount;
+  }
+  else
+    glBufferSubData(GL_ARRAY_BUFFER, 0,
+        sizeof(struct GlyphQuad) * text->quadCount, text->quads);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return true;
+}
+
+bool egl_text_set(EGL_Text * text, const char * str)
+{
+  if (text->str && text->generation == text->atlas->generation &&
+      strcmp(text->str, str) == 0)
+    return true;
+
+  free(text->str);
+  text->str = strdup(str);
+  if (!text->str)
+  {
+    DEBUG_ERROR("Failed to duplicate the text");
+    return false;
+  }
+
+  return egl_text_layout(text);
+}
+
+void egl_text_get_size(EGL_Text * text, int * width, int * height)
+{
+  // another user of the atlas may have caused it to be flushed
+  if (text->str && text->generation != text->atlas->generation)
+    egl_text_layout(text);
+
+  *width  = text->width;
+  *height = text->height;
+}
+
+void egl_text_render(EGL_Text * text, const float scaleX, const float scaleY,
+    const float x, const float y)
+{
+  if (!text->str)
+    return;
+
+  if (text->generation != text->atlas->generation)
+    egl_text_layout(text);
+
+  if (!text->quadCount)
+    return;
+
+  EGL_FontAtlas * atlas = text->atlas;
+  egl_shader_use(atlas->shader);
+  glUniform2f(atlas->uScreen, scaleX, scaleY);
+  glUniform2f(atlas->uPos   , x     , y     );
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas->texture);
+  glBindSampler(0, atlas->sampler);
+
+  // one instance per glyph, the quad corners come from gl_VertexID
+  glBindBuffer(GL_ARRAY_BUFFER, text->buffer);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(struct GlyphQuad),
+      (void *)offsetof(struct GlyphQuad, x));
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct GlyphQuad),
+      (void *)offsetof(struct GlyphQuad, u0));
+  glVertexAttribDivisor(0, 1);
+  glVertexAttribDivisor(1, 1);
+
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, text->quadCount);
+
+  glVertexAttribDivisor(0, 0);
+  glVertexAttribDivisor(1, 0);
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(0);
+}
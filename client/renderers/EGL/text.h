@@ -0,0 +1,46 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2019 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "interface/font.h"
+
+typedef struct EGL_FontAtlas EGL_FontAtlas;
+typedef struct EGL_Text      EGL_Text;
+
+bool egl_font_atlas_init(EGL_FontAtlas ** atlas, const LG_Font * font,
+    LG_FontObj fontObj);
+void egl_font_atlas_free(EGL_FontAtlas ** atlas);
+
+// drops all cached glyphs, text using the atlas is laid out again on render
+void egl_font_atlas_set_font(EGL_FontAtlas * atlas, LG_FontObj fontObj);
+
+bool egl_text_init(EGL_Text ** text, EGL_FontAtlas * atlas);
+void egl_text_free(EGL_Text ** text);
+
+// these must be called from the render thread as new glyphs are uploaded
+// into the atlas as they are encountered
+bool egl_text_set     (EGL_Text * text, const char * str);
+void egl_text_get_size(EGL_Text * text, int * width, int * height);
+
+// x and y are the top left corner of the text in window pixels
+void egl_text_render(EGL_Text * text, const float scaleX, const float scaleY,
+    const float x, const float y);
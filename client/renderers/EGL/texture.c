@@ -20,10 +20,15 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "texture.h"
 #include "common/debug.h"
 #include "common/framebuffer.h"
+#include "common/KVMFR.h"
+#include "common/locking.h"
+#include "common/option.h"
 #include "egl_dynprocs.h"
 #include "egldebug.h"
+#include "util.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdatomic.h>
@@ -42,17 +47,58 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 /* this must be a multiple of 2 */
 #define BUFFER_COUNT 4
 
+/* streaming textures are triple buffered between the upload and render
+ * threads, the mailbox holds the index of the newest texture and this flag
+ * while the render thread has not yet taken it */
+#define TEXTURE_COUNT 3
+#define TEXTURE_FRESH 0x4
+
+/* the most objects kept in the pool, regardless of their size */
+#define POOL_MAX 16
+
+/* a list of regions, or the entire texture if full is set */
+struct Damage
+{
+  bool            full;
+  int             count;
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+};
+
 struct Buffer
 {
   bool     hasPBO;
   GLuint   pbo;
   void *   map;
-  GLsync   sync;
+
+  /* the regions of this buffer that were written and need uploading */
+  struct Damage damage;
 };
 
+/* w counts the buffers written, c how many of them the upload thread has
+ * claimed and u how many it has finished with. w and c share one atomic so the
+ * writer can only take back the newest buffer while it is still unclaimed */
 struct BufferState
 {
-  _Atomic(uint8_t) w, u, s, d;
+  _Atomic(uint16_t) wc;
+  _Atomic(uint8_t)  u;
+};
+
+#define STATE_W(x)     ((uint8_t)((x) & 0xFF))
+#define STATE_C(x)     ((uint8_t)((x) >> 8))
+#define STATE_WC(w, c) ((uint16_t)((uint8_t)(w) | ((uint8_t)(c) << 8)))
+
+/* a texture or mapped PBO that was in use for an earlier format */
+struct PoolEntry
+{
+  bool     isPBO;
+  GLuint   name;
+  void *   map;
+  size_t   size;
+  uint64_t used;
+
+  /* textures only */
+  size_t   width, height;
+  GLenum   intFormat, format, dataType;
 };
 
 struct EGL_Texture
@@ -63,7 +109,7 @@ struct EGL_Texture
   size_t bpp;
   bool   streaming;
   bool   dma;
-  bool   ready;
+  bool   canCopy;
 
   GLuint       sampler;
   size_t       width, height, stride, pitch;
@@ -75,23 +121,52 @@ struct EGL_Texture
 
   struct BufferState state;
   int             bufferCount;
-  GLuint          tex;
   struct Buffer   buf[BUFFER_COUNT];
 
-  size_t dmaImageCount;
+  /* texBack and texLatest belong to the upload thread, texFront to the render
+   * thread. texDamage is how far each texture is behind the latest one */
+  int             texCount;
+  GLuint          tex[TEXTURE_COUNT];
+  struct Damage   texDamage[TEXTURE_COUNT];
+  int             texBack, texLatest, texFront;
+  bool            frontValid;
+  _Atomic(int)    texMailbox;
+
+  /* regions of frames that were dropped because the ring was full, these are
+   * merged into the next buffer written so the texture doesn't go stale */
+  struct Damage   missed;
+
+  /* one EGLImage backed texture per frame buffer, the desktop is sampled
+   * directly from the buffer of the latest frame. fence follows the last draw
+   * that sampled the buffer and dmaBound is the buffer the render thread is
+   * drawing with, both are protected by dmaLock */
   size_t dmaImageUsed;
   struct
   {
-    int fd;
+    int      fd;
     EGLImage image;
+    GLuint   tex;
+    GLsync   sync;
+    GLsync   fence;
   }
-  * dmaImages;
-
-  GLuint dmaFBO;
-  GLuint dmaTex;
+  dmaImages[KVMFR_FRAME_BUFFERS];
+  _Atomic(int) dmaCurrent;
+  LG_Lock      dmaLock;
+  int          dmaBound;
+
+  FrameBufferReader * reader;
+  unsigned int        copyThreads;
+
+  /* storage released by format changes, so switching back to a recent format
+   * does not need to allocate and map it again */
+  struct PoolEntry pool[POOL_MAX];
+  int              poolCount;
+  size_t           poolSize;
+  uint64_t         poolClock;
 };
 
-bool egl_texture_init(EGL_Texture ** texture, EGLDisplay * display)
+bool egl_texture_init(EGL_Texture ** texture, EGLDisplay * display,
+    unsigned int copyThreads)
 {
   *texture = (EGL_Texture *)malloc(sizeof(EGL_Texture));
   if (!*texture)
@@ -101,39 +176,162 @@ bool egl_texture_init(EGL_Texture ** texture, EGLDisplay * display)
   }
 
   memset(*texture, 0, sizeof(EGL_Texture));
-  (*texture)->display = display;
+  (*texture)->display     = display;
+  (*texture)->copyThreads = copyThreads;
+  atomic_init(&(*texture)->dmaCurrent, -1);
+  LG_LOCK_INIT((*texture)->dmaLock);
+  (*texture)->dmaBound = -1;
   return true;
 }
 
-void egl_texture_free(EGL_Texture ** texture)
+static void egl_texture_free_dma(EGL_Texture * texture)
 {
-  if (!*texture)
-    return;
+  atomic_store_explicit(&texture->dmaCurrent, -1, memory_order_release);
+  texture->dmaBound = -1;
 
-  glDeleteSamplers(1, &(*texture)->sampler);
+  for (size_t i = 0; i < texture->dmaImageUsed; ++i)
+  {
+    if (texture->dmaImages[i].sync)
+      glDeleteSync(texture->dmaImages[i].sync);
+    if (texture->dmaImages[i].fence)
+      glDeleteSync(texture->dmaImages[i].fence);
+    glDeleteTextures(1, &texture->dmaImages[i].tex);
+    eglDestroyImage(texture->display, texture->dmaImages[i].image);
+  }
+  texture->dmaImageUsed = 0;
+}
 
-  for(int i = 0; i < (*texture)->bufferCount; ++i)
+static void egl_texture_pool_delete(struct PoolEntry * entry)
+{
+  if (entry->isPBO)
   {
-    struct Buffer * b = &(*texture)->buf[i];
-    if (b->hasPBO)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, entry->name);
+    if (entry->map)
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &entry->name);
+  }
+  else
+    glDeleteTextures(1, &entry->name);
+}
+
+/* evict the least recently used objects until the pool fits the budget */
+static void egl_texture_pool_trim(EGL_Texture * texture, size_t budget)
+{
+  while(texture->poolCount &&
+      (texture->poolSize > budget || texture->poolCount == POOL_MAX))
+  {
+    int lru = 0;
+    for(int i = 1; i < texture->poolCount; ++i)
+      if (texture->pool[i].used < texture->pool[lru].used)
+        lru = i;
+
+    egl_texture_pool_delete(&texture->pool[lru]);
+    texture->poolSize -= texture->pool[lru].size;
+    texture->pool[lru] = texture->pool[--texture->poolCount];
+  }
+}
+
+static void egl_texture_pool_put(EGL_Texture * texture, bool isPBO,
+    GLuint name, void * map, size_t size)
+{
+  egl_texture_pool_trim(texture, SIZE_MAX);
+
+  struct PoolEntry * entry = &texture->pool[texture->poolCount++];
+  entry->isPBO     = isPBO;
+  entry->name      = name;
+  entry->map       = map;
+  entry->size      = size;
+  entry->used      = ++texture->poolClock;
+  entry->width     = texture->width;
+  entry->height    = texture->height;
+  entry->intFormat = texture->intFormat;
+  entry->format    = texture->format;
+  entry->dataType  = texture->dataType;
+  texture->poolSize += size;
+}
+
+/* take an object matching the current format from the pool */
+static bool egl_texture_pool_take(EGL_Texture * texture, bool isPBO,
+    GLuint * name, void ** map)
+{
+  const size_t size = isPBO ? texture->pboBufferSize :
+    texture->height * texture->width * texture->bpp;
+
+  for(int i = 0; i < texture->poolCount; ++i)
+  {
+    struct PoolEntry * entry = &texture->pool[i];
+    if (entry->isPBO != isPBO || entry->size != size)
+      continue;
+
+    if (!isPBO && (
+        entry->width     != texture->width     ||
+        entry->height    != texture->height    ||
+        entry->intFormat != texture->intFormat ||
+        entry->format    != texture->format    ||
+        entry->dataType  != texture->dataType))
+      continue;
+
+    *name = entry->name;
+    if (map)
+      *map = entry->map;
+
+    texture->poolSize -= entry->size;
+    *entry = texture->pool[--texture->poolCount];
+    return true;
+  }
+
+  return false;
+}
+
+/* give up the storage of the current format, a streaming texture keeps it in
+ * the pool as a resolution or mode change is often followed by a change back */
+static void egl_texture_release(EGL_Texture * texture)
+{
+  const bool pool = texture->streaming && !texture->dma;
+
+  for(int i = 0; i < texture->bufferCount; ++i)
+  {
+    struct Buffer * b = &texture->buf[i];
+    if (!b->hasPBO)
+      continue;
+
+    if (pool && b->map)
+      egl_texture_pool_put(texture, true, b->pbo, b->map,
+          texture->pboBufferSize);
+    else
     {
-      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, b->pbo);
-      if ((*texture)->buf[i].map)
-      {
-        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-        (*texture)->buf[i].map = NULL;
-      }
-      glDeleteBuffers(1, &b->pbo);
-      if (b->sync)
-        glDeleteSync(b->sync);
+      struct PoolEntry entry = { .isPBO = true, .name = b->pbo, .map = b->map };
+      egl_texture_pool_delete(&entry);
     }
+
+    b->hasPBO = false;
+    b->map    = NULL;
   }
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  glDeleteTextures(1, &(*texture)->tex);
 
-  for (size_t i = 0; i < (*texture)->dmaImageUsed; ++i)
-    eglDestroyImage((*texture)->display, (*texture)->dmaImages[i].image);
-  free((*texture)->dmaImages);
+  for(int i = 0; i < texture->texCount; ++i)
+    if (pool)
+      egl_texture_pool_put(texture, false, texture->tex[i], NULL,
+          texture->height * texture->width * texture->bpp);
+    else
+      glDeleteTextures(1, &texture->tex[i]);
+
+  texture->texCount = 0;
+}
+
+void egl_texture_free(EGL_Texture ** texture)
+{
+  if (!*texture)
+    return;
+
+  glDeleteSamplers(1, &(*texture)->sampler);
+
+  egl_texture_release(*texture);
+  egl_texture_pool_trim(*texture, 0);
+
+  egl_texture_free_dma(*texture);
+
+  framebuffer_reader_free(&(*texture)->reader);
 
   free(*texture);
   *texture = NULL;
@@ -163,31 +361,28 @@ static bool egl_texture_map(EGL_Texture * texture, uint8_t i)
   return texture->buf[i].map;
 }
 
-static void egl_texture_unmap(EGL_Texture * texture, uint8_t i)
+static bool egl_texture_has_copy_image(void)
 {
-  if (!texture->buf[i].map)
-    return;
+  if (!g_egl_dynProcs.glCopyImageSubData)
+    return false;
 
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->buf[i].pbo);
-  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  texture->buf[i].map = NULL;
+  int maj, min;
+  const char * version = (const char *)glGetString(GL_VERSION);
+  if (version && sscanf(version, "OpenGL ES %d.%d", &maj, &min) == 2 &&
+      (maj > 3 || (maj == 3 && min >= 2)))
+    return true;
+
+  const char * exts = (const char *)glGetString(GL_EXTENSIONS);
+  return exts && (
+      util_hasGLExt(exts, "GL_EXT_copy_image") ||
+      util_hasGLExt(exts, "GL_OES_copy_image"));
 }
 
 bool egl_texture_setup(EGL_Texture * texture, enum EGL_PixelFormat pixFmt, size_t width, size_t height, size_t stride, bool streaming, bool useDMA)
 {
-  if (texture->streaming && !useDMA)
-  {
-    for(int i = 0; i < texture->bufferCount; ++i)
-    {
-      egl_texture_unmap(texture, i);
-      if (texture->buf[i].hasPBO)
-      {
-        glDeleteBuffers(1, &texture->buf[i].pbo);
-        texture->buf[i].hasPBO = false;
-      }
-    }
-  }
+  egl_texture_release(texture);
+  egl_texture_pool_trim(texture,
+      (size_t)option_get_int("egl", "poolSize") * 1024 * 1024);
 
   texture->pixFmt      = pixFmt;
   texture->width       = width;
@@ -196,12 +391,17 @@ bool egl_texture_setup(EGL_Texture * texture, enum EGL_PixelFormat pixFmt, size_
   texture->streaming   = streaming;
   texture->bufferCount = streaming ? BUFFER_COUNT : 1;
   texture->dma         = useDMA;
-  texture->ready       = false;
+  texture->canCopy     = false;
+
+  if (streaming && !useDMA && !texture->reader &&
+      !framebuffer_reader_init(&texture->reader, texture->copyThreads))
+    DEBUG_WARN("Failed to create the frame buffer reader, using a single thread");
+
+  atomic_store_explicit(&texture->state.wc, 0, memory_order_relaxed);
+  atomic_store_explicit(&texture->state.u , 0, memory_order_relaxed);
 
-  atomic_store_explicit(&texture->state.w, 0, memory_order_relaxed);
-  atomic_store_explicit(&texture->state.u, 0, memory_order_relaxed);
-  atomic_store_explicit(&texture->state.s, 0, memory_order_relaxed);
-  atomic_store_explicit(&texture->state.d, 0, memory_order_relaxed);
+  texture->missed.full  = true;
+  texture->missed.count = 0;
 
   switch(pixFmt)
   {
@@ -248,9 +448,12 @@ bool egl_texture_setup(EGL_Texture * texture, enum EGL_PixelFormat pixFmt, size_
 
   texture->pitch = stride / texture->bpp;
 
-  if (texture->tex)
-    glDeleteTextures(1, &texture->tex);
-  glGenTextures(1, &texture->tex);
+  texture->texCount   = streaming && !useDMA ? TEXTURE_COUNT : 1;
+  texture->texBack    = 1;
+  texture->texLatest  = -1;
+  texture->texFront   = 0;
+  texture->frontValid = !streaming;
+  atomic_store_explicit(&texture->texMailbox, 2, memory_order_release);
 
   if (!texture->sampler)
   {
@@ -261,33 +464,46 @@ bool egl_texture_setup(EGL_Texture * texture, enum EGL_PixelFormat pixFmt, size_
     glSamplerParameteri(texture->sampler, GL_TEXTURE_WRAP_T    , GL_CLAMP_TO_EDGE);
   }
 
+  egl_texture_free_dma(texture);
   if (useDMA)
   {
-    if (texture->dmaFBO)
-      glDeleteFramebuffers(1, &texture->dmaFBO);
-    if (texture->dmaTex)
-      glDeleteTextures(1, &texture->dmaTex);
-    glGenFramebuffers(1, &texture->dmaFBO);
-    glGenTextures(1, &texture->dmaTex);
-
-    for (size_t i = 0; i < texture->dmaImageUsed; ++i)
-      eglDestroyImage(texture->display, texture->dmaImages[i].image);
-    texture->dmaImageUsed = 0;
+    glGenTextures(texture->texCount, texture->tex);
     return true;
   }
 
-  glBindTexture(GL_TEXTURE_2D, texture->tex);
-  glTexImage2D(GL_TEXTURE_2D, 0, texture->intFormat, texture->width,
-    texture->height, 0, texture->format, texture->dataType, NULL);
+  for(int i = 0; i < texture->texCount; ++i)
+  {
+    if (!streaming ||
+        !egl_texture_pool_take(texture, false, &texture->tex[i], NULL))
+    {
+      glGenTextures(1, &texture->tex[i]);
+      glBindTexture(GL_TEXTURE_2D, texture->tex[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, texture->intFormat, texture->width,
+        texture->height, 0, texture->format, texture->dataType, NULL);
+    }
+
+    texture->texDamage[i].full  = true;
+    texture->texDamage[i].count = 0;
+  }
   glBindTexture(GL_TEXTURE_2D, 0);
 
   if (!streaming)
     return true;
 
+  /* partial updates leave the other textures behind, they can only be used if
+   * the textures can be brought up to date on the GPU */
+  texture->canCopy = egl_texture_has_copy_image();
+  if (!texture->canCopy)
+    DEBUG_INFO("glCopyImageSubData is unavailable, partial uploads disabled");
+
   for(int i = 0; i < texture->bufferCount; ++i)
   {
-    glGenBuffers(1, &texture->buf[i].pbo);
     texture->buf[i].hasPBO = true;
+    if (egl_texture_pool_take(texture, true, &texture->buf[i].pbo,
+          &texture->buf[i].map))
+      continue;
+
+    glGenBuffers(1, &texture->buf[i].pbo);
 
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->buf[i].pbo);
     glBufferStorage(
@@ -318,26 +534,77 @@ static void egl_warn_slow(void)
   }
 }
 
+/* get the buffer to write the next frame into. When every buffer is waiting
+ * to be uploaded the newest one is taken back and overwritten so the latest
+ * frame always wins, reuse is set as it still holds that frame's damage. This
+ * only fails if the upload thread has already claimed every buffer */
+static bool egl_texture_acquire(EGL_Texture * texture, uint8_t * buffer,
+    bool * reuse)
+{
+  uint16_t wc = atomic_load_explicit(&texture->state.wc, memory_order_acquire);
+  const uint8_t su =
+    atomic_load_explicit(&texture->state.u, memory_order_acquire);
+  const uint8_t sw = STATE_W(wc);
+
+  *reuse = false;
+  if ((uint8_t)(sw - su) < BUFFER_COUNT)
+  {
+    *buffer = sw % BUFFER_COUNT;
+    return true;
+  }
+
+  /* only this thread changes w, so a failed exchange means c moved */
+  while(STATE_C(wc) != sw)
+    if (atomic_compare_exchange_weak_explicit(&texture->state.wc, &wc,
+          STATE_WC(sw - 1, STATE_C(wc)), memory_order_acq_rel,
+          memory_order_acquire))
+    {
+      *buffer = (uint8_t)(sw - 1) % BUFFER_COUNT;
+      *reuse  = true;
+      return true;
+    }
+
+  return false;
+}
+
+static void egl_texture_commit(EGL_Texture * texture)
+{
+  uint16_t wc = atomic_load_explicit(&texture->state.wc, memory_order_relaxed);
+  while(!atomic_compare_exchange_weak_explicit(&texture->state.wc, &wc,
+        STATE_WC(STATE_W(wc) + 1, STATE_C(wc)), memory_order_release,
+        memory_order_relaxed)) {}
+}
+
+/* claim every written buffer for upload, returns the new w */
+static uint8_t egl_texture_claim(EGL_Texture * texture)
+{
+  uint16_t wc = atomic_load_explicit(&texture->state.wc, memory_order_acquire);
+  while(!atomic_compare_exchange_weak_explicit(&texture->state.wc, &wc,
+        STATE_WC(STATE_W(wc), STATE_W(wc)), memory_order_acq_rel,
+        memory_order_acquire)) {}
+  return STATE_W(wc);
+}
+
 bool egl_texture_update(EGL_Texture * texture, const uint8_t * buffer)
 {
   if (texture->streaming)
   {
-    const uint8_t sw =
-      atomic_load_explicit(&texture->state.w, memory_order_acquire);
-
-    if (atomic_load_explicit(&texture->state.u, memory_order_acquire) == (uint8_t)(sw + 1))
+    uint8_t b;
+    bool    reuse;
+    if (!egl_texture_acquire(texture, &b, &reuse))
     {
       egl_warn_slow();
       return true;
     }
 
-    const uint8_t b = sw % BUFFER_COUNT;
     memcpy(texture->buf[b].map, buffer, texture->pboBufferSize);
-    atomic_fetch_add_explicit(&texture->state.w, 1, memory_order_release);
+    texture->buf[b].damage.full  = true;
+    texture->buf[b].damage.count = 0;
+    egl_texture_commit(texture);
   }
   else
   {
-    glBindTexture(GL_TEXTURE_2D, texture->tex);
+    glBindTexture(GL_TEXTURE_2D, texture->tex[0]);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->pitch);
     glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture->width, texture->height,
         texture->format, texture->dataType, buffer);
@@ -346,64 +613,202 @@ bool egl_texture_update(EGL_Texture * texture, const uint8_t * buffer)
   return true;
 }
 
-bool egl_texture_update_from_frame(EGL_Texture * texture, const FrameBuffer * frame)
+static void egl_texture_add_damage(EGL_Texture * texture,
+    struct Damage * damage, const FrameDamageRect * rects, int count)
+{
+  if (damage->full)
+    return;
+
+  if (!count || damage->count + count > KVMFR_MAX_DAMAGE_RECTS)
+  {
+    damage->full  = true;
+    damage->count = 0;
+    return;
+  }
+
+  for(int i = 0; i < count; ++i)
+  {
+    /* clip to the texture, reading outside of it would wait on data that the
+     * host will never write */
+    FrameDamageRect rect = rects[i];
+    if (rect.x >= texture->width || rect.y >= texture->height)
+      continue;
+
+    if (rect.width > texture->width - rect.x)
+      rect.width = texture->width - rect.x;
+    if (rect.height > texture->height - rect.y)
+      rect.height = texture->height - rect.y;
+
+    if (rect.width && rect.height)
+      damage->rects[damage->count++] = rect;
+  }
+
+  /* past half the frame a full multi-threaded copy is as fast */
+  size_t area = 0;
+  for(int i = 0; i < damage->count; ++i)
+    area += (size_t)damage->rects[i].width * damage->rects[i].height;
+
+  if (area * 2 >= texture->width * texture->height)
+  {
+    damage->full  = true;
+    damage->count = 0;
+  }
+}
+
+bool egl_texture_update_from_frame(EGL_Texture * texture,
+    const FrameBuffer * frame, const FrameDamageRect * damageRects,
+    int damageRectsCount)
 {
   if (!texture->streaming)
     return false;
 
-  const uint8_t sw =
-    atomic_load_explicit(&texture->state.w, memory_order_acquire);
-
-  if (atomic_load_explicit(&texture->state.u, memory_order_acquire) == (uint8_t)(sw + 1))
+  uint8_t b;
+  bool    reuse;
+  if (!egl_texture_acquire(texture, &b, &reuse))
   {
     egl_warn_slow();
+
+    /* the frame is dropped, remember what it changed for the next one */
+    egl_texture_add_damage(texture, &texture->missed, damageRects,
+        damageRectsCount);
     return true;
   }
 
-  const uint8_t b = sw % BUFFER_COUNT;
+  /* without a way to update the other textures every upload must be full */
+  if (!texture->canCopy)
+    damageRectsCount = 0;
 
-  framebuffer_read(
-    frame,
-    texture->buf[b].map,
-    texture->stride,
-    texture->height,
-    texture->width,
-    texture->bpp,
-    texture->stride
-  );
+  struct Buffer * buf = &texture->buf[b];
+
+  /* this buffer must carry the frame's damage, anything missed and, if it is
+   * being overwritten, the damage of the frame it held, all of which is read
+   * again from this newer frame */
+  if (reuse)
+  {
+    if (texture->missed.full)
+    {
+      buf->damage.full  = true;
+      buf->damage.count = 0;
+    }
+    else if (texture->missed.count)
+      egl_texture_add_damage(texture, &buf->damage,
+          texture->missed.rects, texture->missed.count);
+  }
+  else
+  {
+    buf->damage.full  = texture->missed.full;
+    buf->damage.count = texture->missed.count;
+    memcpy(buf->damage.rects, texture->missed.rects,
+        texture->missed.count * sizeof(FrameDamageRect));
+  }
+  egl_texture_add_damage(texture, &buf->damage, damageRects, damageRectsCount);
+
+  texture->missed.full  = false;
+  texture->missed.count = 0;
+
+  if (buf->damage.full)
+    framebuffer_read_mt(
+      texture->reader,
+      frame,
+      buf->map,
+      texture->stride,
+      texture->height,
+      texture->width,
+      texture->bpp,
+      texture->stride
+    );
+  else
+    for(int i = 0; i < buf->damage.count; ++i)
+    {
+      const FrameDamageRect * rect = &buf->damage.rects[i];
+      framebuffer_read_rect(
+        frame,
+        buf->map,
+        texture->stride,
+        rect->x,
+        rect->y,
+        rect->width,
+        rect->height,
+        texture->bpp,
+        texture->stride
+      );
+    }
 
-  atomic_fetch_add_explicit(&texture->state.w, 1, memory_order_release);
+  egl_texture_commit(texture);
 
   return true;
 }
 
-bool egl_texture_update_from_dma(EGL_Texture * texture, const FrameBuffer * frame, const int dmaFd)
+/* called once a newer buffer is current, returns when nothing will sample the
+ * buffer again so the message it came from can be released to the host */
+static bool egl_texture_release_dma(EGL_Texture * texture, int index)
 {
-  if (!texture->streaming)
-    return false;
+  /* a render that bound the buffer before it was replaced is still drawing
+   * with it, wait for it to place its fence */
+  GLsync fence;
+  for(;;)
+  {
+    LG_LOCK(texture->dmaLock);
+    if (texture->dmaBound != index)
+    {
+      fence = texture->dmaImages[index].fence;
+      texture->dmaImages[index].fence = 0;
+      LG_UNLOCK(texture->dmaLock);
+      break;
+    }
+    LG_UNLOCK(texture->dmaLock);
+  }
 
-  const uint8_t sw =
-    atomic_load_explicit(&texture->state.w, memory_order_acquire);
+  if (!fence)
+    return true;
 
-  if (atomic_load_explicit(&texture->state.u, memory_order_acquire) == (uint8_t)(sw + 1))
+  /* the render thread flushed the fence so there is nothing for us to flush,
+   * the host is held off until it signals no matter how long it takes */
+  for(;;)
   {
-    egl_warn_slow();
-    return true;
+    switch(glClientWaitSync(fence, 0, 1000000000)) // 1s
+    {
+      case GL_ALREADY_SIGNALED:
+      case GL_CONDITION_SATISFIED:
+        glDeleteSync(fence);
+        return true;
+
+      case GL_TIMEOUT_EXPIRED:
+        egl_warn_slow();
+        continue;
+
+      case GL_WAIT_FAILED:
+      case GL_INVALID_VALUE:
+        glDeleteSync(fence);
+        DEBUG_EGL_ERROR("glClientWaitSync failed");
+        return false;
+    }
   }
+}
 
-  EGLImage image = EGL_NO_IMAGE;
+bool egl_texture_update_from_dma(EGL_Texture * texture, const FrameBuffer * frame, const int dmaFd)
+{
+  if (!texture->streaming)
+    return false;
 
+  int index = -1;
   for (int i = 0; i < texture->dmaImageUsed; ++i)
   {
     if (texture->dmaImages[i].fd == dmaFd)
     {
-      image = texture->dmaImages[i].image;
+      index = i;
       break;
     }
   }
 
-  if (image == EGL_NO_IMAGE)
+  if (index < 0)
   {
+    if (texture->dmaImageUsed == KVMFR_FRAME_BUFFERS)
+    {
+      DEBUG_ERROR("More DMA buffers than frame buffers");
+      return false;
+    }
+
     EGLAttrib const attribs[] =
     {
       EGL_WIDTH                    , texture->width,
@@ -416,7 +821,7 @@ bool egl_texture_update_from_dma(EGL_Texture * texture, const FrameBuffer * fram
     };
 
     /* create the image backed by the dma buffer */
-    image = eglCreateImage(
+    EGLImage image = eglCreateImage(
       texture->display,
       EGL_NO_CONTEXT,
       EGL_LINUX_DMA_BUF_EXT,
@@ -430,41 +835,136 @@ bool egl_texture_update_from_dma(EGL_Texture * texture, const FrameBuffer * fram
       return false;
     }
 
-    if (texture->dmaImageUsed == texture->dmaImageCount)
-    {
-      size_t newCount = texture->dmaImageCount * 2 + 2;
-      void * new = realloc(texture->dmaImages, newCount * sizeof *texture->dmaImages);
-      if (!new)
-      {
-        DEBUG_EGL_ERROR("Failed to allocate memory");
-        eglDestroyImage(texture->display, image);
-        return false;
-      }
-      texture->dmaImageCount = newCount;
-      texture->dmaImages     = new;
-    }
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    g_egl_dynProcs.glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    const size_t index = texture->dmaImageUsed++;
+    index = texture->dmaImageUsed++;
     texture->dmaImages[index].fd    = dmaFd;
     texture->dmaImages[index].image = image;
+    texture->dmaImages[index].tex   = tex;
+    texture->dmaImages[index].fence = 0;
+
+    /* the texture is created in this context but sampled in the render
+     * context, this is only waited on the first time it is bound */
+    texture->dmaImages[index].sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
   }
 
-  /* wait for completion */
+  /* wait for the host to finish writing the frame, the image is sampled in
+   * place so there is nothing to copy and no GPU work to wait on */
   framebuffer_wait(frame, texture->height * texture->stride);
 
-  glBindTexture(GL_TEXTURE_2D, texture->dmaTex);
-  g_egl_dynProcs.glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, image);
+  const int prev = atomic_exchange_explicit(&texture->dmaCurrent, index,
+      memory_order_acq_rel);
+  if (prev >= 0 && prev != index)
+    return egl_texture_release_dma(texture, prev);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, texture->dmaFBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->dmaTex, 0);
+  return true;
+}
+
+static void egl_texture_merge_damage(EGL_Texture * texture,
+    struct Damage * dst, const struct Damage * src)
+{
+  if (src->full)
+  {
+    dst->full  = true;
+    dst->count = 0;
+  }
+  else if (src->count)
+    egl_texture_add_damage(texture, dst, src->rects, src->count);
+}
 
-  glBindTexture(GL_TEXTURE_2D, texture->tex);
-  glCopyTexImage2D(GL_TEXTURE_2D, 0, texture->intFormat, 0, 0, texture->width, texture->height, 0);
+/* bring the back texture up to date with the latest one before the new damage
+ * is applied over it */
+static void egl_texture_catch_up(EGL_Texture * texture, int back)
+{
+  struct Damage * damage = &texture->texDamage[back];
+  const GLuint src = texture->tex[texture->texLatest];
+  const GLuint dst = texture->tex[back];
+
+  if (damage->full)
+    g_egl_dynProcs.glCopyImageSubData(
+        src, GL_TEXTURE_2D, 0, 0, 0, 0,
+        dst, GL_TEXTURE_2D, 0, 0, 0, 0,
+        texture->width, texture->height, 1);
+  else
+    for(int i = 0; i < damage->count; ++i)
+    {
+      const FrameDamageRect * rect = &damage->rects[i];
+      g_egl_dynProcs.glCopyImageSubData(
+          src, GL_TEXTURE_2D, 0, rect->x, rect->y, 0,
+          dst, GL_TEXTURE_2D, 0, rect->x, rect->y, 0,
+          rect->width, rect->height, 1);
+    }
+}
 
-  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-  glFlush();
+static void egl_texture_upload(EGL_Texture * texture, uint8_t b)
+{
+  const struct Damage * damage = &texture->buf[b].damage;
 
-  switch (glClientWaitSync(fence, 0, 10000000)) // 10ms
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->buf[b].pbo);
+  if (damage->full)
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture->width, texture->height,
+        texture->format, texture->dataType, (const void *)0);
+  else
+  {
+    /* the PBO has the frame's layout, so skip to each rect within it */
+    for(int i = 0; i < damage->count; ++i)
+    {
+      const FrameDamageRect * rect = &damage->rects[i];
+      glPixelStorei(GL_UNPACK_SKIP_PIXELS, rect->x);
+      glPixelStorei(GL_UNPACK_SKIP_ROWS  , rect->y);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, rect->x, rect->y, rect->width,
+          rect->height, texture->format, texture->dataType, (const void *)0);
+    }
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS  , 0);
+  }
+}
+
+enum EGL_TexStatus egl_texture_process(EGL_Texture * texture,
+    FrameDamageRect * damageRects, int * damageRectsCount)
+{
+  *damageRectsCount = -1;
+  if (!texture->streaming)
+    return EGL_TEX_STATUS_OK;
+
+  if (texture->dma)
+    return atomic_load_explicit(&texture->dmaCurrent, memory_order_acquire) >= 0 ?
+      EGL_TEX_STATUS_OK : EGL_TEX_STATUS_NOTREADY;
+
+  uint8_t su = atomic_load_explicit(&texture->state.u, memory_order_acquire);
+  const uint8_t sw = egl_texture_claim(texture);
+
+  if (su == sw)
+    return texture->texLatest >= 0 ? EGL_TEX_STATUS_OK : EGL_TEX_STATUS_NOTREADY;
+
+  const int back = texture->texBack;
+  struct Damage damage = { .full = false, .count = 0 };
+
+  glBindTexture(GL_TEXTURE_2D, texture->tex[back]);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->pitch);
+
+  if (texture->texLatest >= 0 && !texture->buf[su % BUFFER_COUNT].damage.full)
+    egl_texture_catch_up(texture, back);
+
+  /* apply every pending buffer in order, each only holds its own damage */
+  for(; su != sw; ++su)
+  {
+    const uint8_t b = su % BUFFER_COUNT;
+    egl_texture_upload(texture, b);
+    egl_texture_merge_damage(texture, &damage, &texture->buf[b].damage);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  /* wait here so the render thread never has to, once this has signalled the
+   * PBOs can be reused and the texture is safe to sample */
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  switch(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)) // 1s
   {
     case GL_ALREADY_SIGNALED:
     case GL_CONDITION_SATISFIED:
@@ -472,111 +972,109 @@ bool egl_texture_update_from_dma(EGL_Texture * texture, const FrameBuffer * fram
 
     case GL_TIMEOUT_EXPIRED:
       egl_warn_slow();
+      glFinish();
       break;
 
     case GL_WAIT_FAILED:
     case GL_INVALID_VALUE:
+      glDeleteSync(fence);
       DEBUG_EGL_ERROR("glClientWaitSync failed");
+      return EGL_TEX_STATUS_ERROR;
   }
-
   glDeleteSync(fence);
-  atomic_fetch_add_explicit(&texture->state.w, 1, memory_order_release);
-  return true;
-}
-
-enum EGL_TexStatus egl_texture_process(EGL_Texture * texture)
-{
-  if (!texture->streaming)
-    return EGL_TEX_STATUS_OK;
-
-  const uint8_t su =
-    atomic_load_explicit(&texture->state.u, memory_order_acquire);
-
-  const uint8_t nextu = su + 1;
-  if (
-      su    == atomic_load_explicit(&texture->state.w, memory_order_acquire) ||
-      nextu == atomic_load_explicit(&texture->state.s, memory_order_acquire) ||
-      nextu == atomic_load_explicit(&texture->state.d, memory_order_acquire))
-    return texture->ready ? EGL_TEX_STATUS_OK : EGL_TEX_STATUS_NOTREADY;
 
-  const uint8_t b = su % BUFFER_COUNT;
-
-  /* update the texture */
-  if (!texture->dma)
-  {
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->buf[b].pbo);
-    glBindTexture(GL_TEXTURE_2D, texture->tex);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, texture->pitch);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture->width, texture->height,
-        texture->format, texture->dataType, (const void *)0);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  atomic_store_explicit(&texture->state.u, sw, memory_order_release);
 
-    /* create a fence to prevent usage before the update is complete */
-    texture->buf[b].sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  /* every other texture is now behind by this damage */
+  for(int i = 0; i < texture->texCount; ++i)
+    if (i == back)
+    {
+      texture->texDamage[i].full  = false;
+      texture->texDamage[i].count = 0;
+    }
+    else
+      egl_texture_merge_damage(texture, &texture->texDamage[i], &damage);
 
-    /* we must flush to ensure the sync is in the command buffer */
-    glFlush();
-  }
+  /* hand the texture to the render thread and take back whichever one it is
+   * not using */
+  texture->texLatest = back;
+  texture->texBack   = atomic_exchange_explicit(&texture->texMailbox,
+      back | TEXTURE_FRESH, memory_order_acq_rel) & ~TEXTURE_FRESH;
 
-  texture->ready = true;
-  atomic_fetch_add_explicit(&texture->state.u, 1, memory_order_release);
+  *damageRectsCount = damage.full ? 0 : damage.count;
+  memcpy(damageRects, damage.rects, *damageRectsCount * sizeof(FrameDamageRect));
 
   return EGL_TEX_STATUS_OK;
 }
 
 enum EGL_TexStatus egl_texture_bind(EGL_Texture * texture)
 {
-  uint8_t ss = atomic_load_explicit(&texture->state.s, memory_order_acquire);
-  uint8_t sd = atomic_load_explicit(&texture->state.d, memory_order_acquire);
-
-  if (texture->streaming)
+  if (texture->streaming && texture->dma)
   {
-    if (!texture->ready)
+    /* taken under the lock so the frame thread either sees this buffer as
+     * bound or this render picks up the buffer that replaced it */
+    LG_LOCK(texture->dmaLock);
+    const int index =
+      atomic_load_explicit(&texture->dmaCurrent, memory_order_acquire);
+    texture->dmaBound = index;
+    LG_UNLOCK(texture->dmaLock);
+    if (index < 0)
       return EGL_TEX_STATUS_NOTREADY;
 
-    const uint8_t b = ss % BUFFER_COUNT;
-    if (texture->dma)
-    {
-      ss = atomic_fetch_add_explicit(&texture->state.s, 1,
-        memory_order_release) + 1;
-    }
-    else if (texture->buf[b].sync != 0)
+    /* make the GPU wait for the texture creation in the frame context, this
+     * does not block the CPU */
+    if (texture->dmaImages[index].sync)
     {
-      switch(glClientWaitSync(texture->buf[b].sync, 0, 20000000)) // 20ms
-      {
-        case GL_ALREADY_SIGNALED:
-        case GL_CONDITION_SATISFIED:
-          glDeleteSync(texture->buf[b].sync);
-          texture->buf[b].sync = 0;
-
-          ss = atomic_fetch_add_explicit(&texture->state.s, 1,
-              memory_order_release) + 1;
-          break;
-
-        case GL_TIMEOUT_EXPIRED:
-          break;
-
-        case GL_WAIT_FAILED:
-        case GL_INVALID_VALUE:
-          glDeleteSync(texture->buf[b].sync);
-          texture->buf[b].sync = 0;
-          DEBUG_EGL_ERROR("glClientWaitSync failed");
-          return EGL_TEX_STATUS_ERROR;
-      }
+      glWaitSync(texture->dmaImages[index].sync, 0, GL_TIMEOUT_IGNORED);
+      glDeleteSync(texture->dmaImages[index].sync);
+      texture->dmaImages[index].sync = 0;
     }
 
-    if (ss != sd && ss != (uint8_t)(sd + 1))
-      sd = atomic_fetch_add_explicit(&texture->state.d, 1,
-          memory_order_release) + 1;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture->dmaImages[index].tex);
+    glBindSampler(0, texture->sampler);
+    return EGL_TEX_STATUS_OK;
+  }
+
+  if (texture->streaming &&
+      atomic_load_explicit(&texture->texMailbox, memory_order_acquire) &
+        TEXTURE_FRESH)
+  {
+    /* take the newest texture, the upload thread already waited on it */
+    texture->texFront = atomic_exchange_explicit(&texture->texMailbox,
+        texture->texFront, memory_order_acq_rel) & ~TEXTURE_FRESH;
+    texture->frontValid = true;
   }
 
+  if (!texture->frontValid)
+    return EGL_TEX_STATUS_NOTREADY;
+
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture->tex);
+  glBindTexture(GL_TEXTURE_2D, texture->tex[texture->texFront]);
   glBindSampler(0, texture->sampler);
 
   return EGL_TEX_STATUS_OK;
 }
 
+void egl_texture_fence(EGL_Texture * texture)
+{
+  if (!texture->dma || texture->dmaBound < 0)
+    return;
+
+  /* flushed here as the frame thread waits on it from its own context */
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+
+  LG_LOCK(texture->dmaLock);
+  GLsync old = texture->dmaImages[texture->dmaBound].fence;
+  texture->dmaImages[texture->dmaBound].fence = fence;
+  texture->dmaBound = -1;
+  LG_UNLOCK(texture->dmaLock);
+
+  if (old)
+    glDeleteSync(old);
+}
+
 int egl_texture_count(EGL_Texture * texture)
 {
   return 1;
@@ -22,6 +22,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stdbool.h>
 #include "shader.h"
 #include "common/framebuffer.h"
+#include "common/types.h"
 
 #include <GL/gl.h>
 #include <EGL/egl.h>
@@ -45,13 +46,19 @@ enum EGL_TexStatus
   EGL_TEX_STATUS_ERROR
 };
 
-bool egl_texture_init(EGL_Texture ** texture, EGLDisplay * display);
+bool egl_texture_init(EGL_Texture ** texture, EGLDisplay * display,
+    unsigned int copyThreads);
 void egl_texture_free(EGL_Texture ** tex);
 
 bool               egl_texture_setup  (EGL_Texture * texture, enum EGL_PixelFormat pixfmt, size_t width, size_t height, size_t stride, bool streaming, bool useDMA);
 bool               egl_texture_update (EGL_Texture * texture, const uint8_t * buffer);
-bool               egl_texture_update_from_frame(EGL_Texture * texture, const FrameBuffer * frame);
+bool               egl_texture_update_from_frame(EGL_Texture * texture, const FrameBuffer * frame, const FrameDamageRect * damageRects, int damageRectsCount);
 bool               egl_texture_update_from_dma  (EGL_Texture * texture, const FrameBuffer * frmame, const int dmaFd);
-enum EGL_TexStatus egl_texture_process(EGL_Texture * texture);
+/* run on the upload thread, if a new texture was published the regions it
+ * changed are returned, a count of 0 meaning all of it, otherwise -1 */
+enum EGL_TexStatus egl_texture_process(EGL_Texture * texture, FrameDamageRect * damageRects, int * damageRectsCount);
 enum EGL_TexStatus egl_texture_bind          (EGL_Texture * texture);
+/* called after drawing with a bound DMA texture, the buffer it sampled is not
+ * released to the host until the GPU has passed this point */
+void               egl_texture_fence         (EGL_Texture * texture);
 int                egl_texture_count         (EGL_Texture * texture);
@@ -0,0 +1,282 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "interface/renderer.h"
+#include "app.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/debug.h"
+#include "common/event.h"
+#include "common/option.h"
+#include "common/framebuffer.h"
+
+#define BUFFER_COUNT 2
+
+static struct Option headless_options[] =
+{
+  {
+    .module       = "headless",
+    .name         = "copy",
+    .description  = "Copy each frame into system memory as a renderer upload would",
+    .type         = OPTION_TYPE_BOOL,
+    .value.x_bool = true
+  },
+  {0}
+};
+
+struct Inst
+{
+  bool                copy;
+  unsigned int        copyThreads;
+  LG_RendererFormat   format;
+  size_t              bufferSize;
+  uint8_t           * buffers[BUFFER_COUNT];
+  int                 bufferIndex;
+  FrameBufferReader * reader;
+  LGEvent           * frameEvent;
+  bool                showFPS;
+  bool                closeFlag;
+};
+
+static const char * headless_get_name(void)
+{
+  return "Headless";
+}
+
+static void headless_setup(void)
+{
+  option_register(headless_options);
+}
+
+static bool headless_create(void ** opaque, const LG_RendererParams params,
+    bool * needsOpenGL)
+{
+  // only usable with the headless display server
+  if (!option_get_bool("headless", "enable"))
+    return false;
+
+  struct Inst * this = calloc(1, sizeof(*this));
+  if (!this)
+  {
+    DEBUG_ERROR("Failed to allocate %lu bytes", sizeof(*this));
+    return false;
+  }
+
+  this->copy        = option_get_bool("headless", "copy");
+  this->copyThreads = params.copyThreads;
+  if (!(this->frameEvent = lgCreateEvent(true, 0)))
+  {
+    DEBUG_ERROR("Failed to create the frame event");
+    free(this);
+    return false;
+  }
+
+  *opaque      = this;
+  *needsOpenGL = false;
+  return true;
+}
+
+static bool headless_initialize(void * opaque)
+{
+  return true;
+}
+
+static void free_buffers(struct Inst * this)
+{
+  for(int i = 0; i < BUFFER_COUNT; ++i)
+  {
+    free(this->buffers[i]);
+    this->buffers[i] = NULL;
+  }
+  this->bufferSize = 0;
+}
+
+static void headless_deinitialize(void * opaque)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  if (!this)
+    return;
+
+  framebuffer_reader_free(&this->reader);
+  free_buffers(this);
+  lgFreeEvent(this->frameEvent);
+  free(this);
+}
+
+static bool headless_supports(void * opaque, LG_RendererSupport flag)
+{
+  return false;
+}
+
+static void headless_on_restart(void * opaque)
+{
+}
+
+static void headless_on_resize(void * opaque, const int width, const int height,
+    const double scale, const LG_RendererRect destRect,
+    LG_RendererRotate rotate)
+{
+}
+
+static bool headless_on_mouse_shape(void * opaque,
+    const LG_RendererCursor cursor, const int width, const int height,
+    const int pitch, const uint8_t * data)
+{
+  return true;
+}
+
+static bool headless_on_mouse_event(void * opaque, const bool visible,
+    const int x, const int y)
+{
+  return true;
+}
+
+static bool headless_on_frame_format(void * opaque,
+    const LG_RendererFormat format, bool useDMA)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  memcpy(&this->format, &format, sizeof(LG_RendererFormat));
+
+  if (!this->copy)
+    return true;
+
+  // allocate like a pinned upload buffer so the copy cost is comparable
+  const size_t pagesize = getpagesize();
+  const size_t size     = (format.height * format.width * (format.bpp / 8) +
+      pagesize - 1) & ~(pagesize - 1);
+
+  if (size != this->bufferSize)
+  {
+    free_buffers(this);
+    for(int i = 0; i < BUFFER_COUNT; ++i)
+      if (!(this->buffers[i] = aligned_alloc(pagesize, size)))
+      {
+        DEBUG_ERROR("Failed to allocate %lu bytes", size);
+        free_buffers(this);
+        return false;
+      }
+    this->bufferSize = size;
+  }
+
+  if (!this->reader &&
+      !framebuffer_reader_init(&this->reader, this->copyThreads))
+    DEBUG_WARN("Failed to create the frame buffer reader, using a single thread");
+
+  return true;
+}
+
+static bool headless_on_frame(void * opaque, const FrameBuffer * frame,
+    int dmaFd, const FrameDamageRect * damageRects, int damageRectsCount)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  if (this->copy)
+  {
+    if (++this->bufferIndex == BUFFER_COUNT)
+      this->bufferIndex = 0;
+
+    const size_t bpp = this->format.bpp / 8;
+    framebuffer_read_mt(
+      this->reader,
+      frame,
+      this->buffers[this->bufferIndex],
+      this->format.width * bpp,
+      this->format.height,
+      this->format.width,
+      bpp,
+      this->format.pitch
+    );
+  }
+  else
+    framebuffer_wait(frame, this->format.height * this->format.pitch);
+
+  app_frameUploaded();
+  lgSignalEvent(this->frameEvent);
+  return true;
+}
+
+static void headless_on_alert(void * opaque, const LG_MsgAlert alert,
+    const char * message, bool ** closeFlag)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  DEBUG_INFO("Alert: %s", message);
+
+  if (closeFlag)
+    *closeFlag = &this->closeFlag;
+}
+
+static void headless_on_help(void * opaque, const char * message)
+{
+}
+
+static void headless_on_show_fps(void * opaque, bool showFPS)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  this->showFPS = showFPS;
+}
+
+static bool headless_render_startup(void * opaque)
+{
+  return true;
+}
+
+static bool headless_render(void * opaque, LG_RendererRotate rotate,
+    const bool invalidateWindow)
+{
+  struct Inst * this = (struct Inst *)opaque;
+
+  /* there is no vsync to pace us, present as soon as a frame has arrived so
+   * the present stage measures only the client's own overhead */
+  lgWaitEvent(this->frameEvent, 100);
+  return true;
+}
+
+static void headless_update_fps(void * opaque, const float avgUPS,
+    const float avgFPS, const char * stats)
+{
+  struct Inst * this = (struct Inst *)opaque;
+  if (this->showFPS)
+    DEBUG_INFO("UPS: %8.4f, FPS: %8.4f", avgUPS, avgFPS);
+}
+
+const LG_Renderer LGR_Headless =
+{
+  .get_name        = headless_get_name,
+  .setup           = headless_setup,
+
+  .create          = headless_create,
+  .initialize      = headless_initialize,
+  .deinitialize    = headless_deinitialize,
+  .supports        = headless_supports,
+  .on_restart      = headless_on_restart,
+  .on_resize       = headless_on_resize,
+  .on_mouse_shape  = headless_on_mouse_shape,
+  .on_mouse_event  = headless_on_mouse_event,
+  .on_frame_format = headless_on_frame_format,
+  .on_frame        = headless_on_frame,
+  .on_alert        = headless_on_alert,
+  .on_help         = headless_on_help,
+  .on_show_fps     = headless_on_show_fps,
+  .render_startup  = headless_render_startup,
+  .render          = headless_render,
+  .update_fps      = headless_update_fps
+};
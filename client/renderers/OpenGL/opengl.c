@@ -24,6 +24,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <unistd.h>
 #include <malloc.h>
 #include <math.h>
+#include <stdatomic.h>
 
 #include <GL/gl.h>
 #include <GL/glx.h>
@@ -32,11 +33,20 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/option.h"
 #include "common/framebuffer.h"
 #include "common/locking.h"
+#include "common/cursor.h"
 #include "dynamic/fonts.h"
 #include "ll.h"
+#include "app.h"
 
 #define BUFFER_COUNT       2
 
+/* frames are copied into these by the frame thread and uploaded from them by
+ * the render thread, this must be a power of 2 */
+#define PBO_COUNT          4
+
+/* the most objects kept in the pool, regardless of their size */
+#define POOL_MAX           16
+
 #define FPS_TEXTURE        0
 #define MOUSE_TEXTURE      1
 #define ALERT_TEXTURE      2
@@ -76,6 +86,13 @@ static struct Option opengl_options[] =
     .type         = OPTION_TYPE_BOOL,
     .value.x_bool = true
   },
+  {
+    .module       = "opengl",
+    .name         = "poolSize",
+    .description  = "Memory in MiB kept for the textures of recently used frame formats",
+    .type         = OPTION_TYPE_INT,
+    .value.x_int  = 256
+  },
   {0}
 };
 
@@ -99,6 +116,22 @@ struct OpenGL_Options
   bool vsync;
   bool preventBuffer;
   bool amdPinnedMem;
+  size_t poolSize;
+};
+
+/* a frame texture or copy buffer that was in use for an earlier format */
+struct PoolEntry
+{
+  bool      isBuffer;
+  GLuint    name;
+  uint8_t * pixels;
+  uint8_t * map;
+  size_t    size;
+  uint64_t  used;
+
+  /* textures only */
+  unsigned int width, height;
+  GLuint       intFormat;
 };
 
 struct Alert
@@ -118,6 +151,8 @@ struct Inst
   struct OpenGL_Options opt;
 
   bool              amdPinnedMemSupport;
+  bool              hasBufferStorage;
+  FrameBufferReader * reader;
   bool              renderStarted;
   bool              configured;
   bool              reconfigure;
@@ -125,7 +160,6 @@ struct Inst
 
   struct IntPoint   window;
   float             uiScale;
-  bool              frameUpdate;
 
   const LG_Font   * font;
   LG_FontObj        fontObj, alertFontObj;
@@ -136,14 +170,21 @@ struct Inst
   GLuint              vboFormat;
   GLuint              dataFormat;
   size_t              texSize;
-  size_t              texPos;
-  const FrameBuffer * frame;
 
   uint64_t          drawStart;
-  bool              hasBuffers;
-  GLuint            vboID[BUFFER_COUNT];
-  uint8_t         * texPixels[BUFFER_COUNT];
-  LG_Lock           syncLock;
+  GLuint            vboID[PBO_COUNT];
+  uint8_t         * texPixels[PBO_COUNT];
+  GLsync            fences[PBO_COUNT];
+
+  /* where the frame thread writes each buffer, the buffers are only valid
+   * while buffersReady is set. pboWrite is advanced by the frame thread,
+   * pboRelease and pboUpload by the render thread */
+  uint8_t         * pboMap[PBO_COUNT];
+  LG_RendererFormat pboFormat;
+  atomic_bool       buffersReady;
+  _Atomic(uint8_t)  pboWrite, pboRelease;
+  uint8_t           pboUpload;
+
   bool              texReady;
   int               texIndex;
   int               texList;
@@ -153,8 +194,15 @@ struct Inst
 
   bool              hasTextures, hasFrames;
   GLuint            frames[BUFFER_COUNT];
-  GLsync            fences[BUFFER_COUNT];
   GLuint            textures[TEXTURE_COUNT];
+
+  /* storage released by format changes, so switching back to a recent format
+   * does not need to allocate and map it again */
+  struct PoolEntry  pool[POOL_MAX];
+  int               poolCount;
+  size_t            poolSize;
+  uint64_t          poolClock;
+
   struct ll       * alerts;
   int               alertList;
 
@@ -170,9 +218,11 @@ struct Inst
   LG_RendererCursor mouseCursor;
   int               mouseWidth;
   int               mouseHeight;
-  int               mousePitch;
-  uint8_t *         mouseData;
+  uint64_t          mouseHash;
+  uint32_t *        mouseData;
   size_t            mouseDataSize;
+  uint32_t *        mouseConv;
+  size_t            mouseConvSize;
 
   bool              mouseUpdate;
   bool              newShape;
@@ -192,6 +242,7 @@ enum ConfigStatus
 };
 
 static void deconfigure(struct Inst * this);
+static void pool_trim(struct Inst * this, size_t budget);
 static enum ConfigStatus configure(struct Inst * this);
 static void update_mouse_shape(struct Inst * this, bool * newShape);
 static bool draw_frame(struct Inst * this);
@@ -227,10 +278,11 @@ bool opengl_create(void ** opaque, const LG_RendererParams params,
   this->opt.vsync         = option_get_bool("opengl", "vsync"        );
   this->opt.preventBuffer = option_get_bool("opengl", "preventBuffer");
   this->opt.amdPinnedMem  = option_get_bool("opengl", "amdPinnedMem" );
+  this->opt.poolSize      =
+    (size_t)option_get_int("opengl", "poolSize") * 1024 * 1024;
 
 
   LG_LOCK_INIT(this->formatLock);
-  LG_LOCK_INIT(this->syncLock  );
   LG_LOCK_INIT(this->mouseLock );
 
   this->font = LG_Fonts[0];
@@ -278,8 +330,10 @@ void opengl_deinitialize(void * opaque)
   }
 
   deconfigure(this);
-  if (this->mouseData)
-    free(this->mouseData);
+  pool_trim(this, 0);
+  framebuffer_reader_free(&this->reader);
+  free(this->mouseData);
+  free(this->mouseConv);
 
   if (this->glContext)
   {
@@ -288,7 +342,6 @@ void opengl_deinitialize(void * opaque)
   }
 
   LG_LOCK_FREE(this->formatLock);
-  LG_LOCK_FREE(this->syncLock  );
   LG_LOCK_FREE(this->mouseLock );
 
   struct Alert * alert;
@@ -357,23 +410,53 @@ bool opengl_on_mouse_shape(void * opaque, const LG_RendererCursor cursor,
   if (!this)
     return false;
 
-  LG_LOCK(this->mouseLock);
-  this->mouseCursor = cursor;
-  this->mouseWidth  = width;
-  this->mouseHeight = height;
-  this->mousePitch  = pitch;
+  // the host often resends the current shape, don't upload it again
+  const uint64_t hash = cursor_hash(cursor, width, height, pitch, data);
+  if (hash == this->mouseHash)
+    return true;
 
-  const size_t size = height * pitch;
-  if (size > this->mouseDataSize)
+  const size_t size = (size_t)width * height * sizeof(uint32_t);
+  if (size > this->mouseConvSize)
   {
-    if (this->mouseData)
-      free(this->mouseData);
-    this->mouseData     = (uint8_t *)malloc(size);
-    this->mouseDataSize = size;
+    free(this->mouseConv);
+    this->mouseConv = (uint32_t *)malloc(size);
+    if (!this->mouseConv)
+    {
+      DEBUG_ERROR("Failed to malloc buffer for cursor shape");
+      this->mouseConvSize = 0;
+      return false;
+    }
+    this->mouseConvSize = size;
   }
 
-  memcpy(this->mouseData, data, size);
-  this->newShape = true;
+  switch(cursor)
+  {
+    case LG_CURSOR_COLOR:
+      cursor_convert_color(this->mouseConv, data, width, height, pitch);
+      break;
+
+    case LG_CURSOR_MASKED_COLOR:
+      cursor_convert_masked(this->mouseConv, data, width, height, pitch);
+      break;
+
+    case LG_CURSOR_MONOCHROME:
+      cursor_convert_mono(this->mouseConv, data, width, height, pitch);
+      break;
+  }
+
+  LG_LOCK(this->mouseLock);
+  uint32_t * tmpData = this->mouseData;
+  size_t     tmpSize = this->mouseDataSize;
+
+  this->mouseData     = this->mouseConv;
+  this->mouseDataSize = this->mouseConvSize;
+  this->mouseConv     = tmpData;
+  this->mouseConvSize = tmpSize;
+  this->mouseCursor   = cursor;
+  this->mouseWidth    = width;
+  this->mouseHeight   = height;
+  this->mouseHash     = hash;
+  this->newShape      = true;
   LG_UNLOCK(this->mouseLock);
 
   return true;
@@ -399,21 +482,67 @@ bool opengl_on_frame_format(void * opaque, const LG_RendererFormat format, bool
 {
   struct Inst * this = (struct Inst *)opaque;
 
+  /* the render thread recreates the buffers, stop writing to them first. This
+   * must be done under the lock, a configure for the previous format that is
+   * still running would otherwise mark its buffers ready again after this */
   LG_LOCK(this->formatLock);
+  atomic_store_explicit(&this->buffersReady, false, memory_order_release);
   memcpy(&this->format, &format, sizeof(LG_RendererFormat));
   this->reconfigure = true;
   LG_UNLOCK(this->formatLock);
   return true;
 }
 
-bool opengl_on_frame(void * opaque, const FrameBuffer * frame, int dmaFd)
+static void opengl_warn_slow(void)
+{
+  static bool warnDone = false;
+  if (!warnDone)
+  {
+    warnDone = true;
+    DEBUG_WARN("The guest is providing updates faster than the frames can be uploaded");
+  }
+}
+
+bool opengl_on_frame(void * opaque, const FrameBuffer * frame, int dmaFd,
+    const FrameDamageRect * damageRects, int damageRectsCount)
 {
   struct Inst * this = (struct Inst *)opaque;
 
-  LG_LOCK(this->syncLock);
-  this->frame       = frame;
-  this->frameUpdate = true;
-  LG_UNLOCK(this->syncLock);
+  /* after a format change the render thread has to create the buffers before
+   * the frame can be copied, give it a little time to do so */
+  for(int i = 0; i < 100 &&
+      !atomic_load_explicit(&this->buffersReady, memory_order_acquire); ++i)
+    usleep(1000);
+
+  if (!atomic_load_explicit(&this->buffersReady, memory_order_acquire))
+    return true;
+
+  const uint8_t sw =
+    atomic_load_explicit(&this->pboWrite, memory_order_relaxed);
+  if ((uint8_t)(sw - atomic_load_explicit(&this->pboRelease,
+          memory_order_acquire)) == PBO_COUNT)
+  {
+    opengl_warn_slow();
+    return true;
+  }
+
+  /* copy here rather than on the render thread so that the render thread is
+   * never held up by the transfer. The size comes from the format the buffers
+   * were created for, not this->format which may already be newer */
+  const LG_RendererFormat * fmt = &this->pboFormat;
+  const int bpp = fmt->bpp / 8;
+  framebuffer_read_mt(
+    this->reader,
+    frame,
+    this->pboMap[sw % PBO_COUNT],
+    fmt->width * bpp,
+    fmt->height,
+    fmt->width,
+    bpp,
+    fmt->pitch
+  );
+
+  atomic_store_explicit(&this->pboWrite, sw + 1, memory_order_release);
 
   if (this->waiting)
   {
@@ -533,6 +662,11 @@ bool opengl_render_startup(void * opaque)
   DEBUG_INFO("Renderer: %s", glGetString(GL_RENDERER));
   DEBUG_INFO("Version : %s", glGetString(GL_VERSION ));
 
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  this->hasBufferStorage = major > 4 || (major == 4 && minor >= 4);
+
   GLint n;
   glGetIntegerv(GL_NUM_EXTENSIONS, &n);
   for(GLint i = 0; i < n; ++i)
@@ -547,8 +681,17 @@ bool opengl_render_startup(void * opaque)
       }
       else
         DEBUG_INFO("GL_AMD_pinned_memory is available but not in use");
-      break;
     }
+    else if (strcmp((const char *)ext, "GL_ARB_buffer_storage") == 0)
+      this->hasBufferStorage = true;
+  }
+
+  if (!this->amdPinnedMemSupport)
+  {
+    if (this->hasBufferStorage)
+      DEBUG_INFO("Using persistently mapped buffers");
+    else
+      DEBUG_INFO("Persistent buffer mapping is unavailable, staging in system memory");
   }
 
   glEnable(GL_TEXTURE_2D);
@@ -572,12 +715,15 @@ bool opengl_render_startup(void * opaque)
   }
   this->hasTextures = true;
 
+  if (!framebuffer_reader_init(&this->reader, this->params.copyThreads))
+    DEBUG_WARN("Failed to create the frame buffer reader, using a single thread");
+
   app_glSetSwapInterval(this->opt.vsync ? 1 : 0);
   this->renderStarted = true;
   return true;
 }
 
-bool opengl_render(void * opaque, LG_RendererRotate rotate)
+bool opengl_render(void * opaque, LG_RendererRotate rotate, const bool invalidateWindow)
 {
   struct Inst * this = (struct Inst *)opaque;
   if (!this)
@@ -694,14 +840,16 @@ bool opengl_render(void * opaque, LG_RendererRotate rotate)
   return true;
 }
 
-void opengl_update_fps(void * opaque, const float avgUPS, const float avgFPS)
+void opengl_update_fps(void * opaque, const float avgUPS, const float avgFPS,
+    const char * stats)
 {
   struct Inst * this = (struct Inst *)opaque;
   if (!this->showFPS)
     return;
 
-  char str[128];
-  snprintf(str, sizeof(str), "UPS: %8.4f, FPS: %8.4f", avgUPS, avgFPS);
+  char str[1024];
+  snprintf(str, sizeof(str), "UPS: %8.4f, FPS: %8.4f%s%s", avgUPS, avgFPS,
+      stats ? "\n" : "", stats ? stats : "");
 
   LG_FontBitmap *textSurface = NULL;
   if (!(textSurface = this->font->render(this->fontObj, 0xffffff00, str)))
@@ -903,6 +1051,159 @@ static bool _check_gl_error(unsigned int line, const char * name)
   return true;
 }
 
+static void pool_delete(struct PoolEntry * entry)
+{
+  if (entry->isBuffer)
+  {
+    /* deleting the buffer also unmaps it, pinned memory is only freed after */
+    if (entry->name)
+      glDeleteBuffers(1, &entry->name);
+    free(entry->pixels);
+  }
+  else
+    glDeleteTextures(1, &entry->name);
+}
+
+/* evict the least recently used objects until the pool fits the budget */
+static void pool_trim(struct Inst * this, size_t budget)
+{
+  while(this->poolCount &&
+      (this->poolSize > budget || this->poolCount == POOL_MAX))
+  {
+    int lru = 0;
+    for(int i = 1; i < this->poolCount; ++i)
+      if (this->pool[i].used < this->pool[lru].used)
+        lru = i;
+
+    pool_delete(&this->pool[lru]);
+    this->poolSize -= this->pool[lru].size;
+    this->pool[lru] = this->pool[--this->poolCount];
+  }
+}
+
+static void pool_put(struct Inst * this, const struct PoolEntry * entry)
+{
+  pool_trim(this, SIZE_MAX);
+
+  struct PoolEntry * e = &this->pool[this->poolCount++];
+  memcpy(e, entry, sizeof(*e));
+  e->used = ++this->poolClock;
+  this->poolSize += e->size;
+}
+
+/* take an object matching the current format from the pool */
+static bool pool_take(struct Inst * this, bool isBuffer,
+    struct PoolEntry * entry)
+{
+  for(int i = 0; i < this->poolCount; ++i)
+  {
+    struct PoolEntry * e = &this->pool[i];
+    if (e->isBuffer != isBuffer || e->size != this->texSize)
+      continue;
+
+    if (!isBuffer && (
+        e->width     != this->format.width  ||
+        e->height    != this->format.height ||
+        e->intFormat != this->intFormat))
+      continue;
+
+    memcpy(entry, e, sizeof(*entry));
+    this->poolSize -= e->size;
+    *e = this->pool[--this->poolCount];
+    return true;
+  }
+
+  return false;
+}
+
+/* create the buffers the frame thread copies frames into */
+static bool configure_buffers(struct Inst * this)
+{
+  const int pagesize = getpagesize();
+  for(int i = 0; i < PBO_COUNT; ++i)
+  {
+    struct PoolEntry entry;
+    if (pool_take(this, true, &entry))
+    {
+      this->vboID[i]     = entry.name;
+      this->texPixels[i] = entry.pixels;
+      this->pboMap[i]    = entry.map;
+      continue;
+    }
+
+    if (this->amdPinnedMemSupport)
+    {
+      this->texPixels[i] = aligned_alloc(pagesize, this->texSize);
+      if (!this->texPixels[i])
+      {
+        DEBUG_ERROR("Failed to allocate memory for texture");
+        return false;
+      }
+
+      memset(this->texPixels[i], 0, this->texSize);
+
+      glGenBuffers(1, &this->vboID[i]);
+      if (check_gl_error("glGenBuffers"))
+        return false;
+
+      glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, this->vboID[i]);
+      if (check_gl_error("glBindBuffer"))
+        return false;
+
+      glBufferData(
+        GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD,
+        this->texSize,
+        this->texPixels[i],
+        GL_STREAM_DRAW
+      );
+
+      if (check_gl_error("glBufferData"))
+        return false;
+
+      glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, 0);
+      this->pboMap[i] = this->texPixels[i];
+    }
+    else if (this->hasBufferStorage)
+    {
+      const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+      glGenBuffers(1, &this->vboID[i]);
+      if (check_gl_error("glGenBuffers"))
+        return false;
+
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->vboID[i]);
+      if (check_gl_error("glBindBuffer"))
+        return false;
+
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, this->texSize, NULL, flags);
+      if (check_gl_error("glBufferStorage"))
+        return false;
+
+      this->pboMap[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+          this->texSize, flags);
+      if (check_gl_error("glMapBufferRange") || !this->pboMap[i])
+        return false;
+
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    else
+    {
+      /* uploaded straight from system memory, the driver copies it before
+       * glTexSubImage2D returns so no fence is needed */
+      this->texPixels[i] = aligned_alloc(pagesize, this->texSize);
+      if (!this->texPixels[i])
+      {
+        DEBUG_ERROR("Failed to allocate memory for texture");
+        return false;
+      }
+      this->pboMap[i] = this->texPixels[i];
+    }
+  }
+
+  return true;
+}
+
 static enum ConfigStatus configure(struct Inst * this)
 {
   LG_LOCK(this->formatLock);
@@ -915,6 +1216,8 @@ static enum ConfigStatus configure(struct Inst * this)
   if (this->configured)
     deconfigure(this);
 
+  pool_trim(this, this->opt.poolSize);
+
   switch(this->format.type)
   {
     case FRAME_TYPE_BGRA:
@@ -943,95 +1246,37 @@ static enum ConfigStatus configure(struct Inst * this)
 
     default:
       DEBUG_ERROR("Unknown/unsupported compression type");
+      LG_UNLOCK(this->formatLock);
       return CONFIG_STATUS_ERROR;
   }
 
   // calculate the texture size in bytes
   this->texSize = this->format.height * this->format.pitch;
-  this->texPos  = 0;
 
-  glGenBuffers(BUFFER_COUNT, this->vboID);
-  if (check_gl_error("glGenBuffers"))
+  if (!configure_buffers(this))
   {
     LG_UNLOCK(this->formatLock);
-    return false;
+    return CONFIG_STATUS_ERROR;
   }
-  this->hasBuffers = true;
-
-  if (this->amdPinnedMemSupport)
-  {
-    const int pagesize = getpagesize();
 
-    for(int i = 0; i < BUFFER_COUNT; ++i)
-    {
-      this->texPixels[i] = aligned_alloc(pagesize, this->texSize);
-      if (!this->texPixels[i])
-      {
-        DEBUG_ERROR("Failed to allocate memory for texture");
-        return CONFIG_STATUS_ERROR;
-      }
-
-      memset(this->texPixels[i], 0, this->texSize);
-
-      glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, this->vboID[i]);
-      if (check_gl_error("glBindBuffer"))
-      {
-        LG_UNLOCK(this->formatLock);
-        return CONFIG_STATUS_ERROR;
-      }
-
-      glBufferData(
-        GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD,
-        this->texSize,
-        this->texPixels[i],
-        GL_STREAM_DRAW
-      );
-
-      if (check_gl_error("glBufferData"))
-      {
-        LG_UNLOCK(this->formatLock);
-        return CONFIG_STATUS_ERROR;
-      }
-    }
-    glBindBuffer(GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD, 0);
-  }
-  else
+  // create the frame textures
+  this->hasFrames = true;
+  for(int i = 0; i < BUFFER_COUNT; ++i)
   {
-    for(int i = 0; i < BUFFER_COUNT; ++i)
+    struct PoolEntry entry;
+    const bool pooled = pool_take(this, false, &entry);
+    if (pooled)
+      this->frames[i] = entry.name;
+    else
     {
-      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->vboID[i]);
-      if (check_gl_error("glBindBuffer"))
-      {
-        LG_UNLOCK(this->formatLock);
-        return CONFIG_STATUS_ERROR;
-      }
-
-      glBufferData(
-        GL_PIXEL_UNPACK_BUFFER,
-        this->texSize,
-        NULL,
-        GL_STREAM_DRAW
-      );
-      if (check_gl_error("glBufferData"))
+      glGenTextures(1, &this->frames[i]);
+      if (check_gl_error("glGenTextures"))
       {
         LG_UNLOCK(this->formatLock);
         return CONFIG_STATUS_ERROR;
       }
     }
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-  }
-
-  // create the frame textures
-  glGenTextures(BUFFER_COUNT, this->frames);
-  if (check_gl_error("glGenTextures"))
-  {
-    LG_UNLOCK(this->formatLock);
-    return CONFIG_STATUS_ERROR;
-  }
-  this->hasFrames = true;
 
-  for(int i = 0; i < BUFFER_COUNT; ++i)
-  {
     // bind and create the new texture
     glBindTexture(GL_TEXTURE_2D, this->frames[i]);
     if (check_gl_error("glBindTexture"))
@@ -1040,21 +1285,24 @@ static enum ConfigStatus configure(struct Inst * this)
       return CONFIG_STATUS_ERROR;
     }
 
-    glTexImage2D(
-      GL_TEXTURE_2D,
-      0,
-      this->intFormat,
-      this->format.width,
-      this->format.height,
-      0,
-      this->vboFormat,
-      this->dataFormat,
-      (void*)0
-    );
-    if (check_gl_error("glTexImage2D"))
+    if (!pooled)
     {
-      LG_UNLOCK(this->formatLock);
-      return CONFIG_STATUS_ERROR;
+      glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        this->intFormat,
+        this->format.width,
+        this->format.height,
+        0,
+        this->vboFormat,
+        this->dataFormat,
+        (void*)0
+      );
+      if (check_gl_error("glTexImage2D"))
+      {
+        LG_UNLOCK(this->formatLock);
+        return CONFIG_STATUS_ERROR;
+      }
     }
 
     // configure the texture
@@ -1083,6 +1331,15 @@ static enum ConfigStatus configure(struct Inst * this)
   this->drawStart   = nanotime();
   this->configured  = true;
   this->reconfigure = false;
+  this->texReady    = false;
+
+  /* let the frame thread start copying into the new buffers, formatLock is
+   * held so reconfigure can not have been set again since the check above */
+  memcpy(&this->pboFormat, &this->format, sizeof(LG_RendererFormat));
+  atomic_store_explicit(&this->pboWrite  , 0, memory_order_relaxed);
+  atomic_store_explicit(&this->pboRelease, 0, memory_order_relaxed);
+  this->pboUpload = 0;
+  atomic_store_explicit(&this->buffersReady, true, memory_order_release);
 
   LG_UNLOCK(this->formatLock);
   return CONFIG_STATUS_OK;
@@ -1099,34 +1356,55 @@ static void deconfigure(struct Inst * this)
     this->hasTextures = false;
   }
 
+  /* the storage is kept in the pool as a resolution or mode change is often
+   * followed by a change back, pboFormat still describes it */
   if (this->hasFrames)
   {
-    glDeleteTextures(BUFFER_COUNT, this->frames);
+    for(int i = 0; i < BUFFER_COUNT; ++i)
+      pool_put(this, &(struct PoolEntry)
+      {
+        .name      = this->frames[i],
+        .size      = this->texSize,
+        .width     = this->pboFormat.width,
+        .height    = this->pboFormat.height,
+        .intFormat = this->intFormat
+      });
     this->hasFrames = false;
   }
 
-  if (this->hasBuffers)
-  {
-    glDeleteBuffers(BUFFER_COUNT, this->vboID);
-    this->hasBuffers = false;
-  }
+  atomic_store_explicit(&this->buffersReady, false, memory_order_release);
 
-  if (this->amdPinnedMemSupport)
-  {
-    for(int i = 0; i < BUFFER_COUNT; ++i)
+  /* a pooled buffer is written as soon as it is taken again, so the uploads
+   * still reading from them must finish first */
+  bool pending = false;
+  for(int i = 0; i < PBO_COUNT; ++i)
+    if (this->fences[i])
     {
-      if (this->fences[i])
-      {
-        glDeleteSync(this->fences[i]);
-        this->fences[i] = NULL;
-      }
-
-      if (this->texPixels[i])
-      {
-        free(this->texPixels[i]);
-        this->texPixels[i] = NULL;
-      }
+      glDeleteSync(this->fences[i]);
+      this->fences[i] = NULL;
+      pending = true;
     }
+
+  if (pending)
+    glFinish();
+
+  for(int i = 0; i < PBO_COUNT; ++i)
+  {
+    if (!this->pboMap[i])
+      continue;
+
+    pool_put(this, &(struct PoolEntry)
+    {
+      .isBuffer = true,
+      .name     = this->vboID[i],
+      .pixels   = this->texPixels[i],
+      .map      = this->pboMap[i],
+      .size     = this->texSize
+    });
+
+    this->vboID[i]     = 0;
+    this->texPixels[i] = NULL;
+    this->pboMap[i]    = NULL;
   }
 
   this->configured = false;
@@ -1145,22 +1423,14 @@ static void update_mouse_shape(struct Inst * this, bool * newShape)
   const LG_RendererCursor cursor = this->mouseCursor;
   const int               width  = this->mouseWidth;
   const int               height = this->mouseHeight;
-  const int               pitch  = this->mousePitch;
-  const uint8_t *         data   = this->mouseData;
-
-  // tmp buffer for masked colour
-  uint32_t tmp[width * height];
+  const uint32_t *        data   = this->mouseData;
 
+  // the shape was already converted on the cursor thread by
+  // opengl_on_mouse_shape, all that is left to do here is upload it
   this->mouseType = cursor;
   switch(cursor)
   {
     case LG_CURSOR_MASKED_COLOR:
-      for(int i = 0; i < width * height; ++i)
-      {
-        const uint32_t c = ((uint32_t *)data)[i];
-        tmp[i] = (c & ~0xFF000000) | (c & 0xFF000000 ? 0x0 : 0xFF000000);
-      }
-      data = (uint8_t *)tmp;
       // fall through to LG_CURSOR_COLOR
       //
       // technically we should also create an XOR texture from the data but this
@@ -1211,19 +1481,6 @@ static void update_mouse_shape(struct Inst * this, bool * newShape)
     case LG_CURSOR_MONOCHROME:
     {
       const int hheight = height / 2;
-      uint32_t d[width * height];
-      for(int y = 0; y < hheight; ++y)
-        for(int x = 0; x < width; ++x)
-        {
-          const uint8_t  * srcAnd  = data + (pitch * y) + (x / 8);
-          const uint8_t  * srcXor  = srcAnd + pitch * hheight;
-          const uint8_t    mask    = 0x80 >> (x % 8);
-          const uint32_t   andMask = (*srcAnd & mask) ? 0xFFFFFFFF : 0xFF000000;
-          const uint32_t   xorMask = (*srcXor & mask) ? 0x00FFFFFF : 0x00000000;
-
-          d[y * width + x                  ] = andMask;
-          d[y * width + x + width * hheight] = xorMask;
-        }
 
       glBindTexture(GL_TEXTURE_2D, this->textures[MOUSE_TEXTURE]);
       glPixelStorei(GL_UNPACK_ALIGNMENT , 4    );
@@ -1238,7 +1495,7 @@ static void update_mouse_shape(struct Inst * this, bool * newShape)
         0      ,
         GL_RGBA,
         GL_UNSIGNED_BYTE,
-        d
+        data
       );
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -1277,82 +1534,50 @@ static void update_mouse_shape(struct Inst * this, bool * newShape)
   LG_UNLOCK(this->mouseLock);
 }
 
-static bool opengl_buffer_fn(void * opaque, const void * data, size_t size)
-{
-  struct Inst * this = (struct Inst *)opaque;
-
-  // update the buffer, this performs a DMA transfer if possible
-  glBufferSubData(
-    GL_PIXEL_UNPACK_BUFFER,
-    this->texPos,
-    size,
-    data
-  );
-  check_gl_error("glBufferSubData");
-
-  this->texPos += size;
-  return true;
-}
-
 static bool draw_frame(struct Inst * this)
 {
-  LG_LOCK(this->syncLock);
-  if (!this->frameUpdate)
-  {
-    LG_UNLOCK(this->syncLock);
+  if (!this->configured)
     return true;
-  }
 
-  if (++this->texIndex == BUFFER_COUNT)
-    this->texIndex = 0;
+  /* give the buffers the GPU has finished reading back to the frame thread,
+   * the fences are only polled so this never blocks */
+  uint8_t sr = atomic_load_explicit(&this->pboRelease, memory_order_relaxed);
+  for(; sr != this->pboUpload; ++sr)
+  {
+    GLsync * fence = &this->fences[sr % PBO_COUNT];
+    if (!*fence)
+      continue;
 
-  this->frameUpdate = false;
-  LG_UNLOCK(this->syncLock);
+    if (glClientWaitSync(*fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      break;
 
-  LG_LOCK(this->formatLock);
-  if (glIsSync(this->fences[this->texIndex]))
-  {
-    switch(glClientWaitSync(this->fences[this->texIndex], 0, GL_TIMEOUT_IGNORED))
-    {
-      case GL_ALREADY_SIGNALED:
-        break;
+    glDeleteSync(*fence);
+    *fence = NULL;
+  }
+  atomic_store_explicit(&this->pboRelease, sr, memory_order_release);
 
-      case GL_CONDITION_SATISFIED:
-        DEBUG_WARN("Had to wait for the sync");
-        break;
+  const uint8_t sw = atomic_load_explicit(&this->pboWrite, memory_order_acquire);
+  if (sw == this->pboUpload)
+    return true;
 
-      case GL_TIMEOUT_EXPIRED:
-        DEBUG_WARN("Timeout expired, DMA transfers are too slow!");
-        break;
+  /* only the newest frame is shown, any older ones are released unread */
+  const int b = (uint8_t)(sw - 1) % PBO_COUNT;
+  this->pboUpload = sw;
 
-      case GL_WAIT_FAILED:
-        DEBUG_ERROR("Wait failed %d", glGetError());
-        break;
-    }
+  if (++this->texIndex == BUFFER_COUNT)
+    this->texIndex = 0;
 
-    glDeleteSync(this->fences[this->texIndex]);
-    this->fences[this->texIndex] = NULL;
-  }
+  LG_LOCK(this->formatLock);
+  const bool hasPBO = this->amdPinnedMemSupport || this->hasBufferStorage;
 
   glBindTexture(GL_TEXTURE_2D, this->frames[this->texIndex]);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->vboID[this->texIndex]);
+  if (hasPBO)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->vboID[b]);
 
   const int bpp = this->format.bpp / 8;
   glPixelStorei(GL_UNPACK_ALIGNMENT , bpp);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, this->format.width);
 
-  this->texPos = 0;
-
-  framebuffer_read_fn(
-    this->frame,
-    this->format.height,
-    this->format.width,
-    bpp,
-    this->format.pitch,
-    opengl_buffer_fn,
-    this
-  );
-
   // update the texture
   glTexSubImage2D(
     GL_TEXTURE_2D,
@@ -1363,7 +1588,7 @@ static bool draw_frame(struct Inst * this)
     this->format.height,
     this->vboFormat,
     this->dataFormat,
-    (void*)0
+    hasPBO ? (void*)0 : this->pboMap[b]
   );
   if (check_gl_error("glTexSubImage2D"))
   {
@@ -1371,13 +1596,17 @@ static bool draw_frame(struct Inst * this)
       this->texIndex, this->format.width, this->format.height, this->vboFormat, this->texSize
     );
   }
+  else
+    app_frameUploaded();
 
-  // set a fence so we don't overwrite a buffer in use
-  this->fences[this->texIndex] =
-    glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  if (hasPBO)
+  {
+    // set a fence so the frame thread doesn't overwrite a buffer in use
+    this->fences[b] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-  // unbind the buffer
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // unbind the buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
 
   const bool mipmap = this->opt.mipmap && (
     (this->format.width  > this->destRect.w) ||
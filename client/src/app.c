@@ -26,6 +26,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "ll.h"
 #include "kb.h"
+#include "latency.h"
 
 #include "common/debug.h"
 #include "common/stringutils.h"
@@ -434,6 +435,26 @@ void app_handleRenderEvent(const uint64_t timeUs)
   }
 }
 
+void app_invalidateWindow(bool full)
+{
+  if (full)
+    atomic_store(&g_state.invalidateWindow, true);
+  main_wakeRender();
+}
+
+void app_frameUploaded(void)
+{
+  /* several frames can be coalesced into one upload, only report it once */
+  const uint64_t available = atomic_exchange_explicit(
+      &g_state.latencyAvailable, 0, memory_order_acquire);
+  if (!available)
+    return;
+
+  const uint64_t uploaded = microtime();
+  latency_record(LATENCY_UPLOAD, uploaded - available);
+  atomic_store_explicit(&g_state.latencyUpload, uploaded, memory_order_release);
+}
+
 void app_setFullscreen(bool fs)
 {
   g_state.ds->setFullscreen(fs);
@@ -24,6 +24,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/option.h"
 #include "common/debug.h"
 #include "common/stringutils.h"
+#include "common/sysinfo.h"
 
 #include <sys/stat.h>
 #include <pwd.h>
@@ -43,9 +44,13 @@ static char *     optSizeToString    (struct Option * opt);
 static bool       optScancodeValidate(struct Option * opt, const char ** error);
 static char *     optScancodeToString(struct Option * opt);
 static bool       optRotateValidate  (struct Option * opt, const char ** error);
+static bool       optCopyThreadsValidate(struct Option * opt, const char ** error);
+static bool       optExitAfterFramesValidate(struct Option * opt, const char ** error);
 
 static void doLicense();
 
+static char * defaultLatencyFile = NULL;
+
 static struct Option options[] =
 {
   // app options
@@ -89,6 +94,36 @@ static struct Option options[] =
     .type          = OPTION_TYPE_INT,
     .value.x_int   = 1000
   },
+  {
+    .module        = "app",
+    .name          = "latestFrameOnly",
+    .description   = "Skip to the newest frame when falling behind instead of processing every queued frame",
+    .type          = OPTION_TYPE_BOOL,
+    .value.x_bool  = true
+  },
+  {
+    .module        = "app",
+    .name          = "copyThreads",
+    .description   = "The number of threads used to copy each frame (0 = auto)",
+    .type          = OPTION_TYPE_INT,
+    .validator     = optCopyThreadsValidate,
+    .value.x_int   = 0
+  },
+  {
+    .module         = "app",
+    .name           = "latencyFile",
+    .description    = "Latency statistics file (default: $XDG_RUNTIME_DIR/looking-glass-latency-<pid>.txt)",
+    .type           = OPTION_TYPE_STRING,
+    .value.x_string = NULL
+  },
+  {
+    .module        = "app",
+    .name          = "exitAfterFrames",
+    .description   = "Exit after this many frames and write the latency statistics (0 = disabled)",
+    .type          = OPTION_TYPE_INT,
+    .validator     = optExitAfterFramesValidate,
+    .value.x_int   = 0
+  },
   {
     .module        = "app",
     .name          = "allowDMA",
@@ -207,6 +242,20 @@ static struct Option options[] =
     .type           = OPTION_TYPE_INT,
     .value.x_int    = -1,
   },
+  {
+    .module         = "win",
+    .name           = "jitRender",
+    .description    = "Render just before the next vsync to reduce latency (needs vsync)",
+    .type           = OPTION_TYPE_BOOL,
+    .value.x_bool   = false,
+  },
+  {
+    .module         = "win",
+    .name           = "jitRenderMargin",
+    .description    = "Safety margin in microseconds before the vsync deadline",
+    .type           = OPTION_TYPE_INT,
+    .value.x_int    = 1000,
+  },
   {
     .module         = "win",
     .name           = "showFPS",
@@ -338,6 +387,13 @@ static struct Option options[] =
     .type           = OPTION_TYPE_BOOL,
     .value.x_bool   = true,
   },
+  {
+    .module         = "input",
+    .name           = "hwCursor",
+    .description    = "Use the display server's cursor for the guest cursor when not captured",
+    .type           = OPTION_TYPE_BOOL,
+    .value.x_bool   = false,
+  },
   {
     .module         = "input",
     .name           = "autoCapture",
@@ -506,8 +562,25 @@ bool config_load(int argc, char * argv[])
   // setup the application params for the basic types
   g_params.cursorPollInterval = option_get_int   ("app"  , "cursorPollInterval");
   g_params.framePollInterval  = option_get_int   ("app"  , "framePollInterval" );
+  g_params.latestFrameOnly    = option_get_bool  ("app"  , "latestFrameOnly"   );
+  g_params.copyThreads        = option_get_int   ("app"  , "copyThreads"       );
+  g_params.latencyFile        = option_get_string("app"  , "latencyFile"       );
+  g_params.exitAfterFrames    = option_get_int   ("app"  , "exitAfterFrames"   );
   g_params.allowDMA           = option_get_bool  ("app"  , "allowDMA"          );
 
+  if (!g_params.latencyFile)
+  {
+    /* /tmp is shared with every other user, keep the statistics somewhere
+     * private and give each client its own file */
+    const char * dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir || !*dir)
+      dir = pw->pw_dir;
+
+    alloc_sprintf(&defaultLatencyFile, "%s/looking-glass-latency-%d.txt",
+        dir, (int)getpid());
+    g_params.latencyFile = defaultLatencyFile;
+  }
+
   g_params.windowTitle     = option_get_string("win", "title"          );
   g_params.autoResize      = option_get_bool  ("win", "autoResize"     );
   g_params.allowResize     = option_get_bool  ("win", "allowResize"    );
@@ -519,6 +592,10 @@ bool config_load(int argc, char * argv[])
   g_params.fullscreen      = option_get_bool  ("win", "fullScreen"     );
   g_params.maximize        = option_get_bool  ("win", "maximize"       );
   g_params.fpsMin          = option_get_int   ("win", "fpsMin"         );
+  g_params.jitRender       = option_get_bool  ("win", "jitRender"      );
+  g_params.jitRenderMargin = option_get_int   ("win", "jitRenderMargin");
+  if (g_params.jitRenderMargin < 0)
+    g_params.jitRenderMargin = 0;
   g_params.showFPS         = option_get_bool  ("win", "showFPS"        );
   g_params.ignoreQuit      = option_get_bool  ("win", "ignoreQuit"     );
   g_params.noScreensaver   = option_get_bool  ("win", "noScreensaver"  );
@@ -551,6 +628,7 @@ bool config_load(int argc, char * argv[])
   g_params.mouseSmoothing         = option_get_bool("input", "mouseSmoothing"        );
   g_params.rawMouse               = option_get_bool("input", "rawMouse"              );
   g_params.mouseRedraw            = option_get_bool("input", "mouseRedraw"           );
+  g_params.hwCursor               = option_get_bool("input", "hwCursor"              );
   g_params.autoCapture            = option_get_bool("input", "autoCapture"           );
   g_params.captureInputOnly       = option_get_bool("input", "captureOnly"           );
 
@@ -587,6 +665,8 @@ bool config_load(int argc, char * argv[])
 void config_free(void)
 {
   option_free();
+  free(defaultLatencyFile);
+  defaultLatencyFile = NULL;
 }
 
 static void doLicense(void)
@@ -759,3 +839,31 @@ static bool optRotateValidate(struct Option * opt, const char ** error)
   *error = "Rotation angle must be one of 0, 90, 180 or 270";
   return false;
 }
+
+static bool optExitAfterFramesValidate(struct Option * opt, const char ** error)
+{
+  if (opt->value.x_int >= 0)
+    return true;
+
+  *error = "The frame count can not be negative";
+  return false;
+}
+
+static bool optCopyThreadsValidate(struct Option * opt, const char ** error)
+{
+  if (opt->value.x_int < 0)
+  {
+    *error = "The thread count can not be negative";
+    return false;
+  }
+
+  // more threads than CPUs can only slow the copy down
+  const int cpus = sysinfo_getCPUCount();
+  if (opt->value.x_int > cpus)
+  {
+    DEBUG_WARN("app:copyThreads limited to the %d available CPUs", cpus);
+    opt->value.x_int = cpus;
+  }
+
+  return true;
+}
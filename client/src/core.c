@@ -24,9 +24,11 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "common/time.h"
 #include "common/debug.h"
+#include "common/cursor.h"
 
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
 
 #define RESIZE_TIMEOUT (10 * 1000) // 10ms
 
@@ -85,6 +87,7 @@ void core_setCursorInView(bool enable)
   }
 
   g_cursor.warpState = WARP_STATE_ON;
+  core_updateGuestPointer();
 }
 
 void core_setGrab(bool enable)
@@ -141,6 +144,8 @@ void core_setGrabQuiet(bool enable)
     if (g_params.captureInputOnly || !g_params.hideMouse)
       core_alignToGuest();
   }
+
+  core_updateGuestPointer();
 }
 
 bool core_warpPointer(int x, int y, bool exiting)
@@ -274,6 +279,7 @@ void core_updatePositionInfo(void)
 
 done:
   atomic_fetch_add(&g_state.lgrResize, 1);
+  app_invalidateWindow(true);
 }
 
 void core_alignToGuest(void)
@@ -523,3 +529,131 @@ void core_handleMouseNormal(double ex, double ey)
   if (!spice_mouse_motion(x, y))
     DEBUG_ERROR("failed to send mouse motion message");
 }
+
+static void premultiplyPointer(uint32_t * pixels, int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const uint32_t p = pixels[i];
+    const uint32_t a = p >> 24;
+    if (a == 0xFF)
+      continue;
+
+    pixels[i] =
+      (a << 24) |
+      ((((p >> 16) & 0xFF) * a / 0xFF) << 16) |
+      ((((p >>  8) & 0xFF) * a / 0xFF) <<  8) |
+      ((((p      ) & 0xFF) * a / 0xFF)      );
+  }
+}
+
+/* merge the AND & XOR masks, inverted pixels can not be shown by the display
+ * server so they are drawn black */
+static void mergeMonoPointer(uint32_t * pixels, int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const uint32_t and = pixels[i];
+    const uint32_t xor = pixels[i + count];
+    if (and == 0xFFFFFFFF)
+      pixels[i] = xor ? 0xFF000000 : 0x00000000;
+    else
+      pixels[i] = 0xFF000000 | xor;
+  }
+}
+
+void core_setGuestPointerShape(LG_RendererCursor type, int width, int height,
+    int pitch, int hx, int hy, const uint8_t * data)
+{
+  if (!g_params.hwCursor || !g_state.ds->setGuestPointer)
+    return;
+
+  const int    rows = type == LG_CURSOR_MONOCHROME ? height / 2 : height;
+  const size_t size = (size_t)width * height * sizeof(uint32_t);
+
+  lgLockMutex(g_cursor.dsLock);
+  g_cursor.dsValid   = false;
+  g_cursor.dsChanged = true;
+
+  if (width <= 0 || rows <= 0)
+    goto done;
+
+  if (g_cursor.dsPixelsSize < size)
+  {
+    uint32_t * pixels = realloc(g_cursor.dsPixels, size);
+    if (!pixels)
+    {
+      DEBUG_ERROR("Failed to allocate memory for the guest cursor");
+      goto done;
+    }
+
+    g_cursor.dsPixels     = pixels;
+    g_cursor.dsPixelsSize = size;
+  }
+
+  switch(type)
+  {
+    case LG_CURSOR_COLOR:
+      cursor_convert_color(g_cursor.dsPixels, data, width, height, pitch);
+      premultiplyPointer(g_cursor.dsPixels, width * rows);
+      break;
+
+    case LG_CURSOR_MASKED_COLOR:
+      cursor_convert_masked(g_cursor.dsPixels, data, width, height, pitch);
+      premultiplyPointer(g_cursor.dsPixels, width * rows);
+      break;
+
+    case LG_CURSOR_MONOCHROME:
+      cursor_convert_mono(g_cursor.dsPixels, data, width, height, pitch);
+      mergeMonoPointer(g_cursor.dsPixels, width * rows);
+      break;
+  }
+
+  g_cursor.dsShape = (LG_DSPointerShape)
+  {
+    .width  = width,
+    .height = rows,
+    .hx     = util_clamp(hx, 0, width - 1),
+    .hy     = util_clamp(hy, 0, rows  - 1),
+    .pixels = g_cursor.dsPixels
+  };
+  g_cursor.dsValid = true;
+
+done:
+  lgUnlockMutex(g_cursor.dsLock);
+  core_updateGuestPointer();
+}
+
+void core_updateGuestPointer(void)
+{
+  if (!g_params.hwCursor || !g_state.ds->setGuestPointer)
+    return;
+
+  lgLockMutex(g_cursor.dsLock);
+
+  /* the display server draws the cursor at the local pointer's position which
+   * only follows the guest's cursor while it is in view and not captured */
+  const bool use = g_cursor.dsValid && g_cursor.guest.visible &&
+    g_cursor.inView && !g_cursor.grab && core_inputEnabled();
+
+  if (use != atomic_load(&g_cursor.dsCursor) || (use && g_cursor.dsChanged))
+  {
+    bool active = false;
+    if (use)
+    {
+      active = g_state.ds->setGuestPointer(&g_cursor.dsShape);
+      if (!active)
+        g_state.ds->setGuestPointer(NULL);
+    }
+    else
+      g_state.ds->setGuestPointer(NULL);
+
+    g_cursor.dsChanged = false;
+    atomic_store(&g_cursor.dsCursor, active);
+
+    /* have the renderer show or hide its copy of the cursor */
+    g_cursor.redraw = true;
+  }
+
+  lgUnlockMutex(g_cursor.dsLock);
+}
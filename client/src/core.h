@@ -21,6 +21,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #define _H_LG_CORE_
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "interface/renderer.h"
 
 bool core_inputEnabled(void);
 void core_setCursorInView(bool enable);
@@ -35,6 +38,9 @@ void core_stopFrameThread(void);
 void core_handleGuestMouseUpdate(void);
 void core_handleMouseGrabbed(double ex, double ey);
 void core_handleMouseNormal(double ex, double ey);
+void core_setGuestPointerShape(LG_RendererCursor type, int width, int height,
+    int pitch, int hx, int hy, const uint8_t * data);
+void core_updateGuestPointer(void);
 
 
 #endif
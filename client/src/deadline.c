@@ -0,0 +1,179 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "deadline.h"
+
+#include "common/debug.h"
+#include "common/time.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+
+// the number of consistent intervals needed before the period is trusted
+#define PERIOD_SAMPLES 8
+
+struct Deadline
+{
+  bool     enabled;
+  uint64_t margin;
+
+  uint64_t period;
+  unsigned periodSamples;
+  uint64_t lastPresent;
+
+  // how long before the vblank rendering is started
+  uint64_t lead;
+
+  // the vblank the current render is aiming for and if it started on time
+  uint64_t target;
+  bool     scheduled;
+
+  uint64_t hit, missed;
+};
+
+static struct Deadline d = { 0 };
+
+void deadline_init(bool enabled, unsigned int margin)
+{
+  d.enabled       = enabled;
+  d.margin        = margin;
+  d.period        = 0;
+  d.periodSamples = 0;
+  d.lastPresent   = 0;
+  d.lead          = 0;
+  d.target        = 0;
+  d.scheduled     = false;
+  d.hit           = 0;
+  d.missed        = 0;
+}
+
+static inline void clampLead(void)
+{
+  const uint64_t max = d.period * 3 / 4;
+  if (d.lead < d.margin)
+    d.lead = d.margin;
+  if (d.lead > max)
+    d.lead = max;
+}
+
+static void sleepUntil(uint64_t time)
+{
+  const struct timespec ts =
+  {
+    .tv_sec  = time / 1000000ULL,
+    .tv_nsec = (time % 1000000ULL) * 1000ULL
+  };
+
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+void deadline_wait(void)
+{
+  d.target    = 0;
+  d.scheduled = false;
+
+  if (!d.enabled || d.periodSamples < PERIOD_SAMPLES)
+    return;
+
+  const uint64_t now  = microtime();
+  uint64_t       next = d.lastPresent + d.period;
+  if (next <= now)
+    next += ((now - next) / d.period + 1) * d.period;
+
+  d.target = next;
+
+  /* if we are already inside the lead time render immediately, it may still
+   * make the vblank but the result says nothing about the lead time */
+  const uint64_t start = next - d.lead;
+  if (start <= now)
+    return;
+
+  sleepUntil(start);
+  d.scheduled = true;
+}
+
+void deadline_presented(void)
+{
+  if (!d.enabled)
+    return;
+
+  const uint64_t now = microtime();
+
+  /* with vsync the present returns on a vblank, track the interval between
+   * them. Longer intervals are missed or idle vblanks and are ignored. */
+  if (d.lastPresent)
+  {
+    const uint64_t interval = now - d.lastPresent;
+    if (!d.period || interval < d.period * 3 / 4)
+    {
+      d.period        = interval;
+      d.periodSamples = 0;
+      d.lead          = interval / 2;
+    }
+    else if (interval <= d.period * 5 / 4)
+    {
+      d.period = (d.period * 15 + interval) / 16;
+      if (d.periodSamples < PERIOD_SAMPLES)
+        ++d.periodSamples;
+    }
+    clampLead();
+  }
+  d.lastPresent = now;
+
+  if (!d.target)
+    return;
+
+  /* the render and present cost can't be measured directly as the swap blocks
+   * until the vblank, instead adapt the lead time from the outcome. Back off
+   * quickly on a miss and creep back towards the deadline while we hit it. */
+  if (now > d.target + d.period / 2)
+  {
+    ++d.missed;
+    if (d.scheduled)
+      d.lead += d.period / 4;
+  }
+  else
+  {
+    ++d.hit;
+    if (d.scheduled)
+      d.lead -= d.lead / 32;
+  }
+  clampLead();
+}
+
+bool deadline_format(char * buffer, size_t size)
+{
+  if (!d.enabled)
+    return false;
+
+  snprintf(buffer, size,
+      "deadline : lead %5.2f ms, period %5.2f ms, missed %" PRIu64 "/%" PRIu64,
+      d.lead / 1000.0, d.period / 1000.0, d.missed, d.hit + d.missed);
+  return true;
+}
+
+void deadline_report(void)
+{
+  if (!d.enabled)
+    return;
+
+  DEBUG_INFO("Render deadlines hit: %" PRIu64 ", missed: %" PRIu64,
+      d.hit, d.missed);
+}
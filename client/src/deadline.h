@@ -0,0 +1,55 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _H_LG_DEADLINE_
+#define _H_LG_DEADLINE_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Reset the scheduler, margin is the safety margin in microseconds kept
+ * between the end of rendering and the predicted vblank
+ */
+void deadline_init(bool enabled, unsigned int margin);
+
+/**
+ * Sleep until just before the next predicted vblank, call this immediately
+ * before rendering
+ */
+void deadline_wait(void);
+
+/**
+ * Record that the renderer has presented, call this as soon as the render
+ * call has returned
+ */
+void deadline_presented(void);
+
+/**
+ * Format the scheduler state and missed deadline count for the overlay,
+ * returns false if the scheduler is not enabled
+ */
+bool deadline_format(char * buffer, size_t size);
+
+/**
+ * Log the total hit and missed deadlines
+ */
+void deadline_report(void);
+
+#endif
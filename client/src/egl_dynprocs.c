@@ -35,6 +35,29 @@ void egl_dynProcsInit(void)
     eglGetProcAddress("eglSwapBuffersWithDamageKHR");
   g_egl_dynProcs.eglSwapBuffersWithDamageEXT = (eglSwapBuffersWithDamageKHR_t)
     eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+  g_egl_dynProcs.eglSetDamageRegionKHR = (eglSetDamageRegionKHR_t)
+    eglGetProcAddress("eglSetDamageRegionKHR");
+  g_egl_dynProcs.glCopyImageSubData = (glCopyImageSubData_t)
+    eglGetProcAddress("glCopyImageSubData");
+  if (!g_egl_dynProcs.glCopyImageSubData)
+    g_egl_dynProcs.glCopyImageSubData = (glCopyImageSubData_t)
+      eglGetProcAddress("glCopyImageSubDataEXT");
+  if (!g_egl_dynProcs.glCopyImageSubData)
+    g_egl_dynProcs.glCopyImageSubData = (glCopyImageSubData_t)
+      eglGetProcAddress("glCopyImageSubDataOES");
+  g_egl_dynProcs.glGetProgramBinary = (glGetProgramBinary_t)
+    eglGetProcAddress("glGetProgramBinary");
+  g_egl_dynProcs.glProgramBinary = (glProgramBinary_t)
+    eglGetProcAddress("glProgramBinary");
+  if (!g_egl_dynProcs.glGetProgramBinary || !g_egl_dynProcs.glProgramBinary)
+  {
+    g_egl_dynProcs.glGetProgramBinary = (glGetProgramBinary_t)
+      eglGetProcAddress("glGetProgramBinaryOES");
+    g_egl_dynProcs.glProgramBinary = (glProgramBinary_t)
+      eglGetProcAddress("glProgramBinaryOES");
+  }
+  g_egl_dynProcs.glProgramParameteri = (glProgramParameteri_t)
+    eglGetProcAddress("glProgramParameteri");
 };
 
 #endif
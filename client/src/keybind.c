@@ -23,6 +23,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "app.h"
 #include "core.h"
 #include "kb.h"
+#include "latency.h"
 
 #include "spice/spice.h"
 
@@ -53,6 +54,15 @@ static void bind_showFPS(int sc, void * opaque)
   app_showFPS(g_state.showFPS);
 }
 
+static void bind_latency(int sc, void * opaque)
+{
+  if (latency_dump(g_params.latencyFile))
+    app_alert(LG_ALERT_INFO, "Latency statistics written to %s",
+        g_params.latencyFile);
+  else
+    app_alert(LG_ALERT_ERROR, "Failed to write the latency statistics");
+}
+
 static void bind_rotate(int sc, void * opaque)
 {
   if (g_params.winRotate == LG_ROTATE_MAX-1)
@@ -133,6 +143,7 @@ void keybind_register(void)
   app_registerKeybind(KEY_F, bind_fullscreen, NULL, "Full screen toggle");
   app_registerKeybind(KEY_V, bind_video     , NULL, "Video stream toggle");
   app_registerKeybind(KEY_D, bind_showFPS   , NULL, "FPS display toggle");
+  app_registerKeybind(KEY_L, bind_latency   , NULL, "Write the latency statistics to a file");
   app_registerKeybind(KEY_R, bind_rotate    , NULL, "Rotate the output clockwise by 90° increments");
   app_registerKeybind(KEY_Q, bind_quit      , NULL, "Quit");
 
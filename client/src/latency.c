@@ -0,0 +1,277 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "latency.h"
+
+#include "common/debug.h"
+#include "common/time.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+
+/* log-linear buckets in the style of HdrHistogram, values below SUB_COUNT are
+ * exact and above that each power of two is split into HALF_COUNT buckets
+ * giving a worst case error of under 1.6% */
+#define SUB_BITS   7
+#define SUB_COUNT  (1 << SUB_BITS)
+#define HALF_COUNT (SUB_COUNT / 2)
+#define MAX_SHIFT  25
+#define BUCKETS    ((MAX_SHIFT + 2) * HALF_COUNT)
+#define MAX_VALUE  (((uint64_t)SUB_COUNT << MAX_SHIFT) - 1)
+
+// how long each clock calibration window lasts in microseconds
+#define CLOCK_WINDOW 2000000
+
+struct Histogram
+{
+  atomic_uint_least32_t counts[BUCKETS];
+  atomic_uint_least64_t total;
+  atomic_uint_least64_t sum;
+  atomic_uint_least64_t max;
+};
+
+struct Latency
+{
+  struct Histogram stages[LATENCY_STAGE_MAX];
+
+  KVMFRClock * clock;
+  bool         local;
+  uint64_t     lastHost;
+  int64_t      prevMin, curMin;
+  uint64_t     windowEnd;
+
+  atomic_bool          offsetValid;
+  atomic_int_least64_t offset;
+};
+
+static struct Latency l = { 0 };
+
+static const char * stageNames[LATENCY_STAGE_MAX] =
+{
+  [LATENCY_HOST_COPY] = "host copy",
+  [LATENCY_TRANSPORT] = "transport",
+  [LATENCY_UPLOAD   ] = "upload",
+  [LATENCY_PRESENT  ] = "present",
+  [LATENCY_TOTAL    ] = "total"
+};
+
+static unsigned int bucketIndex(uint64_t value)
+{
+  if (value > MAX_VALUE)
+    value = MAX_VALUE;
+
+  if (value < SUB_COUNT)
+    return value;
+
+  const int shift = (63 - __builtin_clzll(value)) - (SUB_BITS - 1);
+  return shift * HALF_COUNT + (value >> shift);
+}
+
+static void bucketRange(unsigned int index, uint64_t * lower, uint64_t * upper)
+{
+  if (index < SUB_COUNT)
+  {
+    *lower = *upper = index;
+    return;
+  }
+
+  const int      shift = index / HALF_COUNT - 1;
+  const uint64_t mant  = index - shift * HALF_COUNT;
+  *lower = mant << shift;
+  *upper = ((mant + 1) << shift) - 1;
+}
+
+static uint64_t percentile(struct Histogram * h, uint64_t total, double p)
+{
+  const uint64_t target = (uint64_t)(p * total + 0.5);
+  uint64_t count = 0;
+
+  for(unsigned int i = 0; i < BUCKETS; ++i)
+  {
+    count += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    if (count >= target && count > 0)
+    {
+      uint64_t lower, upper;
+      bucketRange(i, &lower, &upper);
+      return (lower + upper) / 2;
+    }
+  }
+
+  return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+void latency_setClock(KVMFRClock * clock, bool local)
+{
+  l.clock     = clock;
+  l.local     = local;
+  l.lastHost  = 0;
+  l.prevMin   = INT64_MAX;
+  l.curMin    = INT64_MAX;
+  l.windowEnd = 0;
+  atomic_store(&l.offsetValid, local);
+  atomic_store(&l.offset     , 0);
+}
+
+void latency_sampleClock(void)
+{
+  if (!l.clock || l.local)
+    return;
+
+  const uint64_t host = atomic_load_explicit(&l.clock->time,
+      memory_order_acquire);
+
+  // only the first read after an update is worth anything
+  if (host == l.lastHost)
+    return;
+  l.lastHost = host;
+
+  /* the host time is always stale by the time we read it, so the smallest
+   * difference seen is the closest to the real offset. Two windows are kept so
+   * that the estimate follows any drift between the clocks */
+  const uint64_t now   = microtime();
+  const int64_t  delta = (int64_t)(now - host);
+
+  if (now >= l.windowEnd)
+  {
+    l.prevMin   = l.curMin;
+    l.curMin    = INT64_MAX;
+    l.windowEnd = now + CLOCK_WINDOW;
+  }
+
+  if (delta < l.curMin)
+    l.curMin = delta;
+
+  atomic_store(&l.offset, l.curMin < l.prevMin ? l.curMin : l.prevMin);
+  atomic_store(&l.offsetValid, true);
+}
+
+uint64_t latency_hostToLocal(uint64_t hostTime)
+{
+  if (!hostTime || !atomic_load(&l.offsetValid))
+    return 0;
+
+  return hostTime + atomic_load(&l.offset);
+}
+
+void latency_reset(void)
+{
+  for(int s = 0; s < LATENCY_STAGE_MAX; ++s)
+  {
+    struct Histogram * h = &l.stages[s];
+    for(unsigned int i = 0; i < BUCKETS; ++i)
+      atomic_store_explicit(&h->counts[i], 0, memory_order_relaxed);
+    atomic_store(&h->total, 0);
+    atomic_store(&h->sum  , 0);
+    atomic_store(&h->max  , 0);
+  }
+}
+
+void latency_record(enum LatencyStage stage, uint64_t us)
+{
+  struct Histogram * h = &l.stages[stage];
+  atomic_fetch_add_explicit(&h->counts[bucketIndex(us)], 1,
+      memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->total, 1 , memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum  , us, memory_order_relaxed);
+
+  uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while(us > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, us,
+        memory_order_relaxed, memory_order_relaxed)) {}
+}
+
+void latency_format(char * buffer, size_t size)
+{
+  size_t len = 0;
+  buffer[0]  = '\0';
+
+  for(int s = 0; s < LATENCY_STAGE_MAX && len < size; ++s)
+  {
+    struct Histogram * h = &l.stages[s];
+    const uint64_t total = atomic_load(&h->total);
+    const char   * sep   = s == 0 ? "" : "\n";
+
+    if (!total)
+    {
+      len += snprintf(buffer + len, size - len, "%s%-9s: no samples",
+          sep, stageNames[s]);
+      continue;
+    }
+
+    len += snprintf(buffer + len, size - len,
+        "%s%-9s: p50 %7.2f, p99 %7.2f, p99.9 %7.2f ms",
+        sep, stageNames[s],
+        percentile(h, total, 0.500) / 1000.0,
+        percentile(h, total, 0.990) / 1000.0,
+        percentile(h, total, 0.999) / 1000.0);
+  }
+}
+
+bool latency_dump(const char * path)
+{
+  // never follow a link planted in place of the file
+  const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+      O_CLOEXEC, 0600);
+  FILE * fp = fd < 0 ? NULL : fdopen(fd, "w");
+  if (!fp)
+  {
+    DEBUG_ERROR("Failed to open %s for writing", path);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+
+  fprintf(fp, "# all values are in microseconds\n");
+  for(int s = 0; s < LATENCY_STAGE_MAX; ++s)
+  {
+    struct Histogram * h = &l.stages[s];
+    const uint64_t total = atomic_load(&h->total);
+
+    fprintf(fp, "\n[%s]\n", stageNames[s]);
+    fprintf(fp, "count=%" PRIu64 "\n", total);
+    if (!total)
+      continue;
+
+    fprintf(fp, "mean=%" PRIu64 "\n", atomic_load(&h->sum) / total);
+    fprintf(fp, "max=%"  PRIu64 "\n", (uint64_t)atomic_load(&h->max));
+    fprintf(fp, "p50=%"  PRIu64 "\n", percentile(h, total, 0.500));
+    fprintf(fp, "p90=%"  PRIu64 "\n", percentile(h, total, 0.900));
+    fprintf(fp, "p99=%"  PRIu64 "\n", percentile(h, total, 0.990));
+    fprintf(fp, "p99.9=%" PRIu64 "\n", percentile(h, total, 0.999));
+    fprintf(fp, "# lower upper count\n");
+
+    for(unsigned int i = 0; i < BUCKETS; ++i)
+    {
+      const uint32_t count = atomic_load_explicit(&h->counts[i],
+          memory_order_relaxed);
+      if (!count)
+        continue;
+
+      uint64_t lower, upper;
+      bucketRange(i, &lower, &upper);
+      fprintf(fp, "%" PRIu64 " %" PRIu64 " %" PRIu32 "\n", lower, upper, count);
+    }
+  }
+
+  fclose(fp);
+  return true;
+}
@@ -0,0 +1,70 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _H_LG_LATENCY_
+#define _H_LG_LATENCY_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/KVMFR.h"
+
+enum LatencyStage
+{
+  LATENCY_HOST_COPY, // host copy start -> copy end
+  LATENCY_TRANSPORT, // host capture    -> frame available to the client
+  LATENCY_UPLOAD,    // frame available -> upload to the renderer done
+  LATENCY_PRESENT,   // upload done     -> buffer swap
+  LATENCY_TOTAL,     // host capture    -> buffer swap
+
+  LATENCY_STAGE_MAX
+};
+
+/**
+ * Set the host clock to calibrate against, local should be true if the host
+ * shares our monotonic clock (same kernel)
+ */
+void latency_setClock(KVMFRClock * clock, bool local);
+
+/**
+ * Sample the host clock to refine the offset estimate, call this often
+ */
+void latency_sampleClock(void);
+
+/**
+ * Convert a host timestamp to the client clock, returns zero if the offset is
+ * not yet known
+ */
+uint64_t latency_hostToLocal(uint64_t hostTime);
+
+void latency_reset (void);
+void latency_record(enum LatencyStage stage, uint64_t us);
+
+/**
+ * Format the p50/p99/p99.9 of each stage for the overlay
+ */
+void latency_format(char * buffer, size_t size);
+
+/**
+ * Write the percentiles and raw histogram buckets of each stage to a file
+ */
+bool latency_dump(const char * path);
+
+#endif
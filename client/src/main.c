@@ -31,6 +31,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <errno.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <stdatomic.h>
@@ -44,6 +45,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/locking.h"
 #include "common/event.h"
 #include "common/ivshmem.h"
+#include "common/doorbell.h"
 #include "common/time.h"
 #include "common/version.h"
 
@@ -51,9 +53,16 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "app.h"
 #include "keybind.h"
 #include "clipboard.h"
+#include "latency.h"
+#include "deadline.h"
 #include "ll.h"
 #include "egl_dynprocs.h"
 
+/* when blocked on the doorbell we still wake periodically to check the run
+ * state, the cursor thread also needs to pick up local redraw requests */
+#define DOORBELL_FRAME_TIMEOUT  100000
+#define DOORBELL_CURSOR_TIMEOUT 10000
+
 // forwards
 static int cursorThread(void * unused);
 static int renderThread(void * unused);
@@ -91,6 +100,67 @@ static void lgInit(void)
     g_state.ds->showPointer(false);
   else
     g_state.ds->showPointer(true);
+
+  core_updateGuestPointer();
+}
+
+void main_wakeRender(void)
+{
+  if (e_frame)
+    lgSignalEvent(e_frame);
+}
+
+static void updateFPS(bool rendered)
+{
+  if (!g_state.showFPS)
+    return;
+
+  const uint64_t t    = nanotime();
+  g_state.renderTime   += t - g_state.lastFrameTime;
+  g_state.lastFrameTime = t;
+  if (rendered)
+    ++g_state.renderCount;
+
+  if (g_state.renderTime > 1e9)
+  {
+    const float avgUPS = 1000.0f / (((float)g_state.renderTime /
+      atomic_exchange_explicit(&g_state.frameCount, 0, memory_order_acquire)) /
+      1e6f);
+
+    const float avgFPS = 1000.0f / (((float)g_state.renderTime /
+      g_state.renderCount) /
+      1e6f);
+
+    char stats[512];
+    latency_format(stats, sizeof(stats));
+
+    size_t len = strlen(stats);
+    if (len + 1 < sizeof(stats) &&
+        deadline_format(stats + len + 1, sizeof(stats) - len - 1))
+      stats[len] = '\n';
+
+    /* frames from the host, and those it sent that never reached us */
+    const uint64_t received = atomic_load_explicit(&g_state.framesReceived,
+        memory_order_relaxed);
+    const uint64_t skipped  = atomic_load_explicit(&g_state.framesSkipped,
+        memory_order_relaxed);
+
+    len = strlen(stats);
+    snprintf(stats + len, sizeof(stats) - len,
+        "%sSkipped: %" PRIu64 "/s\n"
+        "Frames: %" PRIu64 "/s, dropped: %" PRIu64 "/s",
+        len ? "\n" : "", g_state.renderSkipped,
+        received - g_state.statsReceived, skipped - g_state.statsSkipped);
+
+    g_state.statsReceived = received;
+    g_state.statsSkipped  = skipped;
+
+    g_state.lgr->update_fps(g_state.lgrData, avgUPS, avgFPS, stats);
+
+    g_state.renderTime    = 0;
+    g_state.renderCount   = 0;
+    g_state.renderSkipped = 0;
+  }
 }
 
 static int renderThread(void * unused)
@@ -112,6 +182,8 @@ static int renderThread(void * unused)
   struct timespec time;
   clock_gettime(CLOCK_MONOTONIC, &time);
 
+  deadline_init(g_params.jitRender, g_params.jitRenderMargin);
+
   while(g_state.state != APP_STATE_SHUTDOWN)
   {
     if (g_params.fpsMin != 0)
@@ -130,33 +202,49 @@ static int renderThread(void * unused)
       atomic_compare_exchange_weak(&g_state.lgrResize, &resize, 0);
     }
 
-    if (!g_state.lgr->render(g_state.lgrData, g_params.winRotate))
-      break;
+    const bool invalidate =
+      atomic_exchange(&g_state.invalidateWindow, false) || resize;
 
-    if (g_state.showFPS)
+    /* if nothing visible changed there is no need to draw or present */
+    if (!invalidate && g_state.lgr->needs_render &&
+        !g_state.lgr->needs_render(g_state.lgrData))
     {
-      const uint64_t t    = nanotime();
-      g_state.renderTime   += t - g_state.lastFrameTime;
-      g_state.lastFrameTime = t;
-      ++g_state.renderCount;
+      ++g_state.renderSkipped;
+      ++g_state.renderSkippedTotal;
 
-      if (g_state.renderTime > 1e9)
-      {
-        const float avgUPS = 1000.0f / (((float)g_state.renderTime /
-          atomic_exchange_explicit(&g_state.frameCount, 0, memory_order_acquire)) /
-          1e6f);
+      /* without a minimum frame rate there is nothing else to wait on */
+      if (g_params.fpsMin == 0)
+        lgWaitEventNS(e_frame, g_state.frameTime);
 
-        const float avgFPS = 1000.0f / (((float)g_state.renderTime /
-          g_state.renderCount) /
-          1e6f);
+      updateFPS(false);
+      app_handleRenderEvent(microtime());
+      continue;
+    }
 
-        g_state.lgr->update_fps(g_state.lgrData, avgUPS, avgFPS);
+    /* render as late as possible so the newest frame and cursor position make
+     * it to the display */
+    deadline_wait();
 
-        g_state.renderTime  = 0;
-        g_state.renderCount = 0;
-      }
+    if (!g_state.lgr->render(g_state.lgrData, g_params.winRotate, invalidate))
+      break;
+
+    deadline_presented();
+
+    const uint64_t uploaded =
+      atomic_exchange_explicit(&g_state.latencyUpload, 0, memory_order_acquire);
+    if (uploaded)
+    {
+      const uint64_t now     = microtime();
+      const uint64_t capture = atomic_load_explicit(&g_state.latencyCapture,
+          memory_order_relaxed);
+
+      latency_record(LATENCY_PRESENT, now - uploaded);
+      if (capture && now >= capture)
+        latency_record(LATENCY_TOTAL, now - capture);
     }
 
+    updateFPS(true);
+
     const uint64_t now = microtime();
     if (!g_state.resizeDone && g_state.resizeTimeout < now)
     {
@@ -174,6 +262,8 @@ static int renderThread(void * unused)
   }
 
   g_state.state = APP_STATE_SHUTDOWN;
+  deadline_report();
+  DEBUG_INFO("Renders skipped: %" PRIu64, g_state.renderSkippedTotal);
 
   if (t_cursor)
     lgJoinThread(t_cursor, NULL);
@@ -185,6 +275,45 @@ static int renderThread(void * unused)
   return 0;
 }
 
+static inline uint32_t getPostSeq(int bell)
+{
+  return g_state.doorbell ? doorbellGetSeq(g_state.doorbell, bell) : 0;
+}
+
+/* block until the host posts a new message, if the host is not ringing the
+ * doorbell fall back to polling every interval microseconds */
+static void waitForPost(int bell, uint32_t seq, unsigned int timeout,
+    unsigned int interval)
+{
+  if (g_state.doorbell)
+  {
+    doorbellWait(g_state.doorbell, g_state.doorbellDev, bell, seq, timeout);
+    return;
+  }
+
+  const struct timespec req =
+  {
+    .tv_sec  = 0,
+    .tv_nsec = interval * 1000L
+  };
+
+  struct timespec rem;
+  while(nanosleep(&req, &rem) < 0)
+    if (errno != EINTR)
+    {
+      DEBUG_ERROR("nanosleep failed");
+      break;
+    }
+}
+
+/* the renderer only draws the cursor if the display server is not */
+static bool rendererCursorVisible(void)
+{
+  return g_cursor.guest.visible &&
+    (g_cursor.draw || !g_params.useSpiceInput) &&
+    !atomic_load(&g_cursor.dsCursor);
+}
+
 static int cursorThread(void * unused)
 {
   LGMP_STATUS         status;
@@ -213,6 +342,9 @@ static int cursorThread(void * unused)
 
   while(g_state.state == APP_STATE_RUNNING)
   {
+    latency_sampleClock();
+
+    const uint32_t seq = getPostSeq(KVMFR_DOORBELL_POINTER);
     LGMPMessage msg;
     if ((status = lgmpClientProcess(queue, &msg)) != LGMP_OK)
     {
@@ -224,7 +356,7 @@ static int cursorThread(void * unused)
           g_state.lgr->on_mouse_event
           (
             g_state.lgrData,
-            g_cursor.guest.visible && (g_cursor.draw || !g_params.useSpiceInput),
+            rendererCursorVisible(),
             g_cursor.guest.x,
             g_cursor.guest.y
           );
@@ -232,20 +364,8 @@ static int cursorThread(void * unused)
           lgSignalEvent(e_frame);
         }
 
-        const struct timespec req =
-        {
-          .tv_sec  = 0,
-          .tv_nsec = g_params.cursorPollInterval * 1000L
-        };
-
-        struct timespec rem;
-        while(nanosleep(&req, &rem) < 0)
-          if (errno != -EINTR)
-          {
-            DEBUG_ERROR("nanosleep failed");
-            break;
-          }
-
+        waitForPost(KVMFR_DOORBELL_POINTER, seq, DOORBELL_CURSOR_TIMEOUT,
+            g_params.cursorPollInterval);
         continue;
       }
 
@@ -261,8 +381,9 @@ static int cursorThread(void * unused)
 
     KVMFRCursor * cursor = (KVMFRCursor *)msg.mem;
 
-    g_cursor.guest.visible =
-      msg.udata & CURSOR_FLAG_VISIBLE;
+    const bool visible = msg.udata & CURSOR_FLAG_VISIBLE;
+    const bool visibleChanged = g_cursor.guest.visible != visible;
+    g_cursor.guest.visible = visible;
 
     if (msg.udata & CURSOR_FLAG_SHAPE)
     {
@@ -294,7 +415,12 @@ static int cursorThread(void * unused)
         lgmpClientMessageDone(queue);
         continue;
       }
+
+      core_setGuestPointerShape(cursorType, cursor->width, cursor->height,
+          cursor->pitch, cursor->hx, cursor->hy, data);
     }
+    else if (visibleChanged)
+      core_updateGuestPointer();
 
     if (msg.udata & CURSOR_FLAG_POSITION)
     {
@@ -320,12 +446,13 @@ static int cursorThread(void * unused)
     g_state.lgr->on_mouse_event
     (
       g_state.lgrData,
-      g_cursor.guest.visible && (g_cursor.draw || !g_params.useSpiceInput),
+      rendererCursorVisible(),
       g_cursor.guest.x,
       g_cursor.guest.y
     );
 
-    if (g_params.mouseRedraw && g_cursor.guest.visible)
+    if (g_params.mouseRedraw && g_cursor.guest.visible &&
+        !atomic_load(&g_cursor.dsCursor))
       lgSignalEvent(e_frame);
   }
 
@@ -349,7 +476,7 @@ int main_frameThread(void * unused)
   size_t            dataSize  = 0;
   LG_RendererFormat lgrFormat;
 
-  struct DMAFrameInfo dmaInfo[LGMP_Q_FRAME_LEN] = {0};
+  struct DMAFrameInfo dmaInfo[KVMFR_FRAME_BUFFERS] = {0};
   const bool useDMA =
     g_params.allowDMA &&
     ivshmemHasDMA(&g_state.shm) &&
@@ -381,27 +508,31 @@ int main_frameThread(void * unused)
     break;
   }
 
+  bool     haveSerial = false;
+  uint32_t lastSerial = 0;
+
+  latency_reset();
+
   while(g_state.state == APP_STATE_RUNNING && !g_state.stopVideo)
   {
+    const uint32_t seq = getPostSeq(KVMFR_DOORBELL_FRAME);
+
+    /* drop any frames we have fallen behind on before copying anything, they
+     * would never be shown. DMA frames are not copied, and releasing a frame
+     * that was never drawn would let the host overwrite the one on screen */
+    if (g_params.latestFrameOnly && !useDMA)
+      status = lgmpClientAdvanceToLast(queue);
+    else
+      status = LGMP_OK;
+
     LGMPMessage msg;
-    if ((status = lgmpClientProcess(queue, &msg)) != LGMP_OK)
+    if ((status != LGMP_OK && status != LGMP_ERR_QUEUE_EMPTY) ||
+        (status = lgmpClientProcess(queue, &msg)) != LGMP_OK)
     {
       if (status == LGMP_ERR_QUEUE_EMPTY)
       {
-        const struct timespec req =
-        {
-          .tv_sec  = 0,
-          .tv_nsec = g_params.framePollInterval * 1000L
-        };
-
-        struct timespec rem;
-        while(nanosleep(&req, &rem) < 0)
-          if (errno != -EINTR)
-          {
-            DEBUG_ERROR("nanosleep failed");
-            break;
-          }
-
+        waitForPost(KVMFR_DOORBELL_FRAME, seq, DOORBELL_FRAME_TIMEOUT,
+            g_params.framePollInterval);
         continue;
       }
 
@@ -415,9 +546,27 @@ int main_frameThread(void * unused)
       break;
     }
 
+    const uint64_t available = microtime();
     KVMFRFrame * frame = (KVMFRFrame *)msg.mem;
     struct DMAFrameInfo *dma = NULL;
 
+    // repeated frames for new clients keep the serial and are not counted
+    const int32_t serialDelta = (int32_t)(frame->frameSerial - lastSerial);
+    const bool    newFrame    = !haveSerial || serialDelta != 0;
+
+    /* damage is relative to the previous frame, if any were skipped or the
+     * frame was repeated the whole frame must be treated as damaged */
+    int damageRectsCount = frame->damageRectsCount;
+    if (!haveSerial || serialDelta != 1 ||
+        damageRectsCount > KVMFR_MAX_DAMAGE_RECTS)
+      damageRectsCount = 0;
+    if (haveSerial && serialDelta > 1)
+      atomic_fetch_add_explicit(&g_state.framesSkipped, serialDelta - 1,
+          memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_state.framesReceived, 1, memory_order_relaxed);
+    haveSerial = true;
+    lastSerial = frame->frameSerial;
+
     if (!g_state.formatValid || frame->formatVer != formatVer)
     {
       // setup the renderer format with the frame format details
@@ -466,6 +615,7 @@ int main_frameThread(void * unused)
 
       g_state.formatValid = true;
       formatVer = frame->formatVer;
+      damageRectsCount = 0;
 
       DEBUG_INFO("Format: %s %ux%u stride:%u pitch:%u rotation:%d",
           FrameTypeStr[frame->type],
@@ -538,8 +688,15 @@ int main_frameThread(void * unused)
       }
     }
 
+    /* the renderer ends the upload stage with app_frameUploaded once the frame
+     * can be drawn, which may happen before on_frame returns */
+    if (newFrame)
+      atomic_store_explicit(&g_state.latencyAvailable, available,
+          memory_order_release);
+
     FrameBuffer * fb = (FrameBuffer *)(((uint8_t*)frame) + frame->offset);
-    if (!g_state.lgr->on_frame(g_state.lgrData, fb, useDMA ? dma->fd : -1))
+    if (!g_state.lgr->on_frame(g_state.lgrData, fb, useDMA ? dma->fd : -1,
+          frame->damageRects, damageRectsCount))
     {
       lgmpClientMessageDone(queue);
       DEBUG_ERROR("renderer on frame returned failure");
@@ -547,6 +704,24 @@ int main_frameThread(void * unused)
       break;
     }
 
+    if (newFrame)
+    {
+      const uint64_t capture = latency_hostToLocal(frame->captureTime);
+
+      /* the host writes the copy times after posting the frame, if the copy
+       * has not finished yet they are simply not recorded */
+      const uint64_t copyStart = *(volatile uint64_t *)&frame->copyStart;
+      const uint64_t copyEnd   = *(volatile uint64_t *)&frame->copyEnd;
+      if (copyStart && copyEnd >= copyStart)
+        latency_record(LATENCY_HOST_COPY, copyEnd - copyStart);
+
+      if (capture && available >= capture)
+        latency_record(LATENCY_TRANSPORT, available - capture);
+
+      atomic_store_explicit(&g_state.latencyCapture, capture,
+          memory_order_relaxed);
+    }
+
     if (g_params.autoScreensaver && g_state.autoIdleInhibitState != frame->blockScreensaver)
     {
       if (frame->blockScreensaver)
@@ -558,12 +733,28 @@ int main_frameThread(void * unused)
 
     atomic_fetch_add_explicit(&g_state.frameCount, 1, memory_order_relaxed);
     lgSignalEvent(e_frame);
+
+    /* DMA frames are sampled in place, on_frame only returns once the buffer
+     * of the previous frame is no longer in use. The host does not rewrite
+     * that buffer until this message is released */
     lgmpClientMessageDone(queue);
+
+    if (g_params.exitAfterFrames &&
+        atomic_load(&g_state.framesReceived) >= g_params.exitAfterFrames)
+    {
+      DEBUG_INFO("Received %u frames, exiting", g_params.exitAfterFrames);
+      g_state.state = APP_STATE_SHUTDOWN;
+      break;
+    }
   }
 
   lgmpClientUnsubscribe(&queue);
   g_state.lgr->on_restart(g_state.lgrData);
 
+  DEBUG_INFO("Frames received: %" PRIu64 ", skipped: %" PRIu64,
+      (uint64_t)atomic_load(&g_state.framesReceived),
+      (uint64_t)atomic_load(&g_state.framesSkipped));
+
   if (useDMA)
   {
     for(int i = 0; i < sizeof(dmaInfo) / sizeof(struct DMAFrameInfo); ++i)
@@ -644,6 +835,11 @@ static bool tryRenderer(const int index, const LG_RendererParams lgrParams,
 static int lg_run(void)
 {
   memset(&g_state, 0, sizeof(g_state));
+  if (!(g_cursor.dsLock = lgCreateMutex()))
+  {
+    DEBUG_ERROR("Failed to create the guest cursor lock");
+    return -1;
+  }
 
   g_cursor.sens = g_params.mouseSens;
        if (g_cursor.sens < -9) g_cursor.sens = -9;
@@ -716,6 +912,7 @@ static int lg_run(void)
   bool needsOpenGL;
   LG_RendererParams lgrParams;
   lgrParams.quickSplash = g_params.quickSplash;
+  lgrParams.copyThreads = g_params.copyThreads;
 
   if (g_params.forceRenderer)
   {
@@ -920,6 +1117,41 @@ restart:
   }
 
   DEBUG_INFO("Host ready, reported version: %s", udata->hostver);
+
+  g_state.doorbell    = NULL;
+  g_state.doorbellDev = NULL;
+  bool doorbellLocal  = false;
+  if (udata->doorbell &&
+      udata->doorbell + sizeof(KVMFRDoorbell) <= g_state.shm.size)
+  {
+    KVMFRDoorbell * db =
+      (KVMFRDoorbell *)((uint8_t *)g_state.shm.mem + udata->doorbell);
+    if (doorbellIsLocal(db))
+    {
+      DEBUG_INFO("Using the host doorbell");
+      g_state.doorbell = db;
+      doorbellLocal    = true;
+    }
+    else if (doorbellRegister(db, &g_state.shm))
+    {
+      /* the host is in another VM and rings us through ivshmem-doorbell */
+      DEBUG_INFO("Using the host doorbell through the IVSHMEM interrupts");
+      g_state.doorbell    = db;
+      g_state.doorbellDev = &g_state.shm;
+    }
+    else
+      DEBUG_INFO("The host doorbell is not local, polling for updates");
+  }
+
+  /* a host on the same kernel shares our monotonic clock, otherwise the offset
+   * is calibrated from the clock the host keeps updated in the shared memory */
+  if (udata->clock && udata->clock + sizeof(KVMFRClock) <= g_state.shm.size)
+    latency_setClock(
+      (KVMFRClock *)((uint8_t *)g_state.shm.mem + udata->clock),
+      doorbellLocal);
+  else
+    latency_setClock(NULL, false);
+
   DEBUG_INFO("Starting session");
 
   if (!lgCreateThread("cursorThread", cursorThread, NULL, &t_cursor))
@@ -974,6 +1206,24 @@ static void lg_shutdown(void)
 
   lgmpClientFree(&g_state.lgmp);
 
+  // benchmark runs report the per-stage timings once everything has stopped
+  if (g_params.exitAfterFrames)
+  {
+    char stats[512];
+    latency_format(stats, sizeof(stats));
+
+    char * line = stats;
+    for(char * next; line; line = next)
+    {
+      if ((next = strchr(line, '\n')))
+        *next++ = '\0';
+      DEBUG_INFO("%s", line);
+    }
+
+    if (latency_dump(g_params.latencyFile))
+      DEBUG_INFO("Latency statistics written to %s", g_params.latencyFile);
+  }
+
   if (e_frame)
   {
     lgFreeEvent(e_frame);
@@ -1015,6 +1265,20 @@ static void lg_shutdown(void)
   if (g_state.dsInitialized)
     g_state.ds->free();
 
+  free(g_cursor.dsPixels);
+  g_cursor.dsPixels     = NULL;
+  g_cursor.dsPixelsSize = 0;
+  g_cursor.dsValid      = false;
+
+  if (g_cursor.dsLock)
+  {
+    lgFreeMutex(g_cursor.dsLock);
+    g_cursor.dsLock = NULL;
+  }
+
+  if (g_state.doorbellDev)
+    doorbellUnregister(g_state.doorbell, g_state.doorbellDev);
+
   ivshmemClose(&g_state.shm);
 }
 
@@ -25,7 +25,10 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "dynamic/renderers.h"
 
 #include "common/thread.h"
+#include "common/locking.h"
+#include "common/mutex.h"
 #include "common/types.h"
+#include "common/KVMFR.h"
 #include "common/ivshmem.h"
 
 #include "spice/spice.h"
@@ -80,6 +83,8 @@ struct AppState
   struct ll          * cbRequestList;
 
   struct IVSHMEM       shm;
+  KVMFRDoorbell      * doorbell;
+  struct IVSHMEM     * doorbellDev;
   PLGMPClient          lgmp;
   PLGMPClientQueue     frameQueue;
   PLGMPClientQueue     pointerQueue;
@@ -90,7 +95,17 @@ struct AppState
   uint64_t              lastFrameTime;
   uint64_t              renderTime;
   atomic_uint_least64_t frameCount;
+  atomic_uint_least64_t framesReceived;
+  atomic_uint_least64_t framesSkipped;
+  atomic_uint_least64_t latencyCapture;
+  atomic_uint_least64_t latencyAvailable;
+  atomic_uint_least64_t latencyUpload;
   uint64_t              renderCount;
+  uint64_t              renderSkipped;
+  uint64_t              renderSkippedTotal;
+  uint64_t              statsReceived;
+  uint64_t              statsSkipped;
+  atomic_bool           invalidateWindow;
 
 
   uint64_t resizeTimeout;
@@ -115,6 +130,8 @@ struct AppParams
   int               x, y;
   unsigned int      w, h;
   int               fpsMin;
+  bool              jitRender;
+  int               jitRenderMargin;
   bool              showFPS;
   LG_RendererRotate winRotate;
   bool              useSpiceInput;
@@ -141,6 +158,10 @@ struct AppParams
 
   unsigned int      cursorPollInterval;
   unsigned int      framePollInterval;
+  bool              latestFrameOnly;
+  unsigned int      copyThreads;
+  const char *      latencyFile;
+  unsigned int      exitAfterFrames;
   bool              allowDMA;
 
   bool              forceRenderer;
@@ -148,6 +169,7 @@ struct AppParams
 
   const char *      windowTitle;
   bool              mouseRedraw;
+  bool              hwCursor;
   int               mouseSens;
   bool              mouseSmoothing;
   bool              rawMouse;
@@ -249,6 +271,18 @@ struct CursorState
 
   /* the projected position after move, for app_handleMouseBasic only */
   struct Point projected;
+
+  /* the guest's cursor shape converted for the display server, the lock is
+   * held across the display server calls as they round trip to the server */
+  LGMutex         * dsLock;
+  LG_DSPointerShape dsShape;
+  uint32_t        * dsPixels;
+  size_t            dsPixelsSize;
+  bool              dsValid;
+  bool              dsChanged;
+
+  /* true if the display server is drawing the guest's cursor */
+  atomic_bool       dsCursor;
 };
 
 // forwards
@@ -257,3 +291,4 @@ extern struct CursorState g_cursor;
 extern struct AppParams   g_params;
 
 int main_frameThread(void * unused);
+void main_wakeRender(void);
@@ -24,10 +24,11 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "types.h"
 
 #define KVMFR_MAGIC   "KVMFR---"
-#define KVMFR_VERSION 9
+#define KVMFR_VERSION 14
 
 #define LGMP_Q_POINTER     1
 #define LGMP_Q_FRAME       2
@@ -35,6 +36,14 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #define LGMP_Q_FRAME_LEN   2
 #define LGMP_Q_POINTER_LEN 20
 
+// the host writes frames round robin into one more buffer than the frame
+// queue can hold, a buffer is then only rewritten once the message after the
+// one that used it has been released, which lets DMA clients keep sampling a
+// frame in place until they have moved on to the next one
+#define KVMFR_FRAME_BUFFERS (LGMP_Q_FRAME_LEN + 1)
+
+#define KVMFR_MAX_DAMAGE_RECTS 64
+
 enum
 {
   CURSOR_FLAG_POSITION = 0x1,
@@ -49,9 +58,37 @@ typedef struct KVMFR
   char     magic[8];
   uint32_t version;
   char     hostver[32];
+  uint32_t doorbell; // offset of the KVMFRDoorbell in the shared memory, zero if none
+  uint32_t clock;    // offset of the KVMFRClock in the shared memory, zero if none
 }
 KVMFR;
 
+enum
+{
+  KVMFR_DOORBELL_FRAME,
+  KVMFR_DOORBELL_POINTER,
+
+  KVMFR_DOORBELL_MAX
+};
+
+#define KVMFR_DOORBELL_PEERS 8
+
+typedef struct KVMFRDoorbell
+{
+  char                  bootID[40];                    // the kernel boot id of the host
+  atomic_uint_least32_t seq    [KVMFR_DOORBELL_MAX  ]; // incremented on each post
+  atomic_uint_least32_t waiters[KVMFR_DOORBELL_MAX  ]; // clients blocked on seq
+  atomic_uint_least32_t peers  [KVMFR_DOORBELL_PEERS]; // ivshmem peer id + 1 of clients to interrupt, zero if free
+  atomic_uint_least32_t alive  [KVMFR_DOORBELL_PEERS]; // bumped by the peer each time it waits
+}
+KVMFRDoorbell;
+
+typedef struct KVMFRClock
+{
+  atomic_uint_least64_t time; // the host monotonic time in microseconds, updated periodically
+}
+KVMFRClock;
+
 typedef struct KVMFRCursor
 {
   int16_t    x, y;        // cursor x & y position
@@ -65,16 +102,22 @@ KVMFRCursor;
 
 typedef struct KVMFRFrame
 {
-  uint32_t      formatVer;         // the frame format version number
-  FrameType     type;              // the frame data type
-  uint32_t      width;             // the width
-  uint32_t      height;            // the height
-  FrameRotation rotation;          // the frame rotation
-  uint32_t      stride;            // the row stride (zero if compressed data)
-  uint32_t      pitch;             // the row pitch  (stride in bytes or the compressed frame size)
-  uint32_t      offset;            // offset from the start of this header to the FrameBuffer header
-  uint32_t      mouseScalePercent; // movement scale factor of the mouse (relates to DPI of display, 100 = no scale)
-  bool          blockScreensaver;  // whether the guest has requested to block screensavers
+  uint32_t        formatVer;         // the frame format version number
+  uint32_t        frameSerial;       // incremented for each new frame, repeated frames keep the serial
+  FrameType       type;              // the frame data type
+  uint32_t        width;             // the width
+  uint32_t        height;            // the height
+  FrameRotation   rotation;          // the frame rotation
+  uint32_t        stride;            // the row stride (zero if compressed data)
+  uint32_t        pitch;             // the row pitch  (stride in bytes or the compressed frame size)
+  uint32_t        offset;            // offset from the start of this header to the FrameBuffer header
+  uint32_t        mouseScalePercent; // movement scale factor of the mouse (relates to DPI of display, 100 = no scale)
+  bool            blockScreensaver;  // whether the guest has requested to block screensavers
+  uint32_t        damageRectsCount;  // the number of damage rects (zero for a full frame update)
+  FrameDamageRect damageRects[KVMFR_MAX_DAMAGE_RECTS]; // regions changed since the prior frame
+  uint64_t        captureTime;       // host time the frame was captured in microseconds
+  uint64_t        copyStart;         // host time the copy into the frame buffer started (written after post)
+  uint64_t        copyEnd;           // host time the copy into the frame buffer completed (written after post)
 }
 KVMFRFrame;
 
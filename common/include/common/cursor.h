@@ -0,0 +1,53 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _H_LG_COMMON_CURSOR_
+#define _H_LG_COMMON_CURSOR_
+
+#include <stdint.h>
+
+/**
+ * Convert a monochrome cursor to 32bit pixels, height is the combined height
+ * of the AND and XOR masks. The output is width x height pixels, the AND mask
+ * as 0xFFFFFFFF/0xFF000000 followed by the XOR mask as 0x00FFFFFF/0x00000000,
+ * each height / 2 rows.
+ */
+void cursor_convert_mono(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch);
+
+/**
+ * Convert a masked color cursor to a color cursor, pixels with a zero mask
+ * (alpha) byte become opaque and the others transparent
+ */
+void cursor_convert_masked(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch);
+
+/**
+ * Copy a color cursor removing any padding at the end of each row
+ */
+void cursor_convert_color(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch);
+
+/**
+ * Hash a cursor shape so converted copies of it can be cached
+ */
+uint64_t cursor_hash(int type, int width, int height, int pitch,
+    const uint8_t * data);
+
+#endif
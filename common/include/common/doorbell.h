@@ -0,0 +1,66 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _H_LG_COMMON_DOORBELL_
+#define _H_LG_COMMON_DOORBELL_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common/KVMFR.h"
+#include "common/ivshmem.h"
+
+/**
+ * Initialize the doorbell in the shared memory (host)
+ */
+void doorbellInit(KVMFRDoorbell * db);
+
+/**
+ * Returns true if the doorbell was initialized by a host running on the same
+ * kernel, otherwise ringing it can not wake the waiting threads
+ */
+bool doorbellIsLocal(const KVMFRDoorbell * db);
+
+/**
+ * Have the host interrupt us through the ivshmem device when it rings the
+ * doorbell (client). This works across VMs using ivshmem-doorbell with a vector
+ * per bell, returns false if the device can not be interrupted
+ */
+bool doorbellRegister(KVMFRDoorbell * db, struct IVSHMEM * dev);
+void doorbellUnregister(KVMFRDoorbell * db, struct IVSHMEM * dev);
+
+/**
+ * Increment the sequence and wake any waiting clients (host), the registered
+ * clients are also interrupted through dev if it is not NULL
+ */
+void doorbellRing(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell);
+
+/**
+ * Get the current sequence, this must be read before checking for messages
+ */
+uint32_t doorbellGetSeq(KVMFRDoorbell * db, int bell);
+
+/**
+ * Wait for up to timeout microseconds for the sequence to change from seq,
+ * on the device interrupt if dev was registered, otherwise on the futex
+ * Returns false on timeout
+ */
+bool doorbellWait(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell,
+    uint32_t seq, unsigned int timeout);
+
+#endif
@@ -25,6 +25,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stdint.h>
 
 typedef struct stFrameBuffer FrameBuffer;
+typedef struct FrameBufferReader FrameBufferReader;
 
 typedef bool (*FrameBufferReadFn)(void * opaque, const void * src, size_t size);
 
@@ -44,6 +45,34 @@ void framebuffer_wait(const FrameBuffer * frame, size_t size);
 bool framebuffer_read(const FrameBuffer * frame, void * dst, size_t dstpitch,
     size_t height, size_t width, size_t bpp, size_t pitch);
 
+/**
+ * Read a rectangle of the KVMFRFrame into the same position in the dst buffer
+ */
+bool framebuffer_read_rect(const FrameBuffer * frame, void * dst,
+    size_t dstpitch, size_t x, size_t y, size_t width, size_t height,
+    size_t bpp, size_t pitch);
+
+/**
+ * Create a pool of threads to split framebuffer reads across
+ * If threads is zero a count suitable for the system is chosen
+ */
+bool framebuffer_reader_init(FrameBufferReader ** reader, unsigned int threads);
+
+/**
+ * Stop and free the reader threads
+ */
+void framebuffer_reader_free(FrameBufferReader ** reader);
+
+/**
+ * Read data from the KVMFRFrame into the dst buffer, split into row bands
+ * across the reader threads. Each band waits for its own data to arrive and
+ * the call returns once all bands are complete. The dst buffer must be
+ * writable from any thread. A NULL reader falls back to framebuffer_read.
+ */
+bool framebuffer_read_mt(FrameBufferReader * reader, const FrameBuffer * frame,
+    void * dst, size_t dstpitch, size_t height, size_t width, size_t bpp,
+    size_t pitch);
+
 /**
  * Read data from the KVMFRFrame using a callback
  */
@@ -60,4 +89,15 @@ void framebuffer_prepare(FrameBuffer * frame);
  */
 bool framebuffer_write(FrameBuffer * frame, const void * src, size_t size);
 
+/**
+ * Gets the underlying data buffer of the framebuffer
+ * For use when the data is written externally, see framebuffer_set_write_ptr
+ */
+uint8_t * framebuffer_get_data(FrameBuffer * frame);
+
+/**
+ * Sets the write pointer of the framebuffer to signal data is available
+ */
+void framebuffer_set_write_ptr(FrameBuffer * frame, size_t size);
+
 #endif
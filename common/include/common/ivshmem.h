@@ -43,4 +43,16 @@ void ivshmemFree(struct IVSHMEM * dev);
 bool ivshmemHasDMA   (struct IVSHMEM * dev);
 int  ivshmemGetDMABuf(struct IVSHMEM * dev, uint64_t offset, uint64_t size);
 
+/* returns a new fd that maps the entire device, or -1 on failure */
+int  ivshmemGetFD    (struct IVSHMEM * dev);
+
+/* ivshmem-doorbell support, the vectors are the doorbell interrupts of each
+ * peer. The peer id is -1 if the device can not be rung or interrupted */
+int  ivshmemGetPeerID(struct IVSHMEM * dev);
+bool ivshmemRing     (struct IVSHMEM * dev, uint16_t peer, uint16_t vector);
+
+/* Linux KVMFR support only, returns an eventfd that is signalled each time
+ * another peer rings the vector, or -1 if the device has no such vector */
+int  ivshmemGetEventFD(struct IVSHMEM * dev, uint16_t vector);
+
 #endif
@@ -0,0 +1,35 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#ifndef _H_LG_COMMON_MUTEX_
+#define _H_LG_COMMON_MUTEX_
+
+#include <stdbool.h>
+
+/* a lock that puts the waiter to sleep, for critical sections that may block
+ * where LG_Lock would spin for the whole time */
+typedef struct LGMutex LGMutex;
+
+LGMutex * lgCreateMutex(void);
+void      lgFreeMutex  (LGMutex * handle);
+bool      lgLockMutex  (LGMutex * handle);
+bool      lgUnlockMutex(LGMutex * handle);
+
+#endif
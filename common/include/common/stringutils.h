@@ -33,4 +33,10 @@ int alloc_sprintf(char ** str, const char * format, ...)
 // Find value in a list separated by delimiter.
 bool str_containsValue(const char * list, char delimiter, const char * value);
 
+// Decode the UTF-8 character at str, assumes the input is valid.
+unsigned int utf8_decode(const char * str);
+
+// Return the length of the UTF-8 character at str, assumes the input is valid.
+unsigned int utf8_advance(const char * str);
+
 #endif
@@ -23,4 +23,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 // returns the page size
 long sysinfo_getPageSize();
 
+// returns the number of online processors
+int sysinfo_getCPUCount();
+
 #endif
@@ -20,6 +20,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef _LG_TYPES_H_
 #define _LG_TYPES_H_
 
+#include <stdint.h>
+
 struct Point
 {
   int x, y;
@@ -62,6 +64,15 @@ FrameRotation;
 
 extern const char * FrameTypeStr[FRAME_TYPE_MAX];
 
+typedef struct FrameDamageRect
+{
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+}
+FrameDamageRect;
+
 typedef enum CursorType
 {
   CURSOR_TYPE_COLOR       ,
@@ -0,0 +1,149 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common/cursor.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+static inline uint32_t mono_pixel(const uint8_t * row, int x, uint32_t set,
+    uint32_t clear)
+{
+  return (row[x / 8] & (0x80 >> (x % 8))) ? set : clear;
+}
+
+static void convert_mono_mask(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch, const bool isAnd)
+{
+  const uint32_t set   = isAnd ? 0xFFFFFFFF : 0x00FFFFFF;
+  const uint32_t clear = isAnd ? 0xFF000000 : 0x00000000;
+
+  const __m128i bitsHi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+  const __m128i bitsLo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+  const __m128i fixed  = _mm_set1_epi32(isAnd ? 0xFF000000 : 0x00FFFFFF);
+  const int     bytes  = width / 8;
+
+  for(int y = 0; y < height; ++y)
+  {
+    const uint8_t * row = src + y * pitch;
+    uint32_t      * out = dst + y * width;
+
+    for(int i = 0; i < bytes; ++i, out += 8)
+    {
+      const __m128i b  = _mm_set1_epi32(row[i]);
+      const __m128i hi = _mm_cmpeq_epi32(_mm_and_si128(b, bitsHi), bitsHi);
+      const __m128i lo = _mm_cmpeq_epi32(_mm_and_si128(b, bitsLo), bitsLo);
+
+      if (isAnd)
+      {
+        _mm_storeu_si128((__m128i *)out    , _mm_or_si128(hi, fixed));
+        _mm_storeu_si128((__m128i *)out + 1, _mm_or_si128(lo, fixed));
+      }
+      else
+      {
+        _mm_storeu_si128((__m128i *)out    , _mm_and_si128(hi, fixed));
+        _mm_storeu_si128((__m128i *)out + 1, _mm_and_si128(lo, fixed));
+      }
+    }
+
+    for(int x = bytes * 8; x < width; ++x)
+      *out++ = mono_pixel(row, x, set, clear);
+  }
+}
+
+void cursor_convert_mono(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch)
+{
+  const int half = height / 2;
+  convert_mono_mask(dst, src, width, half, pitch, true);
+  convert_mono_mask(dst + width * half, src + pitch * half, width, half, pitch,
+      false);
+}
+
+void cursor_convert_masked(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch)
+{
+  const __m128i alpha = _mm_set1_epi32(0xFF000000);
+  const __m128i color = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i zero  = _mm_setzero_si128();
+  const int     vec   = width & ~3;
+
+  for(int y = 0; y < height; ++y)
+  {
+    const uint32_t * in  = (const uint32_t *)(src + y * pitch);
+    uint32_t       * out = dst + y * width;
+
+    int x = 0;
+    for(; x < vec; x += 4)
+    {
+      const __m128i c = _mm_loadu_si128((const __m128i *)(in + x));
+      const __m128i z = _mm_cmpeq_epi32(_mm_and_si128(c, alpha), zero);
+      _mm_storeu_si128((__m128i *)(out + x), _mm_or_si128(
+            _mm_and_si128(c, color),
+            _mm_and_si128(z, alpha)));
+    }
+
+    for(; x < width; ++x)
+    {
+      const uint32_t c = in[x];
+      out[x] = (c & 0x00FFFFFF) | ((c & 0xFF000000) ? 0 : 0xFF000000);
+    }
+  }
+}
+
+void cursor_convert_color(uint32_t * dst, const uint8_t * src, int width,
+    int height, int pitch)
+{
+  if (pitch == width * 4)
+  {
+    memcpy(dst, src, (size_t)height * pitch);
+    return;
+  }
+
+  for(int y = 0; y < height; ++y)
+    memcpy(dst + y * width, src + y * pitch, width * 4);
+}
+
+uint64_t cursor_hash(int type, int width, int height, int pitch,
+    const uint8_t * data)
+{
+  uint64_t hash = FNV_OFFSET;
+  hash = (hash ^ (uint64_t)type  ) * FNV_PRIME;
+  hash = (hash ^ (uint64_t)width ) * FNV_PRIME;
+  hash = (hash ^ (uint64_t)height) * FNV_PRIME;
+  hash = (hash ^ (uint64_t)pitch ) * FNV_PRIME;
+
+  const size_t size  = (size_t)height * pitch;
+  const size_t words = size / sizeof(uint64_t);
+  for(size_t i = 0; i < words; ++i)
+  {
+    uint64_t word;
+    memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+
+  for(size_t i = words * sizeof(uint64_t); i < size; ++i)
+    hash = (hash ^ data[i]) * FNV_PRIME;
+
+  return hash;
+}
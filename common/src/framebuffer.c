@@ -19,6 +19,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "common/framebuffer.h"
 #include "common/debug.h"
+#include "common/event.h"
+#include "common/thread.h"
+#include "common/sysinfo.h"
 
 #include <string.h>
 #include <stdatomic.h>
@@ -51,33 +54,40 @@ void framebuffer_wait(const FrameBuffer * frame, size_t size)
   }
 }
 
-bool framebuffer_read(const FrameBuffer * frame, void * restrict dst,
-    size_t dstpitch, size_t height, size_t width, size_t bpp, size_t pitch)
+/* copy linewidth bytes starting offset bytes into each of the rows [y, end)
+ * waiting for each row to be written, the wait only times out if the writer
+ * stops making progress */
+static bool framebuffer_read_rows(const FrameBuffer * frame,
+    uint8_t * restrict d, size_t dstpitch, size_t y, size_t end,
+    size_t offset, size_t linewidth, size_t pitch)
 {
-  uint8_t * restrict d     = (uint8_t*)dst;
-  uint_least32_t rp        = 0;
-  size_t         y         = 0;
-  const size_t   linewidth = width * bpp;
+  uint_least32_t rp = y * pitch + offset;
 
-  while(y < height)
+  while(y < end)
   {
     uint_least32_t wp;
     int spinCount = 0;
 
     /* spinlock */
     wp = atomic_load_explicit(&frame->wp, memory_order_acquire);
-    while(wp - rp < linewidth)
+    while(wp < rp + linewidth)
     {
       if (++spinCount == FB_SPIN_LIMIT)
         return false;
 
       usleep(1);
+      const uint_least32_t last = wp;
       wp = atomic_load_explicit(&frame->wp, memory_order_acquire);
+      if (wp != last)
+        spinCount = 0;
     }
 
-    /* copy any unaligned bytes */
+    /* copy any bytes before the first 16 byte boundary */
     const uint8_t * src = frame->data + rp;
-    const size_t unaligned = (uintptr_t)src & 0xF;
+    size_t unaligned = (16 - ((uintptr_t)src & 0xF)) & 0xF;
+    if (unaligned > linewidth)
+      unaligned = linewidth;
+
     if (unaligned)
     {
       memcpy(d, src, unaligned);
@@ -122,6 +132,203 @@ bool framebuffer_read(const FrameBuffer * frame, void * restrict dst,
   return true;
 }
 
+bool framebuffer_read(const FrameBuffer * frame, void * restrict dst,
+    size_t dstpitch, size_t height, size_t width, size_t bpp, size_t pitch)
+{
+  return framebuffer_read_rows(frame, (uint8_t *)dst, dstpitch, 0, height,
+      0, width * bpp, pitch);
+}
+
+bool framebuffer_read_rect(const FrameBuffer * frame, void * restrict dst,
+    size_t dstpitch, size_t x, size_t y, size_t width, size_t height,
+    size_t bpp, size_t pitch)
+{
+  return framebuffer_read_rows(frame,
+      (uint8_t *)dst + y * dstpitch + x * bpp, dstpitch,
+      y, y + height, x * bpp, width * bpp, pitch);
+}
+
+struct FrameBufferWorker
+{
+  FrameBufferReader * reader;
+  unsigned int        index;
+  LGEvent           * start;
+  LGThread          * thread;
+};
+
+struct FrameBufferReader
+{
+  unsigned int               bands; // the caller reads the first band
+  struct FrameBufferWorker * workers;
+  bool                       running;
+  atomic_int                 pending;
+  atomic_bool                failed;
+  LGEvent                  * done;
+
+  // the read in progress
+  const FrameBuffer * frame;
+  uint8_t           * dst;
+  size_t              dstpitch, height, linewidth, pitch;
+};
+
+static bool framebuffer_read_band(FrameBufferReader * reader,
+    unsigned int band)
+{
+  const size_t rows = (reader->height + reader->bands - 1) / reader->bands;
+  const size_t y    = band * rows;
+  if (y >= reader->height)
+    return true;
+
+  const size_t end = y + rows < reader->height ? y + rows : reader->height;
+  return framebuffer_read_rows(reader->frame,
+      reader->dst + y * reader->dstpitch, reader->dstpitch,
+      y, end, 0, reader->linewidth, reader->pitch);
+}
+
+static int framebuffer_worker(void * opaque)
+{
+  struct FrameBufferWorker * worker = (struct FrameBufferWorker *)opaque;
+  FrameBufferReader        * reader = worker->reader;
+
+  for(;;)
+  {
+    lgWaitEvent(worker->start, TIMEOUT_INFINITE);
+    if (!reader->running)
+      break;
+
+    if (!framebuffer_read_band(reader, worker->index))
+      atomic_store(&reader->failed, true);
+
+    if (atomic_fetch_sub(&reader->pending, 1) == 1)
+      lgSignalEvent(reader->done);
+  }
+
+  return 0;
+}
+
+bool framebuffer_reader_init(FrameBufferReader ** reader, unsigned int threads)
+{
+  if (!threads)
+  {
+    /* the copy is memory bound so more than a few threads will not help */
+    threads = sysinfo_getCPUCount() / 2;
+    if (threads > 4)
+      threads = 4;
+    if (threads < 1)
+      threads = 1;
+  }
+
+  *reader = (FrameBufferReader *)calloc(1, sizeof(FrameBufferReader));
+  if (!*reader)
+  {
+    DEBUG_ERROR("Failed to allocate the FrameBufferReader");
+    return false;
+  }
+
+  FrameBufferReader * r = *reader;
+  r->bands   = threads;
+  r->running = true;
+  if (threads == 1)
+    return true;
+
+  if (!(r->done = lgCreateEvent(true, 0)))
+  {
+    DEBUG_ERROR("Failed to create the done event");
+    goto fail;
+  }
+
+  r->workers = (struct FrameBufferWorker *)calloc(threads - 1,
+      sizeof(struct FrameBufferWorker));
+  if (!r->workers)
+  {
+    DEBUG_ERROR("Failed to allocate the workers");
+    goto fail;
+  }
+
+  for(unsigned int i = 0; i < threads - 1; ++i)
+  {
+    struct FrameBufferWorker * w = &r->workers[i];
+    w->reader = r;
+    w->index  = i + 1;
+
+    if (!(w->start = lgCreateEvent(true, 0)))
+    {
+      DEBUG_ERROR("Failed to create the worker start event");
+      goto fail;
+    }
+
+    if (!lgCreateThread("FrameBufferReader", framebuffer_worker, w,
+          &w->thread))
+    {
+      DEBUG_ERROR("Failed to create the worker thread");
+      goto fail;
+    }
+  }
+
+  DEBUG_INFO("Frame buffer reads split across %u threads", threads);
+  return true;
+
+fail:
+  framebuffer_reader_free(reader);
+  return false;
+}
+
+void framebuffer_reader_free(FrameBufferReader ** reader)
+{
+  FrameBufferReader * r = *reader;
+  if (!r)
+    return;
+
+  r->running = false;
+  if (r->workers)
+  {
+    for(unsigned int i = 0; i < r->bands - 1; ++i)
+    {
+      struct FrameBufferWorker * w = &r->workers[i];
+      if (w->thread)
+      {
+        lgSignalEvent(w->start);
+        lgJoinThread(w->thread, NULL);
+      }
+
+      if (w->start)
+        lgFreeEvent(w->start);
+    }
+    free(r->workers);
+  }
+
+  if (r->done)
+    lgFreeEvent(r->done);
+
+  free(r);
+  *reader = NULL;
+}
+
+bool framebuffer_read_mt(FrameBufferReader * reader, const FrameBuffer * frame,
+    void * dst, size_t dstpitch, size_t height, size_t width, size_t bpp,
+    size_t pitch)
+{
+  if (!reader || reader->bands == 1 || height < reader->bands)
+    return framebuffer_read(frame, dst, dstpitch, height, width, bpp, pitch);
+
+  reader->frame     = frame;
+  reader->dst       = (uint8_t *)dst;
+  reader->dstpitch  = dstpitch;
+  reader->height    = height;
+  reader->linewidth = width * bpp;
+  reader->pitch     = pitch;
+  atomic_store(&reader->failed , false);
+  atomic_store(&reader->pending, reader->bands - 1);
+
+  for(unsigned int i = 0; i < reader->bands - 1; ++i)
+    lgSignalEvent(reader->workers[i].start);
+
+  const bool ok = framebuffer_read_band(reader, 0);
+  lgWaitEvent(reader->done, TIMEOUT_INFINITE);
+
+  return ok && !atomic_load(&reader->failed);
+}
+
 bool framebuffer_read_fn(const FrameBuffer * frame, size_t height, size_t width,
     size_t bpp, size_t pitch, FrameBufferReadFn fn, void * opaque)
 {
@@ -204,3 +411,13 @@ bool framebuffer_write(FrameBuffer * frame, const void * restrict src, size_t si
   atomic_store_explicit(&frame->wp, wp, memory_order_release);
   return true;
 }
+
+uint8_t * framebuffer_get_data(FrameBuffer * frame)
+{
+  return frame->data;
+}
+
+void framebuffer_set_write_ptr(FrameBuffer * frame, size_t size)
+{
+  atomic_store_explicit(&frame->wp, size, memory_order_release);
+}
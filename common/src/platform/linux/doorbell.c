@@ -0,0 +1,245 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common/doorbell.h"
+#include "common/debug.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* a peer slot is stale once its client has not waited for this long, well
+ * beyond the longest timeout a client waits on the doorbell with */
+#define DOORBELL_STALE_TIME 1000 // ms
+
+static bool getBootID(char * id, size_t size)
+{
+  FILE * fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+  if (!fp)
+    return false;
+
+  memset(id, 0, size);
+  const bool ok = fgets(id, size, fp) != NULL;
+  fclose(fp);
+  return ok;
+}
+
+/* the memory is shared between processes so the futex can not be private */
+static long futex(atomic_uint_least32_t * addr, int op, uint32_t val,
+    const struct timespec * timeout)
+{
+  return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+void doorbellInit(KVMFRDoorbell * db)
+{
+  if (!getBootID(db->bootID, sizeof(db->bootID)))
+  {
+    DEBUG_WARN("Unable to read the boot id, the doorbell will not be used");
+    memset(db->bootID, 0, sizeof(db->bootID));
+  }
+
+  for(int i = 0; i < KVMFR_DOORBELL_MAX; ++i)
+  {
+    atomic_store(&db->seq    [i], 0);
+    atomic_store(&db->waiters[i], 0);
+  }
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    atomic_store(&db->peers[i], 0);
+    atomic_store(&db->alive[i], 0);
+  }
+}
+
+bool doorbellIsLocal(const KVMFRDoorbell * db)
+{
+  char id[sizeof(db->bootID)];
+  if (!db->bootID[0] || !getBootID(id, sizeof(id)))
+    return false;
+
+  return memcmp(id, db->bootID, sizeof(id)) == 0;
+}
+
+bool doorbellRegister(KVMFRDoorbell * db, struct IVSHMEM * dev)
+{
+  const int id = ivshmemGetPeerID(dev);
+  if (id < 0)
+    return false;
+
+  for(int i = 0; i < KVMFR_DOORBELL_MAX; ++i)
+    if (ivshmemGetEventFD(dev, i) < 0)
+      return false;
+
+  /* the slot is kept if we are still registered from before a restart */
+  const uint32_t peer = id + 1;
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+    if (atomic_load(&db->peers[i]) == peer)
+      return true;
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    uint32_t expected = 0;
+    if (atomic_compare_exchange_strong(&db->peers[i], &expected, peer))
+      return true;
+  }
+
+  /* a client that was killed never releases its slot, take over the first
+   * slot whose client did not wait on the doorbell while we watched */
+  uint32_t alive[KVMFR_DOORBELL_PEERS];
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+    alive[i] = atomic_load(&db->alive[i]);
+
+  const struct timespec ts =
+  {
+    .tv_sec  = DOORBELL_STALE_TIME / 1000,
+    .tv_nsec = (DOORBELL_STALE_TIME % 1000) * 1000000L
+  };
+  nanosleep(&ts, NULL);
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    uint32_t expected = atomic_load(&db->peers[i]);
+    if (atomic_load(&db->alive[i]) != alive[i])
+      continue;
+
+    if (atomic_compare_exchange_strong(&db->peers[i], &expected, peer))
+    {
+      DEBUG_INFO("Reclaimed a stale doorbell peer slot from peer %d",
+          (int)expected - 1);
+      return true;
+    }
+  }
+
+  DEBUG_WARN("No free doorbell peer slots");
+  return false;
+}
+
+/* let the host know we are still alive, the slot is taken back if another
+ * client reclaimed it while we were stalled */
+static void touchPeer(KVMFRDoorbell * db, struct IVSHMEM * dev)
+{
+  const int id = ivshmemGetPeerID(dev);
+  if (id < 0)
+    return;
+
+  const uint32_t peer = id + 1;
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+    if (atomic_load_explicit(&db->peers[i], memory_order_relaxed) == peer)
+    {
+      atomic_fetch_add_explicit(&db->alive[i], 1, memory_order_relaxed);
+      return;
+    }
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    uint32_t expected = 0;
+    if (atomic_compare_exchange_strong(&db->peers[i], &expected, peer))
+      return;
+  }
+}
+
+void doorbellUnregister(KVMFRDoorbell * db, struct IVSHMEM * dev)
+{
+  const int id = ivshmemGetPeerID(dev);
+  if (id < 0)
+    return;
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    uint32_t expected = id + 1;
+    atomic_compare_exchange_strong(&db->peers[i], &expected, 0);
+  }
+}
+
+void doorbellRing(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell)
+{
+  atomic_fetch_add_explicit(&db->seq[bell], 1, memory_order_seq_cst);
+  if (!atomic_load_explicit(&db->waiters[bell], memory_order_seq_cst))
+    return;
+
+  futex(&db->seq[bell], FUTEX_WAKE, INT_MAX, NULL);
+
+  /* clients in other VMs can only be woken by an interrupt */
+  if (dev)
+    for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+    {
+      const uint32_t peer =
+        atomic_load_explicit(&db->peers[i], memory_order_relaxed);
+      if (peer)
+        ivshmemRing(dev, peer - 1, bell);
+    }
+}
+
+uint32_t doorbellGetSeq(KVMFRDoorbell * db, int bell)
+{
+  return atomic_load_explicit(&db->seq[bell], memory_order_acquire);
+}
+
+/* an interrupt that arrived while we were not waiting leaves the eventfd
+ * readable, which only causes a spurious wake up */
+static bool waitEventFD(int fd, unsigned int timeout)
+{
+  struct pollfd pfd =
+  {
+    .fd     = fd,
+    .events = POLLIN
+  };
+
+  if (poll(&pfd, 1, (timeout + 999) / 1000) <= 0)
+    return false;
+
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    DEBUG_ERROR("Failed to read the doorbell eventfd: %s", strerror(errno));
+  return true;
+}
+
+bool doorbellWait(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell,
+    uint32_t seq, unsigned int timeout)
+{
+  const struct timespec ts =
+  {
+    .tv_sec  = timeout / 1000000,
+    .tv_nsec = (timeout % 1000000) * 1000
+  };
+
+  if (dev)
+    touchPeer(db, dev);
+
+  atomic_fetch_add_explicit(&db->waiters[bell], 1, memory_order_seq_cst);
+  bool woken = true;
+  if (atomic_load_explicit(&db->seq[bell], memory_order_seq_cst) == seq)
+  {
+    if (dev)
+      woken = waitEventFD(ivshmemGetEventFD(dev, bell), timeout);
+    else
+      woken = !(futex(&db->seq[bell], FUTEX_WAIT, seq, &ts) < 0 &&
+          errno == ETIMEDOUT);
+  }
+  atomic_fetch_sub_explicit(&db->waiters[bell], 1, memory_order_seq_cst);
+
+  return woken;
+}
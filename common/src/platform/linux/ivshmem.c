@@ -26,6 +26,10 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <linux/magic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -35,11 +39,32 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/stringutils.h"
 #include "module/kvmfr.h"
 
+#define IVSHMEM_MAX_VECTORS 8
+
 struct IVSHMEMInfo
 {
   int  devFd;
   int  size;
   bool hasDMA;
+  bool locked;
+  long minFlt, majFlt;
+  int  eventFd[IVSHMEM_MAX_VECTORS];
+  int  peerID;
+};
+
+struct IVSHMEMParams
+{
+  bool prefault;
+  bool hugePages;
+  bool lock;
+};
+
+// defaults for callers that do not register the options (ie, obs)
+static struct IVSHMEMParams params =
+{
+  .prefault  = false,
+  .hugePages = false,
+  .lock      = false
 };
 
 static bool ivshmemDeviceValidator(struct Option * opt, const char ** error)
@@ -96,6 +121,27 @@ void ivshmemOptionsInit(void)
       .validator      = ivshmemDeviceValidator,
       .getValues      = ivshmemDeviceGetValues
     },
+    {
+      .module         = "app",
+      .name           = "shmPrefault",
+      .description    = "Fault in the entire shared memory mapping when it is opened",
+      .type           = OPTION_TYPE_BOOL,
+      .value.x_bool   = false
+    },
+    {
+      .module         = "app",
+      .name           = "shmHugePages",
+      .description    = "Request transparent huge pages for the shared memory mapping",
+      .type           = OPTION_TYPE_BOOL,
+      .value.x_bool   = false
+    },
+    {
+      .module         = "app",
+      .name           = "shmLock",
+      .description    = "Lock the shared memory mapping into RAM (mlock)",
+      .type           = OPTION_TYPE_BOOL,
+      .value.x_bool   = false
+    },
     {0}
   };
 
@@ -110,6 +156,9 @@ bool ivshmemInit(struct IVSHMEM * dev)
 
 bool ivshmemOpen(struct IVSHMEM * dev)
 {
+  params.prefault  = option_get_bool("app", "shmPrefault" );
+  params.hugePages = option_get_bool("app", "shmHugePages");
+  params.lock      = option_get_bool("app", "shmLock"     );
   return ivshmemOpenDev(dev, option_get_string("app", "shmFile"));
 }
 
@@ -120,6 +169,7 @@ bool ivshmemOpenDev(struct IVSHMEM * dev, const char * shmDevice)
   unsigned int devSize;
   int devFd = -1;
   bool hasDMA;
+  bool hugeTLB = false;
 
   dev->opaque = NULL;
 
@@ -158,22 +208,76 @@ bool ivshmemOpenDev(struct IVSHMEM * dev, const char * shmDevice)
       return false;
     }
 
+    // files on hugetlbfs (ie, /dev/hugepages) are backed by huge pages already
+    struct statfs sfs;
+    if (fstatfs(devFd, &sfs) == 0 && sfs.f_type == HUGETLBFS_MAGIC)
+      hugeTLB = true;
+
     hasDMA = false;
   }
 
-  void * map = mmap(0, devSize, PROT_READ | PROT_WRITE, MAP_SHARED, devFd, 0);
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  int flags = MAP_SHARED;
+  if (params.prefault)
+    flags |= MAP_POPULATE;
+
+  void * map = mmap(0, devSize, PROT_READ | PROT_WRITE, flags, devFd, 0);
   if (map == MAP_FAILED)
   {
     DEBUG_ERROR("Failed to map the shared memory device: %s", shmDevice);
     DEBUG_ERROR("%s", strerror(errno));
+    close(devFd);
     return false;
   }
 
+  if (hugeTLB)
+    DEBUG_INFO("KVMFR Huge Pages : hugetlbfs");
+  else if (params.hugePages)
+  {
+    // only effective for shmem if transparent_hugepage/shmem_enabled allows it
+    if (madvise(map, devSize, MADV_HUGEPAGE) != 0)
+      DEBUG_WARN("madvise(MADV_HUGEPAGE) failed: %s", strerror(errno));
+    else
+      DEBUG_INFO("KVMFR Huge Pages : transparent");
+  }
+
+  // MAP_POPULATE is ignored for PFN mapped device memory, touch each page
+  if (params.prefault && hasDMA)
+  {
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for(unsigned int i = 0; i < devSize; i += pageSize)
+      (void)*(volatile uint8_t *)((uint8_t *)map + i);
+  }
+
+  bool locked = false;
+  if (params.lock)
+  {
+    if (mlock(map, devSize) != 0)
+    {
+      DEBUG_WARN("Failed to lock the shared memory: %s", strerror(errno));
+      DEBUG_WARN("Check the memlock limit (ulimit -l)");
+    }
+    else
+      locked = true;
+  }
+
   struct IVSHMEMInfo * info =
     (struct IVSHMEMInfo *)malloc(sizeof(struct IVSHMEMInfo));
   info->size   = devSize;
   info->devFd  = devFd;
   info->hasDMA = hasDMA;
+  info->locked = locked;
+  info->minFlt = ru.ru_minflt;
+  info->majFlt = ru.ru_majflt;
+  for(int i = 0; i < IVSHMEM_MAX_VECTORS; ++i)
+    info->eventFd[i] = -1;
+  info->peerID = -1;
+
+  getrusage(RUSAGE_SELF, &ru);
+  DEBUG_INFO("KVMFR Map Faults : %ld minor, %ld major",
+      ru.ru_minflt - info->minFlt, ru.ru_majflt - info->majFlt);
 
   dev->opaque = info;
   dev->size   = devSize;
@@ -191,8 +295,21 @@ void ivshmemClose(struct IVSHMEM * dev)
   struct IVSHMEMInfo * info =
     (struct IVSHMEMInfo *)dev->opaque;
 
+  // process wide, but the shared memory is by far the largest contributor
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  DEBUG_INFO("Page faults while the shared memory was open: %ld minor, %ld major",
+      ru.ru_minflt - info->minFlt, ru.ru_majflt - info->majFlt);
+
+  if (info->locked)
+    munlock(dev->mem, info->size);
+
   munmap(dev->mem, info->size);
+  // the module releases the eventfds registered through this fd
   close(info->devFd);
+  for(int i = 0; i < IVSHMEM_MAX_VECTORS; ++i)
+    if (info->eventFd[i] >= 0)
+      close(info->eventFd[i]);
 
   free(info);
   dev->mem    = NULL;
@@ -240,3 +357,109 @@ int ivshmemGetDMABuf(struct IVSHMEM * dev, uint64_t offset, uint64_t size)
 
   return fd;
 }
+
+int ivshmemGetFD(struct IVSHMEM * dev)
+{
+  assert(dev && dev->opaque);
+
+  struct IVSHMEMInfo * info =
+    (struct IVSHMEMInfo *)dev->opaque;
+
+  if (!info->hasDMA)
+  {
+    int fd = fcntl(info->devFd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+      DEBUG_ERROR("Failed to duplicate the shared memory fd: %s", strerror(errno));
+    return fd;
+  }
+
+  // the device itself can not be mapped by size, export it as a dma buffer
+  const struct kvmfr_dmabuf_create create =
+  {
+    .flags  = KVMFR_DMABUF_FLAG_CLOEXEC,
+    .offset = 0,
+    .size   = info->size
+  };
+
+  int fd = ioctl(info->devFd, KVMFR_DMABUF_CREATE, &create);
+  if (fd < 0)
+    DEBUG_ERROR("Failed to create the dma buffer");
+
+  return fd;
+}
+
+int ivshmemGetPeerID(struct IVSHMEM * dev)
+{
+  assert(dev && dev->opaque);
+
+  struct IVSHMEMInfo * info =
+    (struct IVSHMEMInfo *)dev->opaque;
+
+  if (!info->hasDMA)
+    return -1;
+
+  // the id is fixed for as long as the device exists, only query it once
+  if (info->peerID < 0)
+  {
+    const int id = ioctl(info->devFd, KVMFR_DOORBELL_GETID, 0);
+    info->peerID = id < 0 ? -1 : id;
+  }
+
+  return info->peerID;
+}
+
+bool ivshmemRing(struct IVSHMEM * dev, uint16_t peer, uint16_t vector)
+{
+  assert(dev && dev->opaque);
+
+  struct IVSHMEMInfo * info =
+    (struct IVSHMEMInfo *)dev->opaque;
+
+  if (!info->hasDMA)
+    return false;
+
+  const struct kvmfr_doorbell_ring ring =
+  {
+    .peer   = peer,
+    .vector = vector
+  };
+
+  return ioctl(info->devFd, KVMFR_DOORBELL_RING, &ring) == 0;
+}
+
+int ivshmemGetEventFD(struct IVSHMEM * dev, uint16_t vector)
+{
+  assert(dev && dev->opaque);
+
+  struct IVSHMEMInfo * info =
+    (struct IVSHMEMInfo *)dev->opaque;
+
+  if (!info->hasDMA || vector >= IVSHMEM_MAX_VECTORS)
+    return -1;
+
+  if (info->eventFd[vector] >= 0)
+    return info->eventFd[vector];
+
+  int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd < 0)
+  {
+    DEBUG_ERROR("Failed to create the eventfd: %s", strerror(errno));
+    return -1;
+  }
+
+  const struct kvmfr_doorbell_eventfd req =
+  {
+    .vector = vector,
+    .fd     = fd
+  };
+
+  // fails for static devices and ivshmem-plain, which have no vectors
+  if (ioctl(info->devFd, KVMFR_DOORBELL_EVENTFD, &req) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  info->eventFd[vector] = fd;
+  return fd;
+}
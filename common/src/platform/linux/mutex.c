@@ -0,0 +1,84 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include "common/mutex.h"
+#include "common/debug.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+struct LGMutex
+{
+  pthread_mutex_t mutex;
+};
+
+LGMutex * lgCreateMutex(void)
+{
+  LGMutex * handle = (LGMutex *)calloc(sizeof(LGMutex), 1);
+  if (!handle)
+  {
+    DEBUG_ERROR("Failed to allocate memory");
+    return NULL;
+  }
+
+  if (pthread_mutex_init(&handle->mutex, NULL) != 0)
+  {
+    DEBUG_ERROR("Failed to create the mutex");
+    free(handle);
+    return NULL;
+  }
+
+  return handle;
+}
+
+void lgFreeMutex(LGMutex * handle)
+{
+  assert(handle);
+
+  pthread_mutex_destroy(&handle->mutex);
+  free(handle);
+}
+
+bool lgLockMutex(LGMutex * handle)
+{
+  assert(handle);
+
+  if (pthread_mutex_lock(&handle->mutex) != 0)
+  {
+    DEBUG_ERROR("Failed to lock the mutex");
+    return false;
+  }
+
+  return true;
+}
+
+bool lgUnlockMutex(LGMutex * handle)
+{
+  assert(handle);
+
+  if (pthread_mutex_unlock(&handle->mutex) != 0)
+  {
+    DEBUG_ERROR("Failed to unlock the mutex");
+    return false;
+  }
+
+  return true;
+}
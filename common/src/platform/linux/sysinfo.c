@@ -23,3 +23,9 @@ long sysinfo_getPageSize(void)
 {
   return sysconf(_SC_PAGESIZE);
 }
+
+int sysinfo_getCPUCount(void)
+{
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? count : 1;
+}
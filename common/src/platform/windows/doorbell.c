@@ -0,0 +1,84 @@
+/*
+Looking Glass - KVM FrameRelay (KVMFR) Client
+Copyright (C) 2017-2021 Geoffrey McRae <geoff@hostfission.com>
+https://looking-glass.hostfission.com
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common/doorbell.h"
+
+#include <string.h>
+#include <windows.h>
+
+/* the doorbell is a futex which can not be shared with a Windows host, the
+ * sequence is still maintained so clients can detect posts and clients in
+ * other VMs are interrupted through the ivshmem device */
+
+void doorbellInit(KVMFRDoorbell * db)
+{
+  memset(db->bootID, 0, sizeof(db->bootID));
+  for(int i = 0; i < KVMFR_DOORBELL_MAX; ++i)
+  {
+    atomic_store(&db->seq    [i], 0);
+    atomic_store(&db->waiters[i], 0);
+  }
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    atomic_store(&db->peers[i], 0);
+    atomic_store(&db->alive[i], 0);
+  }
+}
+
+bool doorbellIsLocal(const KVMFRDoorbell * db)
+{
+  return false;
+}
+
+bool doorbellRegister(KVMFRDoorbell * db, struct IVSHMEM * dev)
+{
+  return false;
+}
+
+void doorbellUnregister(KVMFRDoorbell * db, struct IVSHMEM * dev)
+{
+}
+
+void doorbellRing(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell)
+{
+  atomic_fetch_add_explicit(&db->seq[bell], 1, memory_order_seq_cst);
+  if (!dev || !atomic_load_explicit(&db->waiters[bell], memory_order_seq_cst))
+    return;
+
+  for(int i = 0; i < KVMFR_DOORBELL_PEERS; ++i)
+  {
+    const uint32_t peer =
+      atomic_load_explicit(&db->peers[i], memory_order_relaxed);
+    if (peer)
+      ivshmemRing(dev, peer - 1, bell);
+  }
+}
+
+uint32_t doorbellGetSeq(KVMFRDoorbell * db, int bell)
+{
+  return atomic_load_explicit(&db->seq[bell], memory_order_acquire);
+}
+
+bool doorbellWait(KVMFRDoorbell * db, struct IVSHMEM * dev, int bell,
+    uint32_t seq, unsigned int timeout)
+{
+  Sleep(timeout / 1000);
+  return doorbellGetSeq(db, bell) != seq;
+}
@@ -30,7 +30,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 struct IVSHMEMInfo
 {
-  HANDLE handle;
+  HANDLE         handle;
+  IVSHMEM_PEERID peerID;
+  UINT16         vectors;
 };
 
 void ivshmemOptionsInit(void)
@@ -107,10 +109,12 @@ bool ivshmemInit(struct IVSHMEM * dev)
   struct IVSHMEMInfo * info =
     (struct IVSHMEMInfo *)malloc(sizeof(struct IVSHMEMInfo));
 
-  info->handle = handle;
-  dev->opaque  = info;
-  dev->size    = 0;
-  dev->mem     = NULL;
+  info->handle  = handle;
+  info->peerID  = 0;
+  info->vectors = 0;
+  dev->opaque   = info;
+  dev->size     = 0;
+  dev->mem      = NULL;
 
   return true;
 }
@@ -141,6 +145,9 @@ bool ivshmemOpen(struct IVSHMEM * dev)
     return false;
   }
 
+  info->peerID  = map.peerID;
+  info->vectors = map.vectors;
+
   dev->size   = (unsigned int)size;
   dev->mem    = map.ptr;
   return true;
@@ -168,3 +175,37 @@ void ivshmemFree(struct IVSHMEM * dev)
   free(info);
   dev->opaque = NULL;
 }
+
+int ivshmemGetPeerID(struct IVSHMEM * dev)
+{
+  assert(dev && dev->opaque && dev->mem);
+
+  struct IVSHMEMInfo * info = (struct IVSHMEMInfo *)dev->opaque;
+
+  // ivshmem-plain devices have no interrupts
+  return info->vectors ? info->peerID : -1;
+}
+
+bool ivshmemRing(struct IVSHMEM * dev, uint16_t peer, uint16_t vector)
+{
+  assert(dev && dev->opaque && dev->mem);
+
+  struct IVSHMEMInfo * info = (struct IVSHMEMInfo *)dev->opaque;
+  if (!info->vectors)
+    return false;
+
+  IVSHMEM_RING ring =
+  {
+    .peerID = peer,
+    .vector = vector
+  };
+
+  if (!DeviceIoControl(info->handle, IOCTL_IVSHMEM_RING_DOORBELL, &ring,
+        sizeof(IVSHMEM_RING), NULL, 0, NULL, NULL))
+  {
+    DEBUG_WINERROR("DeviceIoControl Failed", GetLastError());
+    return false;
+  }
+
+  return true;
+}
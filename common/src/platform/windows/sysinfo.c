@@ -30,4 +30,11 @@ long sysinfo_getPageSize(void)
   SYSTEM_INFO si;
   GetSystemInfo(&si);
   return si.dwPageSize;
+}
+
+int sysinfo_getCPUCount(void)
+{
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return si.dwNumberOfProcessors;
 }
\ No newline at end of file
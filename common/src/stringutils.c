@@ -88,3 +88,39 @@ bool str_containsValue(const char * list, char delimiter, const char * value)
   }
   return false;
 }
+
+// A very simple UTF-8 decoder that assumes the input is valid.
+unsigned int utf8_decode(const char * str)
+{
+  const unsigned char * ptr = (const unsigned char *) str;
+  // Handle the 4 byte case: 1111 0xxx 10xx xxxx 10xx xxxx 10xx xxxx.
+  if ((*ptr & 0xf8) == 0xf0)
+    return (ptr[0] & 0x07) << 18 | (ptr[1] & 0x3f) << 12 | (ptr[2] & 0x3f) << 6 | (ptr[3] & 0x3f);
+  // Handle the 3 byte case: 1110 xxxx 10xx xxxx 10xx xxxx.
+  else if ((*ptr & 0xf0) == 0xe0)
+    return (ptr[0] & 0x0f) << 12 | (ptr[1] & 0x3f) << 6 | (ptr[2] & 0x3f);
+  // Handle the 2 byte case: 110x xxxx 10xx xxxx.
+  else if ((*ptr & 0xe0) == 0xc0)
+    return (ptr[0] & 0x1f) << 6 | (ptr[1] & 0x3f);
+  // Everything else is the 1 byte case.
+  else
+    return *ptr;
+}
+
+// Return the length of the current UTF-8 character. Assumes the input is valid.
+unsigned int utf8_advance(const char * str)
+{
+  const unsigned char * ptr = (const unsigned char *) str;
+  // 4 byte case starts with 1111 0xxx.
+  if ((*ptr & 0xf8) == 0xf0)
+    return 4;
+  // 3 byte case starts with 1110 xxxx.
+  else if ((*ptr & 0xf0) == 0xe0)
+    return 3;
+  // 2 byte case starts with 110x xxxx.
+  else if ((*ptr & 0xe0) == 0xc0)
+    return 2;
+  // Everything else is the 1 byte case.
+  else
+    return 1;
+}
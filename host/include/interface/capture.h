@@ -22,6 +22,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stdbool.h>
 #include <stdint.h>
 #include "common/framebuffer.h"
+#include "common/KVMFR.h"
+#include "common/ivshmem.h"
 
 typedef enum CaptureResult
 {
@@ -67,6 +69,10 @@ typedef struct CaptureFrame
   unsigned int    stride;
   CaptureFormat   format;
   CaptureRotation rotation;
+
+  // zero if the entire frame has changed
+  unsigned int    damageRectsCount;
+  FrameDamageRect damageRects[KVMFR_MAX_DAMAGE_RECTS];
 }
 CaptureFrame;
 
@@ -98,6 +104,9 @@ typedef struct CaptureInterface
     CapturePostPointerBuffer postPointerBufferFn
   );
 
+  /* optional, called before init with the device frames are written to */
+  void          (*setIVSHMEM     )(struct IVSHMEM * dev);
+
   bool          (*init           )();
   void          (*stop           )();
   bool          (*deinit         )();
@@ -16,36 +16,128 @@ You should have received a copy of the GNU General Public License along with
 this program; if not, write to the Free Software Foundation, Inc., 59 Temple
 Place, Suite 330, Boston, MA 02111-1307 USA
 */
-
 #include "interface/capture.h"
 #include "interface/platform.h"
 #include "common/debug.h"
 #include "common/event.h"
+#include "common/option.h"
+#include "common/time.h"
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <xcb/shm.h>
 #include <xcb/xfixes.h>
+#include <xcb/damage.h>
+#include <xcb/randr.h>
+#include <xcb/composite.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 
+#define min(a,b) ({ __typeof__ (a) _a = (a); __typeof__ (b) _b = (b); _a < _b ? _a : _b; })
+#define max(a,b) ({ __typeof__ (a) _a = (a); __typeof__ (b) _b = (b); _a > _b ? _a : _b; })
+
+// damage accumulated for a buffer since it was last written to
+struct XCBSlot
+{
+  FrameBuffer   * fb;
+  bool            full;
+  unsigned int    count;
+  FrameDamageRect rects[KVMFR_MAX_DAMAGE_RECTS];
+};
+
+typedef enum SegmentState
+{
+  SEGMENT_STATE_UNUSED,
+  SEGMENT_STATE_PENDING
+}
+SegmentState;
+
+struct XCBSegment
+{
+  int         shmID;
+  void      * data;
+  atomic_int  state;
+  uint32_t    seg;
+
+  // the requests writing this frame
+  unsigned int               imgCount;
+  xcb_shm_get_image_cookie_t imgC[KVMFR_MAX_DAMAGE_RECTS];
+
+  // the damage relative to the prior frame
+  unsigned int    damageRectsCount;
+  FrameDamageRect damageRects[KVMFR_MAX_DAMAGE_RECTS];
+
+  // the damage since this segment was last written to
+  struct XCBSlot slot;
+};
+
 struct xcb
 {
   bool               initialized;
+  bool               stop;
+  bool               reinit;
   xcb_connection_t * xcb;
   xcb_screen_t     * xcbScreen;
-  uint32_t           seg;
-  int                shmID;
-  void             * data;
   LGEvent          * frameEvent;
 
+  // the output or window to capture, if not the entire screen
+  const char       * outputName;
+  xcb_window_t       targetWindow;
+
+  xcb_window_t       window;       // the window events are selected on
+  xcb_drawable_t     drawable;     // the drawable images are read from
+  xcb_pixmap_t       pixmap;       // the composite pixmap of targetWindow
+  unsigned int       windowWidth;  // the size of window, to detect resizes
+  unsigned int       windowHeight;
+  int                captureX;     // the frame position in drawable
+  int                captureY;
+  int                originX;      // the frame position in damage/pointer
+  int                originY;      // coordinates
+
+  bool               hasRandR;
+  uint8_t            randrEvent;
+  bool               randrPending;
+
+  struct IVSHMEM   * shm;
+  bool               allowZeroCopy;
+  bool               zeroCopy;
+  uint32_t           shmSeg;
+  struct XCBSlot     slots[KVMFR_FRAME_BUFFERS];
+
+  int                 maxSegments;
+  int                 segCount;
+  struct XCBSegment * segments;
+  int                 segRIndex;
+  int                 segWIndex;
+  atomic_int          segReady;
+
+  CaptureGetPointerBuffer  getPointerBufferFn;
+  CapturePostPointerBuffer postPointerBufferFn;
+
   unsigned int width;
   unsigned int height;
 
-  bool                                 hasFrame;
-  xcb_shm_get_image_cookie_t           imgC;
-  xcb_xfixes_get_cursor_image_cookie_t curC;
+  bool                hasDamage;
+  uint8_t             damageEvent;
+  xcb_damage_damage_t damage;
+  xcb_xfixes_region_t region;
+  bool                damagePending;
+  bool                fullPending;
+
+  // the damage collected for the next frame
+  unsigned int    damageRectsCount;
+  FrameDamageRect damageRects[KVMFR_MAX_DAMAGE_RECTS];
+
+  bool     hasCursor;
+  uint8_t  cursorEvent;
+  bool     cursorPending;
+  uint64_t pointerInterval;
+  uint64_t pointerLast;
+  int      pointerX, pointerY;
+  int      pointerHX, pointerHY;
 };
 
 struct xcb * this = NULL;
@@ -62,12 +154,78 @@ static const char * xcb_getName(void)
   return "XCB";
 }
 
+/* a zero interval would have the pointer thread spin on ppoll */
+#define POINTER_POLL_MIN 1000
+
+static bool xcb_validatePointerPollInterval(struct Option * opt,
+    const char ** error)
+{
+  if (opt->value.x_int < 0)
+  {
+    *error = "The interval can not be negative";
+    return false;
+  }
+
+  if (opt->value.x_int < POINTER_POLL_MIN)
+  {
+    DEBUG_WARN("xcb:pointerPollInterval raised to the minimum of %dus",
+        POINTER_POLL_MIN);
+    opt->value.x_int = POINTER_POLL_MIN;
+  }
+
+  return true;
+}
+
+static void xcb_initOptions(void)
+{
+  struct Option options[] =
+  {
+    {
+      .module         = "xcb",
+      .name           = "pointerPollInterval",
+      .description    = "How often to check the cursor position in microseconds",
+      .type           = OPTION_TYPE_INT,
+      .validator      = xcb_validatePointerPollInterval,
+      .value.x_int    = 1000
+    },
+    {
+      .module         = "xcb",
+      .name           = "zeroCopy",
+      .description    = "Have the X server write frames directly into the shared memory",
+      .type           = OPTION_TYPE_BOOL,
+      .value.x_bool   = true
+    },
+    {
+      .module         = "xcb",
+      .name           = "output",
+      .description    = "The name of the RandR output to capture (ie, HDMI-1), the entire screen if not set",
+      .type           = OPTION_TYPE_STRING,
+      .value.x_string = NULL
+    },
+    {
+      .module         = "xcb",
+      .name           = "window",
+      .description    = "The ID of a window to capture via Composite instead of the screen",
+      .type           = OPTION_TYPE_STRING,
+      .value.x_string = NULL
+    },
+    {
+      .module         = "xcb",
+      .name           = "segments",
+      .description    = "The number of frames to have in flight when not using zero copy",
+      .type           = OPTION_TYPE_INT,
+      .value.x_int    = 2
+    },
+    {0}
+  };
+
+  option_register(options);
+}
+
 static bool xcb_create(CaptureGetPointerBuffer getPointerBufferFn, CapturePostPointerBuffer postPointerBufferFn)
 {
   assert(!this);
   this             = (struct xcb *)calloc(sizeof(struct xcb), 1);
-  this->shmID      = -1;
-  this->data       = (void *)-1;
   this->frameEvent = lgCreateEvent(true, 20);
 
   if (!this->frameEvent)
@@ -77,6 +235,244 @@ static bool xcb_create(CaptureGetPointerBuffer getPointerBufferFn, CapturePostPo
     return false;
   }
 
+  this->maxSegments = option_get_int("xcb", "segments");
+  if (this->maxSegments <= 0)
+    this->maxSegments = 1;
+
+  this->segments = calloc(sizeof(struct XCBSegment), this->maxSegments);
+  for(int i = 0; i < this->maxSegments; ++i)
+  {
+    this->segments[i].shmID = -1;
+    this->segments[i].data  = (void *)-1;
+  }
+
+  this->getPointerBufferFn  = getPointerBufferFn;
+  this->postPointerBufferFn = postPointerBufferFn;
+  this->pointerInterval     =
+    (uint64_t)option_get_int("xcb", "pointerPollInterval") * 1000;
+  this->allowZeroCopy       = option_get_bool("xcb", "zeroCopy");
+  this->outputName          = option_get_string("xcb", "output");
+
+  const char * window = option_get_string("xcb", "window");
+  if (window && *window)
+  {
+    char * end;
+    this->targetWindow = strtoul(window, &end, 0);
+    if (*end || !this->targetWindow)
+    {
+      DEBUG_ERROR("Invalid window ID: %s", window);
+      lgFreeEvent(this->frameEvent);
+      free(this->segments);
+      free(this);
+      this = NULL;
+      return false;
+    }
+  }
+
+  if (this->outputName && !*this->outputName)
+    this->outputName = NULL;
+
+  return true;
+}
+
+static void xcb_setIVSHMEM(struct IVSHMEM * dev)
+{
+  this->shm = dev;
+}
+
+static bool xcb_attachIVSHMEM(void)
+{
+  if (!this->shm || !this->allowZeroCopy)
+    return false;
+
+  xcb_shm_query_version_reply_t * ver = xcb_shm_query_version_reply(
+      this->xcb, xcb_shm_query_version(this->xcb), NULL);
+  if (!ver)
+    return false;
+
+  const bool hasFD = ver->major_version > 1 ||
+    (ver->major_version == 1 && ver->minor_version >= 2);
+  free(ver);
+
+  if (!hasFD)
+  {
+    DEBUG_INFO("MIT-SHM 1.2 is not available, zero copy disabled");
+    return false;
+  }
+
+  // libxcb closes the fd once it has been sent to the server
+  int fd = ivshmemGetFD(this->shm);
+  if (fd < 0)
+    return false;
+
+  this->shmSeg = xcb_generate_id(this->xcb);
+  xcb_generic_error_t * error = xcb_request_check(this->xcb,
+      xcb_shm_attach_fd_checked(this->xcb, this->shmSeg, fd, false));
+  if (error)
+  {
+    DEBUG_WARN("Failed to attach the shared memory to the X server (%d)",
+        error->error_code);
+    free(error);
+    return false;
+  }
+
+  memset(this->slots, 0, sizeof(this->slots));
+  return true;
+}
+
+static bool xcb_initSegment(struct XCBSegment * s)
+{
+  s->shmID = shmget(IPC_PRIVATE, xcb_getMaxFrameSize(), IPC_CREAT | 0777);
+  if (s->shmID == -1)
+  {
+    DEBUG_ERROR("shmget failed");
+    return false;
+  }
+
+  s->seg = xcb_generate_id(this->xcb);
+  xcb_shm_attach(this->xcb, s->seg, s->shmID, false);
+  s->data = shmat(s->shmID, NULL, 0);
+  if ((uintptr_t)s->data == -1)
+  {
+    DEBUG_ERROR("shmat failed");
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Find the geometry of the CRTC driving the named output
+ */
+static bool xcb_getOutputGeometry(const char * name, bool log,
+    int * x, int * y, unsigned int * width, unsigned int * height)
+{
+  xcb_randr_get_screen_resources_current_reply_t * res =
+    xcb_randr_get_screen_resources_current_reply(this->xcb,
+      xcb_randr_get_screen_resources_current(this->xcb,
+        this->xcbScreen->root), NULL);
+  if (!res)
+    return false;
+
+  bool found = false;
+  const xcb_randr_output_t * outputs =
+    xcb_randr_get_screen_resources_current_outputs(res);
+  const int count = xcb_randr_get_screen_resources_current_outputs_length(res);
+
+  for(int i = 0; i < count && !found; ++i)
+  {
+    xcb_randr_get_output_info_reply_t * info =
+      xcb_randr_get_output_info_reply(this->xcb,
+        xcb_randr_get_output_info(this->xcb, outputs[i],
+          res->config_timestamp), NULL);
+    if (!info)
+      continue;
+
+    const char * outName = (const char *)xcb_randr_get_output_info_name(info);
+    const int    nameLen = xcb_randr_get_output_info_name_length(info);
+
+    if (log)
+      DEBUG_INFO("Output           : %.*s%s", nameLen, outName,
+          info->crtc == XCB_NONE ? " (disabled)" : "");
+
+    if (info->crtc != XCB_NONE && strlen(name) == nameLen &&
+        memcmp(name, outName, nameLen) == 0)
+    {
+      xcb_randr_get_crtc_info_reply_t * crtc =
+        xcb_randr_get_crtc_info_reply(this->xcb,
+          xcb_randr_get_crtc_info(this->xcb, info->crtc,
+            res->config_timestamp), NULL);
+
+      if (crtc)
+      {
+        *x      = crtc->x;
+        *y      = crtc->y;
+        *width  = crtc->width;
+        *height = crtc->height;
+        found   = true;
+        free(crtc);
+      }
+    }
+
+    free(info);
+  }
+
+  free(res);
+  return found;
+}
+
+static bool xcb_initOutput(void)
+{
+  if (!this->hasRandR)
+  {
+    DEBUG_ERROR("The RandR extension is required to capture an output");
+    return false;
+  }
+
+  if (!xcb_getOutputGeometry(this->outputName, true,
+        &this->captureX, &this->captureY, &this->width, &this->height))
+  {
+    DEBUG_ERROR("Unable to find an enabled output named %s", this->outputName);
+    return false;
+  }
+
+  this->originX = this->captureX;
+  this->originY = this->captureY;
+  DEBUG_INFO("Capture Output   : %s @ %d,%d", this->outputName,
+      this->captureX, this->captureY);
+  return true;
+}
+
+static bool xcb_initWindow(void)
+{
+  if (!xcb_get_extension_data(this->xcb, &xcb_composite_id)->present)
+  {
+    DEBUG_ERROR("The Composite extension is required to capture a window");
+    return false;
+  }
+
+  free(xcb_composite_query_version_reply(this->xcb,
+        xcb_composite_query_version(this->xcb,
+          XCB_COMPOSITE_MAJOR_VERSION, XCB_COMPOSITE_MINOR_VERSION), NULL));
+
+  xcb_get_geometry_reply_t * geom = xcb_get_geometry_reply(this->xcb,
+      xcb_get_geometry(this->xcb, this->targetWindow), NULL);
+  if (!geom)
+  {
+    DEBUG_ERROR("Unable to get the geometry of window 0x%x", this->targetWindow);
+    return false;
+  }
+
+  // the named pixmap includes the window border
+  this->captureX     = geom->border_width;
+  this->captureY     = geom->border_width;
+  this->width        = geom->width;
+  this->height       = geom->height;
+  this->windowWidth  = geom->width;
+  this->windowHeight = geom->height;
+  free(geom);
+
+  /* the window contents are kept in an offscreen pixmap while redirected so
+   * they can be read even when the window is obscured */
+  xcb_composite_redirect_window(this->xcb, this->targetWindow,
+      XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+
+  this->pixmap = xcb_generate_id(this->xcb);
+  xcb_generic_error_t * error = xcb_request_check(this->xcb,
+      xcb_composite_name_window_pixmap_checked(this->xcb, this->targetWindow,
+        this->pixmap));
+  if (error)
+  {
+    DEBUG_ERROR("Failed to get the pixmap of window 0x%x, is it mapped?",
+        this->targetWindow);
+    free(error);
+    this->pixmap = XCB_NONE;
+    return false;
+  }
+
+  this->window   = this->targetWindow;
+  this->drawable = this->pixmap;
+  DEBUG_INFO("Capture Window   : 0x%x", this->targetWindow);
   return true;
 }
 
@@ -86,6 +482,11 @@ static bool xcb_init(void)
   assert(!this->initialized);
 
   lgResetEvent(this->frameEvent);
+  this->stop      = false;
+  this->reinit    = false;
+  this->segRIndex = 0;
+  this->segWIndex = 0;
+  atomic_store(&this->segReady, 0);
 
   this->xcb = xcb_connect(NULL, NULL);
   if (!this->xcb || xcb_connection_has_error(this->xcb))
@@ -101,28 +502,132 @@ static bool xcb_init(void)
   }
 
   xcb_screen_iterator_t iter;
-  iter            = xcb_setup_roots_iterator(xcb_get_setup(this->xcb));
-  this->xcbScreen = iter.data;
-  this->width     = iter.data->width_in_pixels;
-  this->height    = iter.data->height_in_pixels;
+  iter               = xcb_setup_roots_iterator(xcb_get_setup(this->xcb));
+  this->xcbScreen    = iter.data;
+  this->window       = iter.data->root;
+  this->drawable     = iter.data->root;
+  this->pixmap       = XCB_NONE;
+  this->width        = iter.data->width_in_pixels;
+  this->height       = iter.data->height_in_pixels;
+  this->windowWidth  = this->width;
+  this->windowHeight = this->height;
+  this->captureX     = 0;
+  this->captureY     = 0;
+  this->originX      = 0;
+  this->originY      = 0;
+  this->randrPending = false;
+
+  const xcb_query_extension_reply_t * randrExt =
+    xcb_get_extension_data(this->xcb, &xcb_randr_id);
+  this->hasRandR = randrExt->present;
+  if (this->hasRandR)
+  {
+    free(xcb_randr_query_version_reply(this->xcb,
+          xcb_randr_query_version(this->xcb,
+            XCB_RANDR_MAJOR_VERSION, XCB_RANDR_MINOR_VERSION), NULL));
+    this->randrEvent = randrExt->first_event;
+  }
+
+  if (this->targetWindow)
+  {
+    if (!xcb_initWindow())
+      goto fail;
+  }
+  else if (this->outputName)
+  {
+    if (!xcb_initOutput())
+      goto fail;
+
+    // changes to the layout are reported via RandR rather than the root
+    xcb_randr_select_input(this->xcb, this->xcbScreen->root,
+        XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE |
+        XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE   |
+        XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+  }
+
   DEBUG_INFO("Frame Size       : %u x %u", this->width, this->height);
 
-  this->seg   = xcb_generate_id(this->xcb);
-  this->shmID = shmget(IPC_PRIVATE, xcb_getMaxFrameSize(), IPC_CREAT | 0777);
-  if (this->shmID == -1)
+  // watch for the captured window changing size
+  const uint32_t eventMask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+  xcb_change_window_attributes(this->xcb, this->window,
+      XCB_CW_EVENT_MASK, &eventMask);
+
+  /* with zero copy the frame buffer is the destination so there is nothing
+   * to pipeline, a single segment is used only for tracking the requests */
+  this->zeroCopy = xcb_attachIVSHMEM();
+  if (this->zeroCopy)
   {
-    DEBUG_ERROR("shmget failed");
-    goto fail;
+    this->segCount = 1;
+    DEBUG_INFO("Frame Data       : zero copy");
+  }
+  else
+  {
+    this->segCount = this->maxSegments;
+    for(int i = 0; i < this->segCount; ++i)
+    {
+      if (!xcb_initSegment(&this->segments[i]))
+        goto fail;
+      DEBUG_INFO("Frame Data %d     : 0x%" PRIXPTR, i,
+          (uintptr_t)this->segments[i].data);
+    }
   }
 
-  xcb_shm_attach(this->xcb, this->seg ,this->shmID, false);
-  this->data = shmat(this->shmID, NULL, 0);
-  if ((uintptr_t)this->data == -1)
+  for(int i = 0; i < this->segCount; ++i)
   {
-    DEBUG_ERROR("shmat failed");
-    goto fail;
+    atomic_store(&this->segments[i].state, SEGMENT_STATE_UNUSED);
+    this->segments[i].slot.full  = true;
+    this->segments[i].slot.count = 0;
+  }
+
+  const xcb_query_extension_reply_t * xfixesExt =
+    xcb_get_extension_data(this->xcb, &xcb_xfixes_id);
+  const xcb_query_extension_reply_t * damageExt =
+    xcb_get_extension_data(this->xcb, &xcb_damage_id);
+
+  // both extensions require the version to be negotiated before use
+  if (xfixesExt->present)
+    free(xcb_xfixes_query_version_reply(this->xcb,
+          xcb_xfixes_query_version(this->xcb,
+            XCB_XFIXES_MAJOR_VERSION, XCB_XFIXES_MINOR_VERSION), NULL));
+
+  this->hasDamage = damageExt->present && xfixesExt->present;
+  if (this->hasDamage)
+  {
+    free(xcb_damage_query_version_reply(this->xcb,
+          xcb_damage_query_version(this->xcb,
+            XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION), NULL));
+
+    this->damageEvent = damageExt->first_event + XCB_DAMAGE_NOTIFY;
+    this->damage      = xcb_generate_id(this->xcb);
+    this->region      = xcb_generate_id(this->xcb);
+    xcb_damage_create(this->xcb, this->damage, this->window,
+        XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    xcb_xfixes_create_region(this->xcb, this->region, 0, NULL);
   }
-  DEBUG_INFO("Frame Data       : 0x%" PRIXPTR, (uintptr_t)this->data);
+  else
+    DEBUG_WARN("DAMAGE extension not available, capturing every frame");
+
+  this->hasCursor = xfixesExt->present;
+  if (this->hasCursor)
+  {
+    this->cursorEvent = xfixesExt->first_event + XCB_XFIXES_CURSOR_NOTIFY;
+    xcb_xfixes_select_cursor_input(this->xcb, this->xcbScreen->root,
+        XCB_XFIXES_CURSOR_NOTIFY_MASK_DISPLAY_CURSOR);
+
+    // always send the initial cursor shape
+    this->cursorPending = true;
+    this->pointerLast   = 0;
+    this->pointerX      = -1;
+    this->pointerY      = -1;
+  }
+  else
+    DEBUG_WARN("XFIXES extension not available, the cursor will not be captured");
+
+  xcb_flush(this->xcb);
+
+  // the first frame is always a full update
+  this->damagePending = true;
+  this->fullPending   = true;
 
   this->initialized = true;
   return true;
@@ -135,20 +640,37 @@ static bool xcb_deinit(void)
 {
   assert(this);
 
-  if ((uintptr_t)this->data != -1)
+  for(int i = 0; i < this->maxSegments; ++i)
   {
-    shmdt(this->data);
-    this->data = (void *)-1;
-  }
+    struct XCBSegment * s = &this->segments[i];
+    if ((uintptr_t)s->data != -1)
+    {
+      shmdt(s->data);
+      s->data = (void *)-1;
+    }
 
-  if (this->shmID != -1)
-  {
-    shmctl(this->shmID, IPC_RMID, NULL);
-    this->shmID = -1;
+    if (s->shmID != -1)
+    {
+      shmctl(s->shmID, IPC_RMID, NULL);
+      s->shmID = -1;
+    }
   }
 
   if (this->xcb)
   {
+    if (this->hasDamage)
+    {
+      xcb_damage_destroy      (this->xcb, this->damage);
+      xcb_xfixes_destroy_region(this->xcb, this->region);
+      this->hasDamage = false;
+    }
+
+    if (this->pixmap != XCB_NONE)
+    {
+      xcb_free_pixmap(this->xcb, this->pixmap);
+      this->pixmap = XCB_NONE;
+    }
+
     xcb_disconnect(this->xcb);
     this->xcb = NULL;
   }
@@ -157,9 +679,16 @@ static bool xcb_deinit(void)
   return false;
 }
 
+static void xcb_stop(void)
+{
+  this->stop = true;
+  lgSignalEvent(this->frameEvent);
+}
+
 static void xcb_free(void)
 {
   lgFreeEvent(this->frameEvent);
+  free(this->segments);
   free(this);
   this = NULL;
 }
@@ -174,34 +703,391 @@ static unsigned int xcb_getMouseScale(void)
   return 100;
 }
 
+static void xcb_processEvents(void)
+{
+  xcb_generic_event_t * event;
+  while((event = xcb_poll_for_event(this->xcb)))
+  {
+    const uint8_t type = event->response_type & ~0x80;
+    if (this->hasDamage && type == this->damageEvent)
+      this->damagePending = true;
+    else if (this->hasCursor && type == this->cursorEvent)
+      this->cursorPending = true;
+    else if (this->hasRandR && this->outputName &&
+        (type == this->randrEvent + XCB_RANDR_SCREEN_CHANGE_NOTIFY ||
+         type == this->randrEvent + XCB_RANDR_NOTIFY))
+      this->randrPending = true;
+    else if (type == XCB_CONFIGURE_NOTIFY && !this->outputName)
+    {
+      const xcb_configure_notify_event_t * cfg =
+        (const xcb_configure_notify_event_t *)event;
+
+      if (cfg->window == this->window &&
+          (cfg->width != this->windowWidth || cfg->height != this->windowHeight))
+      {
+        DEBUG_INFO("Capture size changed to %u x %u", cfg->width, cfg->height);
+        this->reinit = true;
+      }
+    }
+    else if (type == XCB_UNMAP_NOTIFY && this->targetWindow)
+    {
+      // the composite pixmap is no longer valid
+      DEBUG_INFO("The captured window was unmapped");
+      this->reinit = true;
+    }
+    free(event);
+  }
+}
+
+/**
+ * Collect the pending damage into this->damageRects clipped to the captured
+ * area, which may leave none. Returns false if a full frame update should be
+ * performed instead.
+ */
+static bool xcb_getDamage(void)
+{
+  xcb_damage_subtract(this->xcb, this->damage, XCB_NONE, this->region);
+  xcb_xfixes_fetch_region_reply_t * reply = xcb_xfixes_fetch_region_reply(
+      this->xcb, xcb_xfixes_fetch_region(this->xcb, this->region), NULL);
+  if (!reply)
+    return false;
+
+  const xcb_rectangle_t * rects = xcb_xfixes_fetch_region_rectangles(reply);
+  const int count = xcb_xfixes_fetch_region_rectangles_length(reply);
+
+  if (count > KVMFR_MAX_DAMAGE_RECTS)
+  {
+    free(reply);
+    return false;
+  }
+
+  unsigned int rows = 0;
+  this->damageRectsCount = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    const int x1 = max(rects[i].x - this->originX, 0);
+    const int y1 = max(rects[i].y - this->originY, 0);
+    const int x2 = min(rects[i].x - this->originX + rects[i].width , (int)this->width );
+    const int y2 = min(rects[i].y - this->originY + rects[i].height, (int)this->height);
+    if (x2 <= x1 || y2 <= y1)
+      continue;
+
+    FrameDamageRect * r = &this->damageRects[this->damageRectsCount++];
+    r->x      = x1;
+    r->y      = y1;
+    r->width  = x2 - x1;
+    r->height = y2 - y1;
+    rows     += r->height;
+  }
+  free(reply);
+
+  // not worth the extra requests if most of the rows changed
+  return rows < this->height;
+}
+
+/**
+ * Add the damage of the new frame to a buffer that still holds an older frame
+ */
+static void xcb_addDamage(struct XCBSlot * slot)
+{
+  if (slot->full)
+    return;
+
+  if (!this->damageRectsCount ||
+      slot->count + this->damageRectsCount > KVMFR_MAX_DAMAGE_RECTS)
+  {
+    slot->full = true;
+    return;
+  }
+
+  memcpy(slot->rects + slot->count, this->damageRects,
+      this->damageRectsCount * sizeof(FrameDamageRect));
+  slot->count += this->damageRectsCount;
+}
+
+static void xcb_getImage(struct XCBSegment * s, uint32_t seg, uint32_t offset,
+    unsigned int y, unsigned int height)
+{
+  s->imgC[s->imgCount++] = xcb_shm_get_image_unchecked(
+      this->xcb,
+      this->drawable,
+      this->captureX, this->captureY + y,
+      this->width,
+      height,
+      ~0,
+      XCB_IMAGE_FORMAT_Z_PIXMAP,
+      seg,
+      offset + y * this->width * 4);
+}
+
+/**
+ * Request the rows the slot needs updated into the shm segment at offset,
+ * writing the requests into the XCBSegment
+ */
+static void xcb_getImages(struct XCBSegment * s, uint32_t seg, uint32_t offset,
+    struct XCBSlot * slot)
+{
+  s->imgCount = 0;
+
+  if (slot->full)
+  {
+    xcb_getImage(s, seg, offset, 0, this->height);
+    slot->full = false;
+    return;
+  }
+
+  /* merge the rects into non-overlapping bands of rows, in no particular
+   * order */
+  unsigned int bandY[KVMFR_MAX_DAMAGE_RECTS];
+  unsigned int bandH[KVMFR_MAX_DAMAGE_RECTS];
+  unsigned int bands = 0;
+
+  for(unsigned int i = 0; i < slot->count; ++i)
+  {
+    unsigned int y1 = slot->rects[i].y;
+    unsigned int y2 = y1 + slot->rects[i].height;
+
+    unsigned int n = 0;
+    for(unsigned int j = 0; j < bands; ++j)
+    {
+      if (bandY[j] + bandH[j] < y1 || y2 < bandY[j])
+      {
+        bandY[n] = bandY[j];
+        bandH[n] = bandH[j];
+        ++n;
+        continue;
+      }
+
+      y1 = min(y1, bandY[j]);
+      y2 = max(y2, bandY[j] + bandH[j]);
+    }
+
+    bandY[n] = y1;
+    bandH[n] = y2 - y1;
+    bands    = n + 1;
+  }
+
+  for(unsigned int i = 0; i < bands; ++i)
+    xcb_getImage(s, seg, offset, bandY[i], bandH[i]);
+
+  slot->count = 0;
+}
+
+static void xcb_updatePointer(void)
+{
+  CapturePointer pointer = { 0 };
+  int x, y;
+
+  if (this->cursorPending)
+  {
+    this->cursorPending = false;
+
+    xcb_xfixes_get_cursor_image_reply_t * img =
+      xcb_xfixes_get_cursor_image_reply(this->xcb,
+          xcb_xfixes_get_cursor_image(this->xcb), NULL);
+    if (!img)
+    {
+      DEBUG_ERROR("Failed to get the cursor image");
+      return;
+    }
+
+    void   * data;
+    uint32_t size;
+    const uint32_t pitch = img->width * sizeof(uint32_t);
+
+    if (!this->getPointerBufferFn(&data, &size))
+      DEBUG_WARN("Failed to obtain a buffer for the cursor shape");
+    else if (pitch * img->height > size)
+      DEBUG_WARN("Cursor shape %ux%u is too large", img->width, img->height);
+    else
+    {
+      // premultiplied ARGB32, which is BGRA in memory
+      memcpy(data, xcb_xfixes_get_cursor_image_cursor_image(img),
+          pitch * img->height);
+
+      pointer.shapeUpdate = true;
+      pointer.format      = CAPTURE_FMT_COLOR;
+      pointer.width       = img->width;
+      pointer.height      = img->height;
+      pointer.pitch       = pitch;
+      pointer.hx          = img->xhot;
+      pointer.hy          = img->yhot;
+      this->pointerHX     = img->xhot;
+      this->pointerHY     = img->yhot;
+    }
+
+    free(img);
+  }
+
+  // the position relative to the captured window
+  xcb_query_pointer_reply_t * ptr = xcb_query_pointer_reply(this->xcb,
+      xcb_query_pointer(this->xcb, this->window), NULL);
+  if (ptr)
+  {
+    x = ptr->win_x - this->originX;
+    y = ptr->win_y - this->originY;
+    free(ptr);
+  }
+  else
+  {
+    x = this->pointerX;
+    y = this->pointerY;
+  }
+
+  if (!pointer.shapeUpdate && x == this->pointerX && y == this->pointerY)
+    return;
+
+  this->pointerX = x;
+  this->pointerY = y;
+
+  // the client expects the position of the top left of the cursor image
+  pointer.positionUpdate = true;
+  pointer.x              = x - this->pointerHX;
+  pointer.y              = y - this->pointerHY;
+  pointer.visible        = x >= 0 && y >= 0 &&
+    x < (int)this->width && y < (int)this->height;
+  this->postPointerBufferFn(pointer);
+}
+
+static bool xcb_checkReinit(void)
+{
+  if (this->randrPending)
+  {
+    this->randrPending = false;
+
+    int x, y;
+    unsigned int width, height;
+    if (!xcb_getOutputGeometry(this->outputName, false, &x, &y, &width, &height) ||
+        x     != this->captureX || y      != this->captureY ||
+        width != this->width    || height != this->height)
+    {
+      DEBUG_INFO("The output %s has changed", this->outputName);
+      this->reinit = true;
+    }
+  }
+
+  return this->reinit;
+}
+
 static CaptureResult xcb_capture(void)
 {
   assert(this);
   assert(this->initialized);
 
-  if (!this->hasFrame)
+  xcb_processEvents();
+  if (xcb_checkReinit())
+    return CAPTURE_RESULT_REINIT;
+
+  if (this->hasCursor)
   {
-    this->imgC = xcb_shm_get_image_unchecked(
-        this->xcb,
-        this->xcbScreen->root,
-        0, 0,
-        this->width,
-        this->height,
-        ~0,
-        XCB_IMAGE_FORMAT_Z_PIXMAP,
-        this->seg,
-        0);
+    const uint64_t now = nanotime();
+    if (this->cursorPending || now - this->pointerLast >= this->pointerInterval)
+    {
+      this->pointerLast = now;
+      xcb_updatePointer();
+    }
+  }
 
-    this->hasFrame  = true;
-    lgSignalEvent(this->frameEvent);
+  // wait for the frame thread to finish with the next segment
+  struct XCBSegment * s = &this->segments[this->segWIndex];
+  if (atomic_load_explicit(&s->state, memory_order_acquire) !=
+      SEGMENT_STATE_UNUSED)
+    return CAPTURE_RESULT_OK;
+
+  if (this->hasDamage)
+  {
+    if (!this->damagePending)
+    {
+      // wait for the server to report something to do, waking in time to
+      // poll the pointer position
+      struct pollfd pfd =
+      {
+        .fd     = xcb_get_file_descriptor(this->xcb),
+        .events = POLLIN
+      };
+
+      struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000000 };
+      if (this->hasCursor)
+        ts.tv_nsec = min(this->pointerInterval, (uint64_t)ts.tv_nsec);
+
+      if (ppoll(&pfd, 1, &ts, NULL) <= 0)
+        return CAPTURE_RESULT_TIMEOUT;
+
+      xcb_processEvents();
+      if (xcb_checkReinit())
+        return CAPTURE_RESULT_REINIT;
+
+      if (!this->damagePending)
+        return CAPTURE_RESULT_TIMEOUT;
+    }
+
+    if (xcb_connection_has_error(this->xcb))
+    {
+      DEBUG_ERROR("The X connection was lost");
+      return CAPTURE_RESULT_ERROR;
+    }
+  }
+
+  // the damage must always be collected to re-arm the notification
+  if (!this->hasDamage || !xcb_getDamage() || this->fullPending)
+  {
+    this->damageRectsCount = 0;
+    this->fullPending      = false;
+  }
+  else if (this->damageRectsCount == 0)
+  {
+    // all of the damage was outside of the captured area
+    this->damagePending = false;
+    return CAPTURE_RESULT_TIMEOUT;
+  }
+  this->damagePending = false;
+
+  s->damageRectsCount = this->damageRectsCount;
+  memcpy(s->damageRects, this->damageRects,
+      this->damageRectsCount * sizeof(FrameDamageRect));
+
+  if (this->zeroCopy)
+  {
+    // the requests are made in getFrame once the destination is known
+    for(int i = 0; i < KVMFR_FRAME_BUFFERS; ++i)
+      xcb_addDamage(&this->slots[i]);
   }
+  else
+  {
+    for(int i = 0; i < this->segCount; ++i)
+      xcb_addDamage(&this->segments[i].slot);
+
+    xcb_getImages(s, s->seg, 0, &s->slot);
+    xcb_flush(this->xcb);
+  }
+
+  atomic_store_explicit(&s->state, SEGMENT_STATE_PENDING, memory_order_release);
+  if (++this->segWIndex == this->segCount)
+    this->segWIndex = 0;
+
+  if (atomic_fetch_add_explicit(&this->segReady, 1, memory_order_release) == 0)
+    lgSignalEvent(this->frameEvent);
 
   return CAPTURE_RESULT_OK;
 }
 
 static CaptureResult xcb_waitFrame(CaptureFrame * frame)
 {
-  lgWaitEvent(this->frameEvent, TIMEOUT_INFINITE);
+  // NOTE: the event may be signaled when there are no frames available
+  if (atomic_load_explicit(&this->segReady, memory_order_acquire) == 0)
+  {
+    if (!lgWaitEvent(this->frameEvent, 1000))
+      return CAPTURE_RESULT_TIMEOUT;
+
+    // the count will still be zero if we are stopping
+    if (atomic_load_explicit(&this->segReady, memory_order_acquire) == 0)
+      return CAPTURE_RESULT_TIMEOUT;
+  }
+
+  if (this->stop)
+    return CAPTURE_RESULT_TIMEOUT;
+
+  struct XCBSegment * s = &this->segments[this->segRIndex];
 
   frame->width    = this->width;
   frame->height   = this->height;
@@ -210,6 +1096,11 @@ static CaptureResult xcb_waitFrame(CaptureFrame * frame)
   frame->format   = CAPTURE_FMT_BGRA;
   frame->rotation = CAPTURE_ROT_0;
 
+  frame->damageRectsCount = s->damageRectsCount;
+  memcpy(frame->damageRects, s->damageRects,
+      s->damageRectsCount * sizeof(FrameDamageRect));
+
+  atomic_fetch_sub_explicit(&this->segReady, 1, memory_order_release);
   return CAPTURE_RESULT_OK;
 }
 
@@ -218,27 +1109,85 @@ static CaptureResult xcb_getFrame(FrameBuffer * frame)
   assert(this);
   assert(this->initialized);
 
-  xcb_shm_get_image_reply_t * img;
-  img = xcb_shm_get_image_reply(this->xcb, this->imgC, NULL);
-  if (!img)
+  struct XCBSegment * s = &this->segments[this->segRIndex];
+  CaptureResult result  = CAPTURE_RESULT_OK;
+
+  if (this->zeroCopy)
+  {
+    struct XCBSlot * slot = NULL;
+    for(int i = 0; i < KVMFR_FRAME_BUFFERS; ++i)
+      if (this->slots[i].fb == frame || !this->slots[i].fb)
+      {
+        slot = &this->slots[i];
+        break;
+      }
+
+    if (!slot)
+    {
+      DEBUG_ERROR("More frame buffers in use than expected");
+      result = CAPTURE_RESULT_ERROR;
+      goto done;
+    }
+
+    // a buffer seen for the first time has never been written to
+    if (!slot->fb)
+    {
+      slot->fb   = frame;
+      slot->full = true;
+    }
+
+    const uintptr_t offset =
+      framebuffer_get_data(frame) - (uint8_t *)this->shm->mem;
+
+    xcb_getImages(s, this->shmSeg, offset, slot);
+    xcb_flush(this->xcb);
+  }
+
+  bool ok = true;
+  for(unsigned int i = 0; i < s->imgCount; ++i)
+  {
+    xcb_shm_get_image_reply_t * img;
+    img = xcb_shm_get_image_reply(this->xcb, s->imgC[i], NULL);
+    if (!img)
+    {
+      ok = false;
+      continue;
+    }
+    free(img);
+  }
+
+  if (!ok)
   {
     DEBUG_ERROR("Failed to get image reply");
-    return CAPTURE_RESULT_ERROR;
+    for(int i = 0; i < KVMFR_FRAME_BUFFERS; ++i)
+      this->slots[i].full = true;
+    s->slot.full = true;
+    result = CAPTURE_RESULT_ERROR;
+    goto done;
   }
 
-  framebuffer_write(frame, this->data, this->width * this->height * 4);
-  free(img);
+  if (this->zeroCopy)
+    framebuffer_set_write_ptr(frame, this->width * this->height * 4);
+  else
+    framebuffer_write(frame, s->data, this->width * this->height * 4);
 
-  this->hasFrame = false;
-  return CAPTURE_RESULT_OK;
+done:
+  atomic_store_explicit(&s->state, SEGMENT_STATE_UNUSED, memory_order_release);
+  if (++this->segRIndex == this->segCount)
+    this->segRIndex = 0;
+
+  return result;
 }
 
 struct CaptureInterface Capture_XCB =
 {
   .shortName       = "XCB",
   .getName         = xcb_getName,
+  .initOptions     = xcb_initOptions,
   .create          = xcb_create,
+  .setIVSHMEM      = xcb_setIVSHMEM,
   .init            = xcb_init,
+  .stop            = xcb_stop,
   .deinit          = xcb_deinit,
   .free            = xcb_free,
   .getMaxFrameSize = xcb_getMaxFrameSize,
@@ -29,6 +29,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "common/thread.h"
 #include "common/ivshmem.h"
 #include "common/sysinfo.h"
+#include "common/doorbell.h"
 #include "common/time.h"
 
 #include <lgmp/host.h>
@@ -73,7 +74,10 @@ struct app
 {
   int exitcode;
 
-  PLGMPHost lgmp;
+  PLGMPHost        lgmp;
+  struct IVSHMEM * shmDev;
+  KVMFRDoorbell  * doorbell;
+  KVMFRClock     * clock;
 
   PLGMPHostQueue pointerQueue;
   PLGMPMemory    pointerMemory[POINTER_SHAPE_BUFFERS];
@@ -85,7 +89,7 @@ struct app
 
   size_t         maxFrameSize;
   PLGMPHostQueue frameQueue;
-  PLGMPMemory    frameMemory[LGMP_Q_FRAME_LEN];
+  PLGMPMemory    frameMemory[KVMFR_FRAME_BUFFERS];
   unsigned int   frameIndex;
 
   CaptureInterface * iface;
@@ -122,8 +126,15 @@ static struct Option options[] =
   {0}
 };
 
+static inline void updateClock(void)
+{
+  atomic_store_explicit(&app.clock->time, microtime(), memory_order_release);
+}
+
 static bool lgmpTimer(void * opaque)
 {
+  updateClock();
+
   LGMP_STATUS status;
   if ((status = lgmpHostProcess(app.lgmp)) != LGMP_OK)
   {
@@ -141,6 +152,8 @@ static int frameThread(void * opaque)
 
   bool         frameValid     = false;
   bool         repeatFrame    = false;
+  uint32_t     frameSerial    = 0;
+  uint64_t     captureTime    = 0;
   CaptureFrame frame          = { 0 };
   const long   pageSize       = sysinfo_getPageSize();
 
@@ -157,6 +170,7 @@ static int frameThread(void * opaque)
     {
       case CAPTURE_RESULT_OK:
         repeatFrame = false;
+        captureTime = microtime();
         break;
 
       case CAPTURE_RESULT_REINIT:
@@ -187,17 +201,21 @@ static int frameThread(void * opaque)
 
     LGMP_STATUS status;
 
-    // if we are repeating a frame just send the last frame again
+    /* if we are repeating a frame just send the last frame again. It is
+     * already published and may still be read, so it must not be modified,
+     * clients see the unchanged serial and treat the whole frame as damaged */
     if (repeatFrame)
     {
       if ((status = lgmpHostQueuePost(app.frameQueue, 0, app.frameMemory[app.frameIndex])) != LGMP_OK)
         DEBUG_ERROR("%s", lgmpStatusString(status));
+      else
+        doorbellRing(app.doorbell, app.shmDev, KVMFR_DOORBELL_FRAME);
       continue;
     }
 
     // we increment the index first so that if we need to repeat a frame
     // the index still points to the latest valid frame
-    if (++app.frameIndex == LGMP_Q_FRAME_LEN)
+    if (++app.frameIndex == KVMFR_FRAME_BUFFERS)
       app.frameIndex = 0;
 
     KVMFRFrame * fi = lgmpHostMemPtr(app.frameMemory[app.frameIndex]);
@@ -225,6 +243,7 @@ static int frameThread(void * opaque)
     }
 
     fi->formatVer         = frame.formatVer;
+    fi->frameSerial       = ++frameSerial;
     fi->width             = frame.width;
     fi->height            = frame.height;
     fi->stride            = frame.stride;
@@ -232,8 +251,15 @@ static int frameThread(void * opaque)
     fi->offset            = pageSize - FrameBufferStructSize;
     fi->mouseScalePercent = app.iface->getMouseScale();
     fi->blockScreensaver  = os_blockScreensaver();
+    fi->damageRectsCount  = frame.damageRectsCount;
+    fi->captureTime       = captureTime;
+    fi->copyStart         = 0;
+    fi->copyEnd           = 0;
     frameValid            = true;
 
+    memcpy(fi->damageRects, frame.damageRects,
+        frame.damageRectsCount * sizeof(FrameDamageRect));
+
     // put the framebuffer on the border of the next page
     // this is to allow for aligned DMA transfers by the receiver
     FrameBuffer * fb = (FrameBuffer *)(((uint8_t*)fi) + fi->offset);
@@ -245,7 +271,13 @@ static int frameThread(void * opaque)
       DEBUG_ERROR("%s", lgmpStatusString(status));
       continue;
     }
+    updateClock();
+    doorbellRing(app.doorbell, app.shmDev, KVMFR_DOORBELL_FRAME);
+
+    // the client reads these once it has finished with the frame buffer
+    fi->copyStart = microtime();
     app.iface->getFrame(fb);
+    fi->copyEnd   = microtime();
   }
   DEBUG_INFO("Frame thread stopped");
   return 0;
@@ -394,8 +426,10 @@ static void sendPointer(bool newClient)
     }
 
     DEBUG_ERROR("lgmpHostQueuePost Failed (Pointer): %s", lgmpStatusString(status));
-    break;
+    return;
   }
+
+  doorbellRing(app.doorbell, app.shmDev, KVMFR_DOORBELL_POINTER);
 }
 
 void capturePostPointerBuffer(CapturePointer pointer)
@@ -488,6 +522,11 @@ int app_main(int argc, char * argv[])
   int exitcode  = 0;
   DEBUG_INFO("IVSHMEM Size     : %u MiB", shmDev.size / 1048576);
   DEBUG_INFO("IVSHMEM Address  : 0x%" PRIXPTR, (uintptr_t)shmDev.mem);
+
+  const int peerID = ivshmemGetPeerID(&shmDev);
+  if (peerID >= 0)
+    DEBUG_INFO("IVSHMEM Peer ID  : %d", peerID);
+
   DEBUG_INFO("Max Pointer Size : %u KiB", (unsigned int)MAX_POINTER_SIZE / 1024);
   DEBUG_INFO("KVMFR Version    : %u", KVMFR_VERSION);
 
@@ -497,8 +536,22 @@ int app_main(int argc, char * argv[])
   };
   strncpy(udata.hostver, BUILD_VERSION, sizeof(udata.hostver)-1);
 
+  /* the doorbell and clock live in the last page of the shared memory,
+   * outside of the region given to LGMP so that their offsets are known before
+   * lgmpHostInit */
+  const long   resSize  = sysinfo_getPageSize();
+  const size_t lgmpSize = shmDev.size - resSize;
+  const size_t clockOfs = lgmpSize + ((sizeof(KVMFRDoorbell) + 63) & ~63);
+  app.shmDev     = &shmDev;
+  app.doorbell   = (KVMFRDoorbell *)((uint8_t *)shmDev.mem + lgmpSize);
+  app.clock      = (KVMFRClock    *)((uint8_t *)shmDev.mem + clockOfs);
+  udata.doorbell = lgmpSize;
+  udata.clock    = clockOfs;
+  doorbellInit(app.doorbell);
+  updateClock();
+
   LGMP_STATUS status;
-  if ((status = lgmpHostInit(shmDev.mem, shmDev.size, &app.lgmp,
+  if ((status = lgmpHostInit(shmDev.mem, lgmpSize, &app.lgmp,
           sizeof(udata), (uint8_t *)&udata)) != LGMP_OK)
   {
     DEBUG_ERROR("lgmpHostInit Failed: %s", lgmpStatusString(status));
@@ -542,10 +595,10 @@ int app_main(int argc, char * argv[])
   const long sz = sysinfo_getPageSize();
   app.maxFrameSize = lgmpHostMemAvail(app.lgmp);
   app.maxFrameSize = (app.maxFrameSize - (sz - 1)) & ~(sz - 1);
-  app.maxFrameSize /= LGMP_Q_FRAME_LEN;
+  app.maxFrameSize /= KVMFR_FRAME_BUFFERS;
   DEBUG_INFO("Max Frame Size   : %u MiB", (unsigned int)(app.maxFrameSize / 1048576LL));
 
-  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+  for(int i = 0; i < KVMFR_FRAME_BUFFERS; ++i)
   {
     if ((status = lgmpHostMemAllocAligned(app.lgmp, app.maxFrameSize, sz, &app.frameMemory[i])) != LGMP_OK)
     {
@@ -571,6 +624,9 @@ int app_main(int argc, char * argv[])
       continue;
     }
 
+    if (iface->setIVSHMEM)
+      iface->setIVSHMEM(&shmDev);
+
     if (iface->init())
       break;
 
@@ -721,7 +777,7 @@ fail_timer:
   LG_LOCK_FREE(app.pointerLock);
 
 fail_lgmp:
-  for(int i = 0; i < LGMP_Q_FRAME_LEN; ++i)
+  for(int i = 0; i < KVMFR_FRAME_BUFFERS; ++i)
     lgmpHostMemFree(&app.frameMemory[i]);
   for(int i = 0; i < POINTER_SHAPE_BUFFERS; ++i)
     lgmpHostMemFree(&app.pointerMemory[i]);
@@ -29,6 +29,10 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <linux/dma-buf.h>
 #include <linux/highmem.h>
 #include <linux/version.h>
+#include <linux/interrupt.h>
+#include <linux/eventfd.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
 
 #include <asm/io.h>
 
@@ -39,6 +43,11 @@ DEFINE_IDR(kvmfr_idr);
 
 #define KVMFR_DEV_NAME    "kvmfr"
 #define KVMFR_MAX_DEVICES 10
+#define KVMFR_MAX_VECTORS 8
+
+// ivshmem BAR0 registers
+#define IVSHMEM_REG_IVPOSITION 8
+#define IVSHMEM_REG_DOORBELL   12
 
 static int static_size_mb[KVMFR_MAX_DEVICES];
 static int static_count;
@@ -59,6 +68,23 @@ enum kvmfr_type
   KVMFR_TYPE_STATIC,
 };
 
+struct kvmfr_dev;
+
+struct kvmfr_vector
+{
+  struct kvmfr_dev * kdev;
+  unsigned int       vector;
+};
+
+// an eventfd signalled each time the vector is rung by another peer
+struct kvmfr_eventfd
+{
+  struct list_head     list;
+  struct file        * owner;
+  unsigned int         vector;
+  struct eventfd_ctx * ctx;
+};
+
 struct kvmfr_dev
 {
   unsigned long        size;
@@ -68,6 +94,13 @@ struct kvmfr_dev
   struct dev_pagemap   pgmap;
   void               * addr;
   enum kvmfr_type      type;
+
+  // ivshmem-doorbell only, static devices have no registers or vectors
+  void __iomem       * regs;
+  int                  vectors;
+  struct kvmfr_vector  irqs[KVMFR_MAX_VECTORS];
+  spinlock_t           eventfdLock;
+  struct list_head     eventfds;
 };
 
 struct kvmfrbuf
@@ -252,6 +285,94 @@ err:
   return ret;
 }
 
+static irqreturn_t kvmfr_irq(int irq, void * opaque)
+{
+  struct kvmfr_vector  * vec  = (struct kvmfr_vector *)opaque;
+  struct kvmfr_dev     * kdev = vec->kdev;
+  struct kvmfr_eventfd * efd;
+  unsigned long flags;
+
+  spin_lock_irqsave(&kdev->eventfdLock, flags);
+  list_for_each_entry(efd, &kdev->eventfds, list)
+    if (efd->vector == vec->vector)
+    {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
+      eventfd_signal(efd->ctx, 1);
+#else
+      eventfd_signal(efd->ctx);
+#endif
+    }
+  spin_unlock_irqrestore(&kdev->eventfdLock, flags);
+
+  return IRQ_HANDLED;
+}
+
+static long kvmfr_doorbell_getid(struct kvmfr_dev * kdev)
+{
+  u32 id;
+
+  if (!kdev->regs)
+    return -ENODEV;
+
+  // ivshmem-plain devices have no peer id and read back as -1
+  id = readl(kdev->regs + IVSHMEM_REG_IVPOSITION);
+  if (id > 0xFFFF)
+    return -ENODEV;
+
+  return id;
+}
+
+static long kvmfr_doorbell_ring(struct kvmfr_dev * kdev, unsigned long arg)
+{
+  struct kvmfr_doorbell_ring ring;
+
+  if (!kdev->regs)
+    return -ENODEV;
+
+  if (copy_from_user(&ring, (void __user *)arg, sizeof(ring)))
+    return -EFAULT;
+
+  writel(((u32)ring.peer << 16) | ring.vector,
+      kdev->regs + IVSHMEM_REG_DOORBELL);
+  return 0;
+}
+
+static long kvmfr_doorbell_eventfd(struct kvmfr_dev * kdev, struct file * filp,
+    unsigned long arg)
+{
+  struct kvmfr_doorbell_eventfd req;
+  struct kvmfr_eventfd * efd;
+  struct eventfd_ctx   * ctx;
+  unsigned long flags;
+
+  if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+    return -EFAULT;
+
+  if (req.vector >= kdev->vectors)
+    return -EINVAL;
+
+  ctx = eventfd_ctx_fdget(req.fd);
+  if (IS_ERR(ctx))
+    return PTR_ERR(ctx);
+
+  efd = kzalloc(sizeof(struct kvmfr_eventfd), GFP_KERNEL);
+  if (!efd)
+  {
+    eventfd_ctx_put(ctx);
+    return -ENOMEM;
+  }
+
+  // released with the file that registered it
+  efd->owner  = filp;
+  efd->vector = req.vector;
+  efd->ctx    = ctx;
+
+  spin_lock_irqsave(&kdev->eventfdLock, flags);
+  list_add_tail(&efd->list, &kdev->eventfds);
+  spin_unlock_irqrestore(&kdev->eventfdLock, flags);
+  return 0;
+}
+
 static long device_ioctl(struct file * filp, unsigned int ioctl, unsigned long arg)
 {
   struct kvmfr_dev * kdev;
@@ -271,6 +392,18 @@ static long device_ioctl(struct file * filp, unsigned int ioctl, unsigned long a
       ret = kdev->size;
       break;
 
+    case KVMFR_DOORBELL_GETID:
+      ret = kvmfr_doorbell_getid(kdev);
+      break;
+
+    case KVMFR_DOORBELL_RING:
+      ret = kvmfr_doorbell_ring(kdev, arg);
+      break;
+
+    case KVMFR_DOORBELL_EVENTFD:
+      ret = kvmfr_doorbell_eventfd(kdev, filp, arg);
+      break;
+
     default:
       return -ENOTTY;
   }
@@ -324,13 +457,87 @@ static int device_mmap(struct file * filp, struct vm_area_struct * vma)
   }
 }
 
+static int device_release(struct inode * inode, struct file * filp)
+{
+  struct kvmfr_dev     * kdev;
+  struct kvmfr_eventfd * efd, * tmp;
+  unsigned long flags;
+  LIST_HEAD(released);
+
+  kdev = (struct kvmfr_dev *)idr_find(&kvmfr_idr, iminor(inode));
+  if (!kdev)
+    return 0;
+
+  spin_lock_irqsave(&kdev->eventfdLock, flags);
+  list_for_each_entry_safe(efd, tmp, &kdev->eventfds, list)
+    if (efd->owner == filp)
+      list_move(&efd->list, &released);
+  spin_unlock_irqrestore(&kdev->eventfdLock, flags);
+
+  list_for_each_entry_safe(efd, tmp, &released, list)
+  {
+    eventfd_ctx_put(efd->ctx);
+    kfree(efd);
+  }
+
+  return 0;
+}
+
 static struct file_operations fops =
 {
   .owner          = THIS_MODULE,
   .unlocked_ioctl = device_ioctl,
   .mmap           = device_mmap,
+  .release        = device_release,
 };
 
+// ivshmem-doorbell devices interrupt us through MSI-X when another peer rings
+static void kvmfr_pci_setup_doorbell(struct pci_dev * dev, struct kvmfr_dev * kdev)
+{
+  int nvec, i;
+
+  kdev->regs = pci_iomap(dev, 0, 0);
+  if (!kdev->regs)
+  {
+    printk(KERN_WARNING "kvmfr: failed to map the registers, doorbell disabled\n");
+    return;
+  }
+
+  nvec = pci_alloc_irq_vectors(dev, 1, KVMFR_MAX_VECTORS, PCI_IRQ_MSIX);
+  if (nvec < 0)
+    return;
+
+  pci_set_master(dev);
+  for (i = 0; i < nvec; ++i)
+  {
+    kdev->irqs[i].kdev   = kdev;
+    kdev->irqs[i].vector = i;
+    if (request_irq(pci_irq_vector(dev, i), kvmfr_irq, 0, KVMFR_DEV_NAME,
+          &kdev->irqs[i]))
+      break;
+  }
+
+  kdev->vectors = i;
+  if (!kdev->vectors)
+    pci_free_irq_vectors(dev);
+
+  printk(KERN_INFO "kvmfr%d: %d doorbell vectors\n", kdev->minor, kdev->vectors);
+}
+
+static void kvmfr_pci_free_doorbell(struct pci_dev * dev, struct kvmfr_dev * kdev)
+{
+  int i;
+
+  for (i = 0; i < kdev->vectors; ++i)
+    free_irq(pci_irq_vector(dev, i), &kdev->irqs[i]);
+
+  if (kdev->vectors)
+    pci_free_irq_vectors(dev);
+
+  if (kdev->regs)
+    pci_iounmap(dev, kdev->regs);
+}
+
 static int kvmfr_pci_probe(struct pci_dev *dev, const struct pci_device_id *id)
 {
   struct kvmfr_dev *kdev;
@@ -339,6 +546,9 @@ static int kvmfr_pci_probe(struct pci_dev *dev, const struct pci_device_id *id)
   if (!kdev)
     return -ENOMEM;
 
+  spin_lock_init(&kdev->eventfdLock);
+  INIT_LIST_HEAD(&kdev->eventfds);
+
   if (pci_enable_device(dev))
     goto out_free;
 
@@ -382,6 +592,8 @@ static int kvmfr_pci_probe(struct pci_dev *dev, const struct pci_device_id *id)
   if (IS_ERR(kdev->addr))
     goto out_destroy;
 
+  kvmfr_pci_setup_doorbell(dev, kdev);
+
   pci_set_drvdata(dev, kdev);
   return 0;
 
@@ -404,6 +616,7 @@ static void kvmfr_pci_remove(struct pci_dev *dev)
 {
   struct kvmfr_dev *kdev = pci_get_drvdata(dev);
 
+  kvmfr_pci_free_doorbell(dev, kdev);
   devm_memunmap_pages(&dev->dev, &kdev->pgmap);
   device_destroy(kvmfr->pClass, kdev->devNo);
 
@@ -445,6 +658,9 @@ static int create_static_device_unlocked(int size_mb)
   if (!kdev)
     return -ENOMEM;
 
+  spin_lock_init(&kdev->eventfdLock);
+  INIT_LIST_HEAD(&kdev->eventfds);
+
   kdev->size = size_mb * 1024 * 1024;
   kdev->type = KVMFR_TYPE_STATIC;
   kdev->addr = vmalloc_user(kdev->size);
@@ -570,4 +786,4 @@ MODULE_DEVICE_TABLE(pci, kvmfr_pci_ids);
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Geoffrey McRae <geoff@hostfission.com>");
 MODULE_AUTHOR("Guanzhong Chen <quantum2048@gmail.com>");
-MODULE_VERSION("0.0.7");
+MODULE_VERSION("0.0.8");
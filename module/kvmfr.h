@@ -12,7 +12,21 @@ struct kvmfr_dmabuf_create {
   __u64 size;
 };
 
-#define KVMFR_DMABUF_GETSIZE _IO('u', 0x44)
-#define KVMFR_DMABUF_CREATE  _IOW('u', 0x42, struct kvmfr_dmabuf_create)
+/* ivshmem-doorbell devices only, each vector is one MSI-X interrupt */
+struct kvmfr_doorbell_ring {
+  __u16 peer;
+  __u16 vector;
+};
+
+struct kvmfr_doorbell_eventfd {
+  __u16 vector;
+  __s32 fd;
+};
+
+#define KVMFR_DMABUF_GETSIZE    _IO('u', 0x44)
+#define KVMFR_DMABUF_CREATE     _IOW('u', 0x42, struct kvmfr_dmabuf_create)
+#define KVMFR_DOORBELL_GETID    _IO('u', 0x45)
+#define KVMFR_DOORBELL_RING     _IOW('u', 0x46, struct kvmfr_doorbell_ring)
+#define KVMFR_DOORBELL_EVENTFD  _IOW('u', 0x47, struct kvmfr_doorbell_eventfd)
 
 #endif
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include <common/ivshmem.h>
 #include <common/KVMFR.h>
 #include <common/framebuffer.h>
+#include <common/cursor.h>
+#include <common/doorbell.h>
 #include <lgmp/client.h>
 
 #include <stdio.h>
@@ -34,11 +36,13 @@ typedef struct
   FrameType         type;
   int               bpp;
   struct IVSHMEM    shmDev;
+  KVMFRDoorbell   * doorbell;
   PLGMPClient       lgmp;
   PLGMPClientQueue  frameQueue, pointerQueue;
   gs_texture_t    * texture;
   uint8_t         * texData;
   uint32_t          linesize;
+  FrameBufferReader * reader;
 
   pthread_t         frameThread, pointerThread;
   os_sem_t        * frameSem;
@@ -54,6 +58,7 @@ typedef struct
   unsigned int         cursorCurVer;
   uint32_t             cursorSize;
   uint32_t           * cursorData;
+  uint64_t             cursorHash;
 }
 LGPlugin;
 
@@ -71,6 +76,8 @@ static void * lgCreate(obs_data_t * settings, obs_source_t * context)
   os_sem_init (&this->frameSem , 0);
   os_sem_init (&this->cursorSem, 1);
   atomic_store(&this->cursorVer, 0);
+  if (!framebuffer_reader_init(&this->reader, 0))
+    printf("failed to create the frame buffer reader, using a single thread\n");
   lgUpdate(this, settings);
   return this;
 }
@@ -135,6 +142,7 @@ static void lgDestroy(void * data)
   deinit(this);
   os_sem_destroy(this->frameSem );
   os_sem_destroy(this->cursorSem);
+  framebuffer_reader_free(&this->reader);
   bfree(this);
 }
 
@@ -213,6 +221,9 @@ static void * pointerThread(void * data)
     LGMP_STATUS status;
     LGMPMessage msg;
 
+    const uint32_t seq = this->doorbell ?
+      doorbellGetSeq(this->doorbell, KVMFR_DOORBELL_POINTER) : 0;
+
     if ((status = lgmpClientProcess(this->pointerQueue, &msg)) != LGMP_OK)
     {
       if (status != LGMP_ERR_QUEUE_EMPTY)
@@ -221,7 +232,10 @@ static void * pointerThread(void * data)
         break;
       }
 
-      usleep(1000);
+      if (this->doorbell)
+        doorbellWait(this->doorbell, NULL, KVMFR_DOORBELL_POINTER, seq, 100000);
+      else
+        usleep(1000);
       continue;
     }
 
@@ -229,56 +243,33 @@ static void * pointerThread(void * data)
     this->cursorVisible =
       msg.udata & CURSOR_FLAG_VISIBLE;
 
-    if (msg.udata & CURSOR_FLAG_SHAPE)
+    const uint8_t * const data = (const uint8_t * const)(cursor + 1);
+    const uint64_t hash = (msg.udata & CURSOR_FLAG_SHAPE) ?
+      cursor_hash(cursor->type, cursor->width, cursor->height, cursor->pitch,
+          data) : 0;
+
+    // skip shapes that are identical to the one we already have
+    if ((msg.udata & CURSOR_FLAG_SHAPE) && hash != this->cursorHash)
     {
       os_sem_wait(this->cursorSem);
-      const uint8_t * const data = (const uint8_t * const)(cursor + 1);
-      unsigned int dataSize = 0;
+      allocCursorData(this, cursor->height * cursor->width * sizeof(uint32_t));
 
       switch(cursor->type)
       {
         case CURSOR_TYPE_MASKED_COLOR:
-        {
-          dataSize = cursor->height * cursor->pitch;
-          allocCursorData(this, dataSize);
-
-          const uint32_t * s = (const uint32_t *)data;
-          uint32_t * d       = this->cursorData;
-          for(int i = 0; i < dataSize; ++i, ++s, ++d)
-            *d = (*s & ~0xFF000000) | (*s & 0xFF000000 ? 0x0 : 0xFF000000);
+          cursor_convert_masked(this->cursorData, data, cursor->width,
+              cursor->height, cursor->pitch);
           break;
-        }
 
         case CURSOR_TYPE_COLOR:
-        {
-          dataSize = cursor->height * cursor->pitch;
-          allocCursorData(this, dataSize);
-          memcpy(this->cursorData, data, dataSize);
+          cursor_convert_color(this->cursorData, data, cursor->width,
+              cursor->height, cursor->pitch);
           break;
-        }
 
         case CURSOR_TYPE_MONOCHROME:
-        {
-          dataSize = cursor->height * cursor->width * sizeof(uint32_t);
-          allocCursorData(this, dataSize);
-
-          const int hheight = cursor->height / 2;
-          uint32_t * d = this->cursorData;
-          for(int y = 0; y < hheight; ++y)
-            for(int x = 0; x < cursor->width; ++x)
-            {
-              const uint8_t  * srcAnd  = data   + (cursor->pitch * y) + (x / 8);
-              const uint8_t  * srcXor  = srcAnd + cursor->pitch * hheight;
-              const uint8_t    mask    = 0x80 >> (x % 8);
-              const uint32_t   andMask = (*srcAnd & mask) ? 0xFFFFFFFF : 0xFF000000;
-              const uint32_t   xorMask = (*srcXor & mask) ? 0x00FFFFFF : 0x00000000;
-
-              d[y * cursor->width + x                          ] = andMask;
-              d[y * cursor->width + x + cursor->width * hheight] = xorMask;
-            }
-
+          cursor_convert_mono(this->cursorData, data, cursor->width,
+              cursor->height, cursor->pitch);
           break;
-        }
 
         default:
           printf("Invalid cursor type\n");
@@ -288,6 +279,7 @@ static void * pointerThread(void * data)
       this->cursor.type   = cursor->type;
       this->cursor.width  = cursor->width;
       this->cursor.height = cursor->height;
+      this->cursorHash    = hash;
 
       atomic_fetch_add_explicit(&this->cursorVer, 1, memory_order_relaxed);
       os_sem_post(this->cursorSem);
@@ -307,6 +299,7 @@ static void * pointerThread(void * data)
   bfree(this->cursorData);
   this->cursorData = NULL;
   this->cursorSize = 0;
+  this->cursorHash = 0;
 
   this->state = STATE_STOPPING;
   return NULL;
@@ -346,6 +339,16 @@ static void lgUpdate(void * data, obs_data_t * settings)
     return;
   }
 
+  this->doorbell = NULL;
+  if (udata->doorbell &&
+      udata->doorbell + sizeof(KVMFRDoorbell) <= this->shmDev.size)
+  {
+    KVMFRDoorbell * db =
+      (KVMFRDoorbell *)((uint8_t *)this->shmDev.mem + udata->doorbell);
+    if (doorbellIsLocal(db))
+      this->doorbell = db;
+  }
+
   this->state = STATE_STARTING;
   pthread_create(&this->frameThread, NULL, frameThread, this);
   pthread_setname_np(this->frameThread, "LGFrameThread");
@@ -507,7 +510,8 @@ static void lgVideoTick(void * data, float seconds)
   if (this->texture)
   {
     FrameBuffer * fb = (FrameBuffer *)(((uint8_t*)frame) + frame->offset);
-    framebuffer_read(
+    framebuffer_read_mt(
+        this->reader,
         fb,
         this->texData,    // dst
         this->linesize,   // dstpitch